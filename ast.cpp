@@ -5,51 +5,296 @@
 
 using namespace AST;
 
-void FunctionDeclarationNode::postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                                 void (ASTNode::*func)(Compiler*, std::vector<Error>&)) {
-    for (auto& param : parameters) {
-        param->postorder_traverse(compiler, errors, func);
+void StatementBlockNode::provided_declarations(std::vector<const DeclarationNode*>& declarations) const {
+    for (auto& statement : statements) {
+        statement->provided_declarations(declarations);
     }
-    DeclarationNode::postorder_traverse(compiler, errors, func);
 }
 
-void BinaryOperatorNode::postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                            void (ASTNode::*func)(Compiler*, std::vector<Error>&)) {
-    left->postorder_traverse(compiler, errors, func);
-    right->postorder_traverse(compiler, errors, func);
-    ExpressionNode::postorder_traverse(compiler, errors, func);
+void InitializationStatementNode::provided_declarations(std::vector<const DeclarationNode*>& declarations) const {
+    declarations.push_back(declaration.get());
 }
 
-void UnaryOperatorNode::postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                           void (ASTNode::*func)(Compiler*, std::vector<Error>&)) {
-    expr->postorder_traverse(compiler, errors, func);
-    ExpressionNode::postorder_traverse(compiler, errors, func);
+void StructDefinitionNode::provided_declarations(std::vector<const DeclarationNode*>& declarations) const {
+    declarations.push_back(declaration.get());
+    for (auto& field : declaration->fields) {
+        declarations.push_back(field.get());
+    }
+    for (auto& member : declaration->members) {
+        member->provided_declarations(declarations);
+    }
 }
 
-void StatementBlockNode::postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                            void (ASTNode::*func)(Compiler*, std::vector<Error>&)) {
-    for (auto& statement : statements) {
-        statement->postorder_traverse(compiler, errors, func);
+void ActionDefinitionNode::provided_declarations(std::vector<const DeclarationNode*>& declarations) const {
+    declarations.push_back(declaration.get());
+}
+
+// Destroying an expression through its members' destructors recurses once per level, so the outermost
+// destructor takes the subexpressions of the whole tree and destroys them one at a time instead
+static thread_local std::vector<unq_ptr<ExpressionNode>>* pendingDestruction = nullptr;
+
+static void defer_destruction(std::vector<unq_ptr<ExpressionNode>>& pending, unq_ptr<ExpressionNode>& child) {
+    if (!child) {return;}
+    if (child->owners > 1) {
+        // Another parent still holds it
+        child->owners--;
+        child.release();
+        return;
     }
-    StatementNode::postorder_traverse(compiler, errors, func);
+    pending.push_back(std::move(child));
 }
 
-void InitializationStatementNode::postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                                     void (ASTNode::*func)(Compiler*, std::vector<Error>&)) {
-    declaration->postorder_traverse(compiler, errors, func);
-    value->postorder_traverse(compiler, errors, func);
-    StatementNode::postorder_traverse(compiler, errors, func);
+static void defer_destruction(std::vector<unq_ptr<ExpressionNode>>& pending, std::vector<unq_ptr<ExpressionNode>>& children) {
+    for (auto& child : children) {
+        defer_destruction(pending, child);
+    }
 }
 
-void MainBlockNode::postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                       void (ASTNode::*func)(Compiler*, std::vector<Error>&)) {
-    for (auto& statement : statements) {
-        statement->postorder_traverse(compiler, errors, func);
+template <class... Children>
+static void destroy_subexpressions(Children&... children) {
+    if (pendingDestruction) {
+        (defer_destruction(*pendingDestruction, children), ...);
+        return;
+    }
+
+    std::vector<unq_ptr<ExpressionNode>> pending;
+    pendingDestruction = &pending;
+    (defer_destruction(pending, children), ...);
+    while (!pending.empty()) {
+        // Its destructor adds its own subexpressions to pending
+        unq_ptr<ExpressionNode> node = std::move(pending.back());
+        pending.pop_back();
+        node.reset();
     }
-    ASTNode::postorder_traverse(compiler, errors, func);
+    pendingDestruction = nullptr;
+}
+
+PointNode::~PointNode() {destroy_subexpressions(x, y);}
+ListNode::~ListNode() {destroy_subexpressions(elements);}
+IndexNode::~IndexNode() {destroy_subexpressions(list, index);}
+CallNode::~CallNode() {destroy_subexpressions(function, arguments);}
+MemberAccessNode::~MemberAccessNode() {destroy_subexpressions(object);}
+StructInitializerNode::~StructInitializerNode() {destroy_subexpressions(arguments);}
+BinaryOperatorNode::~BinaryOperatorNode() {destroy_subexpressions(left, right);}
+UnaryOperatorNode::~UnaryOperatorNode() {destroy_subexpressions(expr);}
+TernaryOperatorNode::~TernaryOperatorNode() {destroy_subexpressions(condition, ifTrue, ifFalse);}
+ComprehensionNode::~ComprehensionNode() {destroy_subexpressions(start, end, body, unrolled);}
+SolveNode::~SolveNode() {destroy_subexpressions(left, right);}
+DerivativeNode::~DerivativeNode() {destroy_subexpressions(expr, variable, derivative);}
+
+template <class T>
+static unq_ptr<T> copy_node(const T* node) {
+    auto copy = std::make_unique<T>(*node);
+    copy->owners = 1;
+    return copy;
+}
+
+// Copying an expression by substituting into each of its subexpressions would recurse once per level too, so
+// each substitute() copies only its own node, and the outermost one copies the queued subexpressions one at a time.
+// Bindings made for the subexpressions of comprehensions and equations are kept until the whole copy is done.
+namespace {
+    struct PendingCopy {
+        unq_ptr<ExpressionNode>* slot;
+        const ExpressionNode* source;
+        const Bindings* bindings;
+    };
+
+    struct Substitution {
+        std::vector<PendingCopy> pending;
+        std::vector<unq_ptr<Bindings>> bindings;
+        std::vector<unq_ptr<IdentifierNode>> references;
+    };
+}
+
+static thread_local Substitution* substitution = nullptr;
+static const Bindings NO_BINDINGS;
+
+// Queues the copy of source that goes in slot, which has to stay where it is until the copy is done
+static void substitute_into(unq_ptr<ExpressionNode>& slot, const ExpressionNode* source, const Bindings& bindings) {
+    if (source) {substitution->pending.push_back({&slot, source, &bindings});}
+}
+
+template <class Copy>
+static unq_ptr<ExpressionNode> substitute_node(Copy copy) {
+    if (substitution) {return copy();}
+
+    Substitution outermost;
+    substitution = &outermost;
+    unq_ptr<ExpressionNode> node = copy();
+    while (!outermost.pending.empty()) {
+        PendingCopy next = outermost.pending.back();
+        outermost.pending.pop_back();
+        // Only copies the node itself, queueing its subexpressions
+        *next.slot = next.source->substitute(*next.bindings);
+    }
+    substitution = nullptr;
+    return node;
+}
+
+// A copy of a comprehension's variable or an equation's unknown, for the copy's subexpressions to refer to
+static const Bindings& bind_copy(const Bindings& bindings, const DeclarationNode* original, const DeclarationNode* copy) {
+    auto reference = std::make_unique<IdentifierNode>(original->pos, original->identifier, original->scope, nullptr);
+    reference->declaration = (DeclarationNode*) copy;
+    reference->type = original->type;
+    auto scoped = std::make_unique<Bindings>(bindings);
+    (*scoped)[original] = reference.get();
+    substitution->references.push_back(std::move(reference));
+    substitution->bindings.push_back(std::move(scoped));
+    return *substitution->bindings.back();
+}
+
+unq_ptr<ExpressionNode> LiteralNode::substitute(const Bindings& bindings) const {
+    return copy_node(this);
+}
+
+unq_ptr<ExpressionNode> IdentifierNode::substitute(const Bindings& bindings) const {
+    auto binding = bindings.find(declaration);
+    if (declaration && binding != bindings.end()) {
+        // The bound expression has already had its own bindings applied
+        return substitute_node([&] {return binding->second->substitute(NO_BINDINGS);});
+    }
+    return copy_node(this);
+}
+
+unq_ptr<ExpressionNode> PointNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<PointNode>(pos, nullptr, nullptr);
+        substitute_into(node->x, x.get(), bindings);
+        substitute_into(node->y, y.get(), bindings);
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> ListNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<ListNode>(pos);
+        node->elements.resize(elements.size());
+        for (size_t i = 0; i < elements.size(); i++) {
+            substitute_into(node->elements[i], elements[i].get(), bindings);
+        }
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> IndexNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<IndexNode>(pos, nullptr, nullptr);
+        substitute_into(node->list, list.get(), bindings);
+        substitute_into(node->index, index.get(), bindings);
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> CallNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<CallNode>(pos, nullptr);
+        substitute_into(node->function, function.get(), bindings);
+        node->arguments.resize(arguments.size());
+        for (size_t i = 0; i < arguments.size(); i++) {
+            substitute_into(node->arguments[i], arguments[i].get(), bindings);
+        }
+        node->type = type;
+        return node;
+    });
+}
+
+const builtins::Builtin* CallNode::builtin() const {
+    return ((const IdentifierNode*) function.get())->builtin;
+}
+
+unq_ptr<ExpressionNode> MemberAccessNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<MemberAccessNode>(pos, nullptr, member);
+        substitute_into(node->object, object.get(), bindings);
+        node->memberDeclaration = memberDeclaration;
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> StructInitializerNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<StructInitializerNode>(pos);
+        node->arguments.resize(arguments.size());
+        for (size_t i = 0; i < arguments.size(); i++) {
+            substitute_into(node->arguments[i], arguments[i].get(), bindings);
+        }
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> BinaryOperatorNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<BinaryOperatorNode>(pos, op, nullptr, nullptr);
+        substitute_into(node->left, left.get(), bindings);
+        substitute_into(node->right, right.get(), bindings);
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> UnaryOperatorNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<UnaryOperatorNode>(pos, op, nullptr);
+        substitute_into(node->expr, expr.get(), bindings);
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> TernaryOperatorNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<TernaryOperatorNode>(pos, nullptr, nullptr, nullptr);
+        substitute_into(node->condition, condition.get(), bindings);
+        substitute_into(node->ifTrue, ifTrue.get(), bindings);
+        substitute_into(node->ifFalse, ifFalse.get(), bindings);
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> ComprehensionNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        // The copy has a variable of its own, which its body refers to
+        auto copy = std::make_unique<DeclarationNode>(variable->pos, variable->type, variable->identifier, variable->scope);
+        const Bindings& bodyBindings = bind_copy(bindings, variable.get(), copy.get());
+
+        auto node = std::make_unique<ComprehensionNode>(pos, std::move(copy), nullptr, nullptr, nullptr);
+        substitute_into(node->start, start.get(), bindings);
+        substitute_into(node->end, end.get(), bindings);
+        substitute_into(node->body, body.get(), bodyBindings);
+        substitute_into(node->unrolled, unrolled.get(), bindings);
+        node->type = type;
+        return node;
+    });
+}
+
+unq_ptr<ExpressionNode> SolveNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        // The copy has an unknown of its own, which its equation refers to
+        auto copy = std::make_unique<DeclarationNode>(unknown->pos, unknown->type, unknown->identifier, unknown->scope);
+        const Bindings& equationBindings = bind_copy(bindings, unknown.get(), copy.get());
+
+        auto node = std::make_unique<SolveNode>(pos, std::move(copy), nullptr, nullptr, definition);
+        substitute_into(node->left, left.get(), equationBindings);
+        substitute_into(node->right, right.get(), equationBindings);
+        node->root = root;
+        node->type = type;
+        return node;
+    });
 }
 
-void ASTNode::postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                 void (ASTNode::*func)(Compiler*, std::vector<Error>&)) {
-    (this->*func)(compiler, errors);
+unq_ptr<ExpressionNode> DerivativeNode::substitute(const Bindings& bindings) const {
+    return substitute_node([&] {
+        auto node = std::make_unique<DerivativeNode>(pos, nullptr, nullptr);
+        substitute_into(node->expr, expr.get(), bindings);
+        substitute_into(node->variable, variable.get(), NO_BINDINGS);
+        substitute_into(node->derivative, derivative.get(), bindings);
+        node->type = type;
+        return node;
+    });
 }
@@ -5,40 +5,87 @@
 #ifndef DESMOS_COMPILER_AST_H
 #define DESMOS_COMPILER_AST_H
 
+#include <optional>
+#include <cstdint>
+
 #include "compiler.h"
 #include "frontend.h"
 
+// Forward declarations
+namespace vm {class Assembler;}
+namespace modules {class Module;}
+namespace builtins {struct Builtin;}
+
 namespace AST {
     using namespace frontend;
     
     template <class T>
     using unq_ptr = std::unique_ptr<T>;
 
+    struct DeclarationNode;
+    struct StructDeclarationNode;
+    struct ExpressionNode;
+    class Emitter;
+
+    // Maps declarations to the expressions that references to them should be replaced with
+    using Bindings = std::unordered_map<const DeclarationNode*, const ExpressionNode*>;
+
+    // The concrete type of a node, so that passes can dispatch on it without virtual calls (see visitor.h)
+    enum class NodeKind : uint8_t {
+        LITERAL, IDENTIFIER, POINT, LIST, INDEX, CALL, MEMBER_ACCESS, STRUCT_INITIALIZER,
+        BINARY_OPERATOR, UNARY_OPERATOR, TERNARY_OPERATOR, COMPREHENSION, SOLVE, DERIVATIVE,
+        DECLARATION, FUNCTION_DECLARATION, STRUCT_DECLARATION, ACTION_DECLARATION, TICKER_STATE_DECLARATION, HOISTED_DECLARATION,
+        STATEMENT_BLOCK, INITIALIZATION, STRUCT_DEFINITION, ASSIGNMENT, ACTION_CALL, ACTION_DEFINITION, TICKER, IMPORT,
+        TICKER_SCHEDULE, MAIN_BLOCK
+    };
+
     struct ASTNode {
+        const NodeKind kind;
         SrcPos pos;
 
-        virtual void postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                             void (ASTNode::*func)(Compiler*, std::vector<Error>&));
         virtual void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {}
+        // Runs once every node has been through semantic analysis
+        virtual void late_analysis(Compiler* compiler, std::vector<Error>& errors) {}
         virtual void compile(std::ostream& out) const = 0;
 
-        explicit ASTNode(SrcPos pos) : pos(pos) {}
+        ASTNode(NodeKind kind, SrcPos pos) : kind(kind), pos(pos) {}
         virtual ~ASTNode() = default;
     };
 
     struct ExpressionNode : ASTNode {
         Type type;
         virtual int precedence() const = 0;
-        explicit ExpressionNode(SrcPos pos) : ASTNode(pos) {}
+        // Deep copy of the expression, with bound identifiers replaced by copies of their bindings
+        virtual unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const = 0;
+        // The value of a num or bool expression, if it can be computed at compile time
+        std::optional<double> constant_value() const {return isFolded ? folded : fold();}
+        // Computes the constant value from those of the subexpressions
+        virtual std::optional<double> fold() const {return std::nullopt;}
+        // Emits bytecode that evaluates the expression into register dest (see vm.h)
+        virtual void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const = 0;
+        // Expressions are written through an Emitter (see backend.cpp), which expands subexpressions without recursing
+        void compile(std::ostream& out) const final;
+        virtual void emit(Emitter& emitter) const = 0;
+        // Cached by constant folding during semantic analysis (identifiers are never cached, since their
+        // declarations' values may not have been analyzed yet)
+        std::optional<double> folded;
+        bool isFolded = false;
+        // Parents holding the node, which is more than one when identical subexpressions are shared (see parser.cpp)
+        uint32_t owners = 1;
+
+        ExpressionNode(NodeKind kind, SrcPos pos) : ASTNode(kind, pos) {}
     };
 
     struct LiteralNode : ExpressionNode {
         double value;
 
         int precedence() const override {return 0;}
-        void compile(std::ostream& out) const override;
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        std::optional<double> fold() const override {return value;}
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
 
-        LiteralNode(SrcPos pos, Type type, double value) : ExpressionNode(pos), value(value) {
+        LiteralNode(SrcPos pos, Type type, double value) : ExpressionNode(NodeKind::LITERAL, pos), value(value) {
             this->type = type;
         }
     };
@@ -46,34 +93,147 @@ namespace AST {
     struct IdentifierNode : ExpressionNode {
         std::string_view identifier;
         SymbolScope* scope;
+        DeclarationNode* context; // The declaration whose value this appears in, if any
+        DeclarationNode* declaration = nullptr; // Set during semantic analysis
+        // Set by the parser on the names of calls to builtin functions. A declaration of the same name takes its
+        // place during semantic analysis, unless the call was written with a '$'.
+        const builtins::Builtin* builtin = nullptr;
+        bool isExplicitBuiltin = false;
+        mutable bool isEvaluating = false; // Guards fold() against cyclic definitions
 
         int precedence() const override {return 0;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        std::optional<double> fold() const override;
         void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
-        void compile(std::ostream& out) const override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        IdentifierNode(SrcPos pos, std::string_view identifier, SymbolScope* scope, DeclarationNode* context) : ExpressionNode(NodeKind::IDENTIFIER, pos), identifier(identifier), scope(scope), context(context) {}
+    };
+
+    struct PointNode : ExpressionNode {
+        unq_ptr<ExpressionNode> x;
+        unq_ptr<ExpressionNode> y;
+
+        int precedence() const override {return 0;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        PointNode(SrcPos pos, unq_ptr<ExpressionNode> x, unq_ptr<ExpressionNode> y) : ExpressionNode(NodeKind::POINT, pos), x(std::move(x)), y(std::move(y)) {}
+        ~PointNode() override;
+    };
+
+    struct ListNode : ExpressionNode {
+        std::vector<unq_ptr<ExpressionNode>> elements;
+
+        int precedence() const override {return 0;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
 
-        IdentifierNode(SrcPos pos, std::string_view identifier, SymbolScope* scope) : ExpressionNode(pos), identifier(identifier), scope(scope) {}
+        explicit ListNode(SrcPos pos) : ExpressionNode(NodeKind::LIST, pos), elements() {}
+        ~ListNode() override;
+    };
+
+    struct IndexNode : ExpressionNode {
+        unq_ptr<ExpressionNode> list;
+        unq_ptr<ExpressionNode> index;
+
+        int precedence() const override {return 1;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        IndexNode(SrcPos pos, unq_ptr<ExpressionNode> list, unq_ptr<ExpressionNode> index) : ExpressionNode(NodeKind::INDEX, pos), list(std::move(list)), index(std::move(index)) {}
+        ~IndexNode() override;
+    };
+
+    struct CallNode : ExpressionNode {
+        unq_ptr<ExpressionNode> function;
+        std::vector<unq_ptr<ExpressionNode>> arguments;
+
+        int precedence() const override {return 1;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        std::optional<double> fold() const override;
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        // The builtin function called, if it isn't a declared one
+        const builtins::Builtin* builtin() const;
+
+        CallNode(SrcPos pos, unq_ptr<ExpressionNode> function) : ExpressionNode(NodeKind::CALL, pos), function(std::move(function)), arguments() {}
+        ~CallNode() override;
+    };
+
+    struct MemberAccessNode : ExpressionNode {
+        unq_ptr<ExpressionNode> object;
+        std::string_view member;
+        DeclarationNode* memberDeclaration = nullptr; // Set during semantic analysis; nullptr for point coordinates
+
+        int precedence() const override {return 1;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        MemberAccessNode(SrcPos pos, unq_ptr<ExpressionNode> object, std::string_view member) : ExpressionNode(NodeKind::MEMBER_ACCESS, pos), object(std::move(object)), member(member) {}
+        ~MemberAccessNode() override;
+    };
+
+    struct StructInitializerNode : ExpressionNode {
+        std::vector<unq_ptr<ExpressionNode>> arguments;
+
+        int precedence() const override {return 0;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        explicit StructInitializerNode(SrcPos pos) : ExpressionNode(NodeKind::STRUCT_INITIALIZER, pos), arguments() {}
+        ~StructInitializerNode() override;
     };
 
     struct DeclarationNode : ASTNode {
         Type type;
         std::string_view identifier;
         SymbolScope* scope;
+        ExpressionNode* value = nullptr; // The value it is initialized with, if any
 
-        virtual bool isFunction() const {return false;}
-        void compile(std::ostream& out) const override;
+        // For fields and members of a struct: the struct, and whether the value differs between instances
+        StructDeclarationNode* parentStruct = nullptr;
+        bool isPerInstance = false;
+        // For struct instances: its position in its struct's list of instances, set when it is registered
+        long instanceIndex = -1;
 
-        DeclarationNode(SrcPos pos, Type type, std::string_view identifier, SymbolScope* scope) : ASTNode(pos), type(type), identifier(identifier), scope(scope) {}
+        size_t uses = 0; // References to it, counted during semantic analysis
+        std::string minifiedName; // Emitted in place of its name, if set (see minify.cpp)
+
+        virtual bool isFunction() const {return false;}
+        virtual bool isStruct() const {return false;}
+        // Writes minifiedName if it is set, and otherwise the usual name of the kind of declaration
+        void compile(std::ostream& out) const final;
+        virtual void compile_name(std::ostream& out) const;
+
+        DeclarationNode(SrcPos pos, Type type, std::string_view identifier, SymbolScope* scope) : DeclarationNode(NodeKind::DECLARATION, pos, type, identifier, scope) {}
+    protected:
+        DeclarationNode(NodeKind kind, SrcPos pos, Type type, std::string_view identifier, SymbolScope* scope) : ASTNode(kind, pos), type(type), identifier(identifier), scope(scope) {}
     };
 
     struct FunctionDeclarationNode : DeclarationNode {
         std::vector<unq_ptr<DeclarationNode>> parameters;
+        uint32_t signature = 0; // Its parameter types, interned (see SignatureTable)
+        bool isOverloaded = false; // Whether another function in its scope has its name, so calls are resolved by signature
 
         bool isFunction() const override {return true;}
-        void postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                     void (ASTNode::*func)(Compiler*, std::vector<Error>&)) override;
-        void compile(std::ostream& out) const override;
+        void compile_name(std::ostream& out) const override;
 
-        FunctionDeclarationNode(SrcPos pos, Type type, std::string_view identifier, SymbolScope* scope) : DeclarationNode(pos, type, identifier, scope), parameters() {}
+        FunctionDeclarationNode(SrcPos pos, Type type, std::string_view identifier, SymbolScope* scope) : FunctionDeclarationNode(NodeKind::FUNCTION_DECLARATION, pos, type, identifier, scope) {}
+    protected:
+        FunctionDeclarationNode(NodeKind kind, SrcPos pos, Type type, std::string_view identifier, SymbolScope* scope) : DeclarationNode(kind, pos, type, identifier, scope), parameters() {}
     };
 
     struct BinaryOperatorNode : ExpressionNode {
@@ -82,12 +242,14 @@ namespace AST {
         unq_ptr<ExpressionNode> right;
 
         int precedence() const override;
-        void postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                     void (ASTNode::*func)(Compiler*, std::vector<Error>&)) override;
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        std::optional<double> fold() const override;
         void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
-        void compile(std::ostream& out) const override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
 
-        BinaryOperatorNode(SrcPos pos, Operator op, unq_ptr<ExpressionNode> left, unq_ptr<ExpressionNode> right) : ExpressionNode(pos), op(op), left(std::move(left)), right(std::move(right)) {}
+        BinaryOperatorNode(SrcPos pos, Operator op, unq_ptr<ExpressionNode> left, unq_ptr<ExpressionNode> right) : ExpressionNode(NodeKind::BINARY_OPERATOR, pos), op(op), left(std::move(left)), right(std::move(right)) {}
+        ~BinaryOperatorNode() override;
     };
 
     struct UnaryOperatorNode : ExpressionNode {
@@ -95,47 +257,300 @@ namespace AST {
         unq_ptr<ExpressionNode> expr;
 
         int precedence() const override;
-        void postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                     void (ASTNode::*func)(Compiler*, std::vector<Error>&)) override;
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        std::optional<double> fold() const override;
         void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
-        void compile(std::ostream& out) const override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
 
-        UnaryOperatorNode(SrcPos pos, Operator op, unq_ptr<ExpressionNode> expr) : ExpressionNode(pos), op(op), expr(std::move(expr)) {}
+        UnaryOperatorNode(SrcPos pos, Operator op, unq_ptr<ExpressionNode> expr) : ExpressionNode(NodeKind::UNARY_OPERATOR, pos), op(op), expr(std::move(expr)) {}
+        ~UnaryOperatorNode() override;
+    };
+
+    struct TernaryOperatorNode : ExpressionNode {
+        unq_ptr<ExpressionNode> condition;
+        unq_ptr<ExpressionNode> ifTrue;
+        unq_ptr<ExpressionNode> ifFalse; // nullptr if there is no else branch (undefined)
+
+        int precedence() const override {return 0;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        std::optional<double> fold() const override;
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        TernaryOperatorNode(SrcPos pos, unq_ptr<ExpressionNode> condition, unq_ptr<ExpressionNode> ifTrue, unq_ptr<ExpressionNode> ifFalse)
+            : ExpressionNode(NodeKind::TERNARY_OPERATOR, pos), condition(std::move(condition)), ifTrue(std::move(ifTrue)), ifFalse(std::move(ifFalse)) {}
+        ~TernaryOperatorNode() override;
+    };
+
+    // [body for variable=[start...end]]: the body's value for each number from start to end, counting by 1 (down if
+    // end is less than start). Written as 'for variable in [start...end] type name = body;' (see parse_for).
+    struct ComprehensionNode : ExpressionNode {
+        static constexpr double MAX_SIZE = 10000; // Desmos' limit on the length of a list
+        static constexpr double MAX_UNROLLED = 8;
+
+        unq_ptr<DeclarationNode> variable;
+        unq_ptr<ExpressionNode> start;
+        unq_ptr<ExpressionNode> end;
+        unq_ptr<ExpressionNode> body;
+        // Set during late analysis if the range is constant and at most MAX_UNROLLED long: the list of the body's
+        // values, which takes the comprehension's place from then on
+        unq_ptr<ExpressionNode> unrolled;
+
+        int precedence() const override {return 0;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void late_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        // The number of elements, if the range is constant
+        std::optional<double> size() const;
+
+        ComprehensionNode(SrcPos pos, unq_ptr<DeclarationNode> variable, unq_ptr<ExpressionNode> start, unq_ptr<ExpressionNode> end, unq_ptr<ExpressionNode> body)
+            : ExpressionNode(NodeKind::COMPREHENSION, pos), variable(std::move(variable)), start(std::move(start)), end(std::move(end)), body(std::move(body)) {}
+        ~ComprehensionNode() override;
+    };
+
+    // $solve(left = right), as the value of a definition: the value of the definition that makes both sides equal,
+    // where the sides refer to it by its own name. Solved during semantic analysis if nothing else in the equation
+    // changes (see solver.cpp), and otherwise emitted as the regression left~right, which Desmos fits at runtime.
+    struct SolveNode : ExpressionNode {
+        unq_ptr<DeclarationNode> unknown; // Named like the definition, which it stands for in the equation
+        unq_ptr<ExpressionNode> left;
+        unq_ptr<ExpressionNode> right;
+        DeclarationNode* definition;
+        // Set during semantic analysis if the equation is constant; the solution takes the equation's place from then on
+        std::optional<double> root;
+
+        int precedence() const override {return 0;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        std::optional<double> fold() const override {return root;}
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        // Writes the equation as a regression, for an equation that isn't constant
+        void compile_regression(std::ostream& out) const;
+        // Finds a root of left - right if the equation only depends on constants and the unknown, and returns
+        // whether it does
+        bool solve();
+
+        SolveNode(SrcPos pos, unq_ptr<DeclarationNode> unknown, unq_ptr<ExpressionNode> left, unq_ptr<ExpressionNode> right, DeclarationNode* definition)
+            : ExpressionNode(NodeKind::SOLVE, pos), unknown(std::move(unknown)), left(std::move(left)), right(std::move(right)), definition(definition) {}
+        ~SolveNode() override;
+    };
+
+    // $d(expr, variable): the derivative of a num or point expression with respect to a num. Found symbolically
+    // during late analysis (see derivative.cpp), so that Desmos evaluates a closed form instead of differentiating
+    // numerically.
+    struct DerivativeNode : ExpressionNode {
+        unq_ptr<ExpressionNode> expr;
+        unq_ptr<ExpressionNode> variable; // An identifier
+        // Set during late analysis, and takes the node's place from then on
+        unq_ptr<ExpressionNode> derivative;
+
+        int precedence() const override {return derivative ? derivative->precedence() : 0;}
+        unq_ptr<ExpressionNode> substitute(const Bindings& bindings) const override;
+        std::optional<double> fold() const override {return derivative ? derivative->constant_value() : std::nullopt;}
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void late_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void emit(Emitter& emitter) const override;
+        void compile_bytecode(vm::Assembler& assembler, uint32_t dest) const override;
+
+        // Sets the derivative, if it hasn't been yet (an inlined definition can be differentiated before its own
+        // late analysis)
+        void differentiate(Compiler* compiler, std::vector<Error>& errors);
+
+        DerivativeNode(SrcPos pos, unq_ptr<ExpressionNode> expr, unq_ptr<ExpressionNode> variable)
+            : ExpressionNode(NodeKind::DERIVATIVE, pos), expr(std::move(expr)), variable(std::move(variable)) {}
+        ~DerivativeNode() override;
     };
 
     struct StatementNode : ASTNode {
-        explicit StatementNode(SrcPos pos) : ASTNode(pos) {}
+        // The declarations whose Desmos definitions this statement emits (including those of nested statements)
+        virtual void provided_declarations(std::vector<const DeclarationNode*>& declarations) const {}
+
+        StatementNode(NodeKind kind, SrcPos pos) : ASTNode(kind, pos) {}
     };
 
     struct StatementBlockNode : StatementNode {
         std::vector<unq_ptr<StatementNode>> statements;
 
-        void postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                     void (ASTNode::*func)(Compiler*, std::vector<Error>&)) override;
+        void provided_declarations(std::vector<const DeclarationNode*>& declarations) const override;
         void compile(std::ostream& out) const override;
 
-        explicit StatementBlockNode(SrcPos pos) : StatementNode(pos), statements() {}
+        explicit StatementBlockNode(SrcPos pos) : StatementNode(NodeKind::STATEMENT_BLOCK, pos), statements() {}
     };
 
     struct InitializationStatementNode : StatementNode {
         unq_ptr<DeclarationNode> declaration;
         unq_ptr<ExpressionNode> value;
 
-        void postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                     void (ASTNode::*func)(Compiler*, std::vector<Error>&)) override;
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void provided_declarations(std::vector<const DeclarationNode*>& declarations) const override;
+        void compile(std::ostream& out) const override;
+
+        InitializationStatementNode(unq_ptr<DeclarationNode> left, unq_ptr<ExpressionNode> right) : StatementNode(NodeKind::INITIALIZATION, left->pos), declaration(std::move(left)), value(std::move(right)) {
+            declaration->value = value.get();
+        }
+    };
+
+    // All instances of a struct share one Desmos list per field and member (structure of arrays),
+    // so each member expression is only emitted once and is evaluated over every instance
+    struct StructDeclarationNode : DeclarationNode {
+        std::vector<unq_ptr<DeclarationNode>> fields;
+        std::vector<unq_ptr<InitializationStatementNode>> members;
+        SymbolScope* memberScope = nullptr;
+
+        // Set during semantic analysis
+        std::vector<const InitializationStatementNode*> instances;
+        std::vector<std::pair<DeclarationNode*, DeclarationNode*>> memberReferences; // (member, field or member it references)
+
+        bool isStruct() const override {return true;}
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+
+        StructDeclarationNode(SrcPos pos, std::string_view identifier, SymbolScope* scope) : DeclarationNode(NodeKind::STRUCT_DECLARATION, pos, Type(identifier), identifier, scope), fields(), members() {}
+    };
+
+    struct StructDefinitionNode : StatementNode {
+        unq_ptr<StructDeclarationNode> declaration;
+
+        void provided_declarations(std::vector<const DeclarationNode*>& declarations) const override;
+        void compile(std::ostream& out) const override;
+        // The list of every instance's value for one field
+        void compile_field(std::ostream& out, size_t field) const;
+
+        explicit StructDefinitionNode(unq_ptr<StructDeclarationNode> declaration) : StatementNode(NodeKind::STRUCT_DEFINITION, declaration->pos), declaration(std::move(declaration)) {}
+    };
+
+    // target := value. Compound assignments (+= etc.) are expanded by the parser.
+    struct AssignmentStatementNode : StatementNode {
+        unq_ptr<IdentifierNode> target;
+        unq_ptr<ExpressionNode> value;
+
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void compile(std::ostream& out) const override;
+
+        AssignmentStatementNode(SrcPos pos, unq_ptr<IdentifierNode> target, unq_ptr<ExpressionNode> value) : StatementNode(NodeKind::ASSIGNMENT, pos), target(std::move(target)), value(std::move(value)) {}
+    };
+
+    // Runs another action (an identifier or a call with arguments)
+    struct ActionCallStatementNode : StatementNode {
+        unq_ptr<ExpressionNode> action;
+
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void compile(std::ostream& out) const override;
+
+        ActionCallStatementNode(SrcPos pos, unq_ptr<ExpressionNode> action) : StatementNode(NodeKind::ACTION_CALL, pos), action(std::move(action)) {}
+    };
+
+    // Actions are lowered to a single Desmos action (a \to ..., b \to ...): assignments are applied in order
+    // by substituting earlier assignments into later ones, and calls to other actions are inlined.
+    struct ActionDeclarationNode : FunctionDeclarationNode {
+        bool hasParameters; // 'action f() = ...' is a function, 'action f = ...' isn't
+        std::vector<unq_ptr<StatementNode>> body;
+
+        // Set during late analysis: the final value of each assigned variable, in terms of the values before the action ran
+        std::vector<std::pair<DeclarationNode*, unq_ptr<ExpressionNode>>> assignments;
+        enum {UNLOWERED, LOWERING, LOWERED} lowering = UNLOWERED;
+
+        bool isFunction() const override {return hasParameters;}
+        void late_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void compile_name(std::ostream& out) const override;
+
+        void lower(std::vector<Error>& errors);
+        void lower_statement(const StatementNode* statement, std::vector<Error>& errors, const ExpressionNode* condition = nullptr);
+
+        ActionDeclarationNode(SrcPos pos, std::string_view identifier, SymbolScope* scope) : FunctionDeclarationNode(NodeKind::ACTION_DECLARATION, pos, Type(Type::ACTION), identifier, scope), hasParameters(false), body() {}
+    };
+
+    struct ActionDefinitionNode : StatementNode {
+        unq_ptr<ActionDeclarationNode> declaration;
+
+        void provided_declarations(std::vector<const DeclarationNode*>& declarations) const override;
+        void compile(std::ostream& out) const override;
+        static void compile_action(std::ostream& out, const ActionDeclarationNode* declaration);
+
+        explicit ActionDefinitionNode(unq_ptr<ActionDeclarationNode> declaration) : StatementNode(NodeKind::ACTION_DEFINITION, declaration->pos), declaration(std::move(declaration)) {}
+    };
+
+    // ticker action <period=ms>;
+    struct TickerNode : StatementNode {
+        unq_ptr<ActionCallStatementNode> action;
+        unq_ptr<ExpressionNode> period; // nullptr to run on every tick
+
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void compile(std::ostream& out) const override;
+
+        TickerNode(SrcPos pos, unq_ptr<ActionCallStatementNode> action, unq_ptr<ExpressionNode> period) : StatementNode(NodeKind::TICKER, pos), action(std::move(action)), period(std::move(period)) {}
+    };
+
+    // import name; makes the exported symbols of name.desm visible at the top level
+    struct ImportStatementNode : StatementNode {
+        std::string_view name;
+        modules::Module* module; // Owned by the compiler
+
+        void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) override;
+        void compile(std::ostream& out) const override;
+
+        ImportStatementNode(SrcPos pos, std::string_view name, modules::Module* module) : StatementNode(NodeKind::IMPORT, pos), name(name), module(module) {}
+    };
+
+    // Variables that only exist to drive the ticker schedule
+    struct TickerStateDeclarationNode : DeclarationNode {
+        std::string name;
+
+        void compile_name(std::ostream& out) const override;
+
+        TickerStateDeclarationNode(SrcPos pos, std::string name, SymbolScope* scope) : DeclarationNode(NodeKind::TICKER_STATE_DECLARATION, pos, Type(Type::NUM), "", scope), name(std::move(name)) {
+            identifier = this->name;
+        }
+    };
+
+    // A subexpression moved into a definition of its own by invariant hoisting (see hoisting.cpp)
+    struct HoistedDeclarationNode : DeclarationNode {
+        size_t number;
+        std::string name;
+
+        void compile_name(std::ostream& out) const override;
+
+        HoistedDeclarationNode(SrcPos pos, Type type, size_t number, SymbolScope* scope) : DeclarationNode(NodeKind::HOISTED_DECLARATION, pos, type, "", scope), number(number), name("H" + std::to_string(number)) {
+            identifier = this->name;
+        }
+    };
+
+    // Desmos only allows one ticker per graph, so every ticker in the program is merged into a single
+    // dispatch action that runs every basePeriod ms. Tickers with a constant period fire on the ticks where
+    // a shared tick counter is a multiple of their period; tickers with a dynamic period fire once their
+    // own count of elapsed time reaches the period.
+    struct TickerScheduleNode : ASTNode {
+        static constexpr long DEFAULT_BASE_PERIOD = 16; // Used if no ticker has a constant period (about one frame)
+        static constexpr long MAX_TICK_CYCLE = 1000000; // Larger cycles let the tick counter grow instead of wrapping
+
+        std::vector<TickerNode*> tickers; // Registered during semantic analysis
+
+        // Set by build(). A base period of 0 runs as often as Desmos allows.
+        long basePeriod = 0;
+        unq_ptr<ActionDeclarationNode> dispatch;
+        std::vector<unq_ptr<TickerStateDeclarationNode>> state;
+
+        void build(std::vector<Error>& errors);
         void compile(std::ostream& out) const override;
 
-        InitializationStatementNode(unq_ptr<DeclarationNode> left, unq_ptr<ExpressionNode> right) : StatementNode(left->pos), declaration(std::move(left)), value(std::move(right)) {}
+        explicit TickerScheduleNode(SrcPos pos) : ASTNode(NodeKind::TICKER_SCHEDULE, pos), tickers(), state() {}
     };
 
     struct MainBlockNode : ASTNode {
         std::vector<unq_ptr<StatementNode>> statements;
+        TickerScheduleNode tickerSchedule;
+        std::vector<const StatementNode*> emissionOrder; // Set during late analysis: statements after everything they depend on
 
-        void postorder_traverse(Compiler* compiler, std::vector<Error>& errors,
-                                     void (ASTNode::*func)(Compiler*, std::vector<Error>&)) override;
+        void late_analysis(Compiler* compiler, std::vector<Error>& errors) override;
         void compile(std::ostream& out) const override;
 
-        explicit MainBlockNode(SrcPos pos) : ASTNode(pos), statements() {}
+        explicit MainBlockNode(SrcPos pos) : ASTNode(NodeKind::MAIN_BLOCK, pos), statements(), tickerSchedule(pos) {}
     };
 }
 
@@ -3,13 +3,21 @@
 //
 
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <cstdlib>
+#include <unordered_set>
 
 #include "compiler.h"
 #include "ast.h"
+#include "module.h"
+#include "builtins.h"
 
 using namespace AST;
 
 void Compiler::compile_backend(std::ostream& out) {
+    if (prelude) {prelude->compile(out);}
     ast->compile(out);
 }
 
@@ -17,39 +25,343 @@ static void compile_identifier(std::ostream& out, std::string_view identifier, b
     out << (isFunction ? "F" : isConst ? "C" : "V") << "_{" << identifier << "}";
 }
 
-static void compile_simple_binop(std::ostream& out, const BinaryOperatorNode* node, const char* op, bool commutative = true) {
-    if (node->left->precedence() > node->precedence()) {
-        out << "\\left(";
-        node->left->compile(out);
-        out << "\\right)";
+// Struct fields and members are stored as one list per field, so they are named after both the struct and the field.
+// The names are length-prefixed so that different struct/field pairs can never produce the same name.
+static void compile_member_identifier(std::ostream& out, std::string_view structName, std::string_view member) {
+    out << "S_{" << structName.size() << structName << member.size() << member << "}";
+}
+
+// Overloads are also named after their parameter types, length-prefixed like members, with an 'l' after each
+// list type. Identifiers can't start with a digit, so no other function can have the name.
+static void compile_overload_identifier(std::ostream& out, const FunctionDeclarationNode* function) {
+    out << "F_{" << function->identifier.size() << function->identifier;
+    for (auto& parameter : function->parameters) {
+        std::string type = parameter->type.element().name();
+        out << type.size() << type << (parameter->type.isList ? "l" : "");
+    }
+    out << "}";
+}
+
+static void compile_action_identifier(std::ostream& out, std::string_view identifier) {
+    out << "A_{" << identifier << "}";
+}
+
+static void compile_parameters(std::ostream& out, const FunctionDeclarationNode* function) {
+    out << "\\left(";
+    for (size_t i = 0; i < function->parameters.size(); i++) {
+        if (i > 0) {out << ",";}
+        function->parameters[i]->compile(out);
+    }
+    out << "\\right)";
+}
+
+namespace AST {
+    // Expressions are written with an explicit stack instead of by recursing into subexpressions, so that deeply
+    // nested expressions can't overflow the native stack. A node's emit() describes its LaTeX as a sequence of
+    // text and subexpressions, and each subexpression is expanded once everything before it has been written.
+    class Emitter {
+        struct Fragment {
+            const ExpressionNode* node; // nullptr for text
+            std::string text;
+        };
+
+        std::ostream& out;
+        std::vector<Fragment> stack; // Top is written next
+        std::vector<Fragment> pending; // Emitted by the node being expanded, after its first subexpression
+
+        void append(std::string_view text) {
+            if (pending.back().node) {pending.push_back({nullptr, std::string()});}
+            pending.back().text += text;
+        }
+
+        template <class Write>
+        void write(Write write) {
+            if (pending.empty()) {
+                // Nothing is waiting to be written before it
+                write(out);
+            } else {
+                std::stringstream ss;
+                write(ss);
+                append(ss.str());
+            }
+        }
+
+    public:
+        explicit Emitter(std::ostream& out) : out(out), stack(), pending() {}
+
+        // Text, a declaration's name, or a subexpression to write in its place
+        template <class T>
+        Emitter& operator<<(const T& value) {
+            if constexpr (std::is_convertible_v<T, const ExpressionNode*>) {
+                pending.push_back({value, std::string()});
+            } else if constexpr (std::is_convertible_v<T, const DeclarationNode*>) {
+                write([&](std::ostream& stream) {value->compile(stream);});
+            } else if constexpr (std::is_convertible_v<T, std::string_view>) {
+                if (pending.empty()) {
+                    out << std::string_view(value);
+                } else {
+                    append(value);
+                }
+            } else {
+                write([&](std::ostream& stream) {stream << value;});
+            }
+            return *this;
+        }
+
+        // Writes everything that has been emitted
+        void finish() {
+            while (true) {
+                for (auto fragment = pending.rbegin(); fragment != pending.rend(); fragment++) {
+                    stack.push_back(std::move(*fragment));
+                }
+                pending.clear();
+                if (stack.empty()) {return;}
+
+                Fragment fragment = std::move(stack.back());
+                stack.pop_back();
+                if (fragment.node) {
+                    fragment.node->emit(*this);
+                } else {
+                    out << fragment.text;
+                }
+            }
+        }
+    };
+}
+
+void ExpressionNode::compile(std::ostream& out) const {
+    Emitter emitter(out);
+    emitter << this;
+    emitter.finish();
+}
+
+static void emit_operand(Emitter& emitter, const ExpressionNode* operand, bool parenthesize) {
+    if (parenthesize) {
+        emitter << "\\left(" << operand << "\\right)";
+    } else {
+        emitter << operand;
+    }
+}
+
+static void emit_simple_binop(Emitter& emitter, const BinaryOperatorNode* node, const char* op, bool commutative = true) {
+    emit_operand(emitter, node->left.get(), node->left->precedence() > node->precedence());
+    emitter << op;
+    emit_operand(emitter, node->right.get(), node->right->precedence() > node->precedence() || (!commutative && node->right->precedence() == node->precedence()));
+}
+
+static bool is_comparison(Operator op) {
+    switch (op) {
+        case Operator::LESS:
+        case Operator::GREATER:
+        case Operator::LESS_EQUAL:
+        case Operator::GREATER_EQUAL:
+        case Operator::EQUAL_EQUAL:
+        case Operator::NOT_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Writes a bool expression as a Desmos condition (as used in piecewise blocks).
+// Desmos has no '!=' or '!' for conditions, so this returns true if what was
+// written is the negation of the expression.
+static bool emit_condition(Emitter& emitter, const ExpressionNode* expr) {
+    bool negated = false;
+    while (auto unop = dynamic_cast<const UnaryOperatorNode*>(expr)) {
+        if (unop->op != Operator::INVERT) {break;}
+        negated = !negated;
+        expr = unop->expr.get();
+    }
+
+    auto binop = dynamic_cast<const BinaryOperatorNode*>(expr);
+    if (!binop || !is_comparison(binop->op)) {
+        emitter << expr << "=1";
+        return negated;
+    }
+
+    emitter << binop->left.get();
+    switch (binop->op) {
+        case Operator::LESS: emitter << "<"; break;
+        case Operator::GREATER: emitter << ">"; break;
+        case Operator::LESS_EQUAL: emitter << "\\le "; break;
+        case Operator::GREATER_EQUAL: emitter << "\\ge "; break;
+        case Operator::EQUAL_EQUAL:
+        case Operator::NOT_EQUAL:
+            emitter << "="; break;
+        default: break;
+    }
+    emitter << binop->right.get();
+    return negated != (binop->op == Operator::NOT_EQUAL);
+}
+
+// The branch of a conditional that is taken when its written condition holds
+static const ExpressionNode* taken_branch(const TernaryOperatorNode* node, std::string& condition) {
+    std::stringstream ss;
+    Emitter emitter(ss);
+    bool negated = emit_condition(emitter, node->condition.get());
+    emitter.finish();
+    condition = ss.str();
+    return negated ? node->ifFalse.get() : node->ifTrue.get();
+}
+
+static const ExpressionNode* fallback_branch(const TernaryOperatorNode* node) {
+    std::stringstream ss;
+    Emitter emitter(ss);
+    bool negated = emit_condition(emitter, node->condition.get());
+    return negated ? node->ifTrue.get() : node->ifFalse.get();
+}
+
+// The shortest decimal that reads back as the same number, since values folded at compile time are only as
+// precise as they are written. Exponent notation, which Desmos doesn't read, is written as a power of ten.
+static std::string format_number(double value) {
+    std::string text;
+    for (int precision = std::numeric_limits<double>::digits10; precision <= std::numeric_limits<double>::max_digits10; precision++) {
+        std::stringstream ss;
+        ss << std::setprecision(precision) << value;
+        text = ss.str();
+        if (std::strtod(text.c_str(), nullptr) == value) {break;}
+    }
+    if (size_t exponent = text.find('e'); exponent != std::string::npos) {
+        text = "\\left(" + text.substr(0, exponent) + "\\cdot 10^{" + std::to_string(std::stoi(text.substr(exponent + 1))) + "}\\right)";
+    }
+    return text;
+}
+
+static void emit_undefined(Emitter& emitter) {
+    emitter << "\\frac{0}{0}";
+}
+
+
+void LiteralNode::emit(Emitter& emitter) const {
+    emitter << format_number(value);
+}
+
+void IdentifierNode::emit(Emitter& emitter) const {
+    if (declaration) {
+        emitter << declaration;
     } else {
-        node->left->compile(out);
+        std::stringstream ss;
+        compile_identifier(ss, identifier, type.isConst, false);
+        emitter << ss.str();
     }
-    out << op;
-    if (node->right->precedence() > node->precedence() || (!commutative && node->right->precedence() == node->precedence())) {
-        out << "\\left(";
-        node->right->compile(out);
-        out << "\\right)";
+}
+
+void PointNode::emit(Emitter& emitter) const {
+    emitter << "\\left(" << x.get() << "," << y.get() << "\\right)";
+}
+
+void ListNode::emit(Emitter& emitter) const {
+    emitter << "\\left[";
+    for (size_t i = 0; i < elements.size(); i++) {
+        if (i > 0) {emitter << ",";}
+        emitter << elements[i].get();
+    }
+    emitter << "\\right]";
+}
+
+void IndexNode::emit(Emitter& emitter) const {
+    emit_operand(emitter, list.get(), list->precedence() > precedence());
+
+    // Desmos lists are 1-indexed
+    emitter << "\\left[";
+    if (auto literal = dynamic_cast<const LiteralNode*>(index.get())) {
+        emitter << literal->value + 1;
+    } else {
+        emit_operand(emitter, index.get(), index->precedence() > 5);
+        emitter << "+1";
+    }
+    emitter << "\\right]";
+}
+
+void CallNode::emit(Emitter& emitter) const {
+    if (auto called = builtin(); called && called->spelling == builtins::Builtin::BRACES) {
+        emitter << called->latex << "{" << arguments[0].get() << "}";
+        return;
+    } else if (called) {
+        emitter << called->latex << "\\left(";
     } else {
-        node->right->compile(out);
+        emitter << function.get() << "\\left(";
+    }
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (i > 0) {emitter << ",";}
+        emitter << arguments[i].get();
+    }
+    emitter << "\\right)";
+}
+
+void MemberAccessNode::emit(Emitter& emitter) const {
+    if (!memberDeclaration) {
+        // Point coordinate
+        emit_operand(emitter, object.get(), object->precedence() > precedence());
+        emitter << "." << member;
+        return;
+    }
+
+    emitter << memberDeclaration;
+    if (memberDeclaration->isPerInstance) {
+        auto instance = ((const IdentifierNode*) object.get())->declaration;
+        emitter << "\\left[" << instance->instanceIndex + 1 << "\\right]";
+    }
+}
+
+void StructInitializerNode::emit(Emitter& emitter) const {
+    throw std::runtime_error("Struct initializers are compiled as part of their struct definition");
+}
+
+void ComprehensionNode::emit(Emitter& emitter) const {
+    if (unrolled) {
+        emitter << unrolled.get();
+        return;
     }
+    emitter << "\\left[" << body.get() << "\\operatorname{for}" << variable.get() << "=\\left[" << start.get() << "..." << end.get() << "\\right]\\right]";
 }
 
+void SolveNode::emit(Emitter& emitter) const {
+    if (!root) {
+        throw std::runtime_error("Equations that aren't constant are compiled as regressions by their definition");
+    }
+    // In full, since the solution is only as precise as it is written
+    emitter << format_number(*root);
+}
 
-void LiteralNode::compile(std::ostream& out) const {
-    out << value;
+void DerivativeNode::emit(Emitter& emitter) const {
+    if (!derivative) {
+        throw std::runtime_error("Derivatives are taken during late analysis");
+    }
+    emitter << derivative.get();
 }
 
-void IdentifierNode::compile(std::ostream& out) const {
-    compile_identifier(out, identifier, type.isConst, false);
+void SolveNode::compile_regression(std::ostream& out) const {
+    // Desmos finds the unknown's value by fitting it, and the unknown is written with the definition's name
+    left->compile(out);
+    out << "\\sim ";
+    right->compile(out);
+    out << std::endl;
 }
 
 void DeclarationNode::compile(std::ostream& out) const {
-    compile_identifier(out, identifier, type.isConst, false);
+    if (minifiedName.empty()) {
+        compile_name(out);
+    } else {
+        out << minifiedName;
+    }
+}
+
+void DeclarationNode::compile_name(std::ostream& out) const {
+    if (parentStruct) {
+        compile_member_identifier(out, parentStruct->identifier, identifier);
+    } else {
+        compile_identifier(out, identifier, type.isConst, false);
+    }
 }
 
-void FunctionDeclarationNode::compile(std::ostream& out) const {
-    compile_identifier(out, identifier, false, true);
+void FunctionDeclarationNode::compile_name(std::ostream& out) const {
+    if (isOverloaded) {
+        compile_overload_identifier(out, this);
+    } else {
+        compile_identifier(out, identifier, false, true);
+    }
 }
 
 int BinaryOperatorNode::precedence() const {
@@ -67,90 +379,133 @@ int BinaryOperatorNode::precedence() const {
             return 8;
         case Operator::OR:
             return 9;
+        case Operator::LESS:
+        case Operator::GREATER:
+        case Operator::LESS_EQUAL:
+        case Operator::GREATER_EQUAL:
+        case Operator::EQUAL_EQUAL:
+        case Operator::NOT_EQUAL:
+            // Compiled as a piecewise block, so never needs parentheses
+            return 0;
         default:
             throw std::runtime_error("Invalid binary operator: " + std::to_string(op));
     }
 }
 
-void BinaryOperatorNode::compile(std::ostream& out) const {
+void BinaryOperatorNode::emit(Emitter& emitter) const {
     switch (op) {
         case Operator::PLUS:
-            compile_simple_binop(out, this, "+"); break;
+            emit_simple_binop(emitter, this, "+"); break;
         case Operator::MINUS:
-            compile_simple_binop(out, this, "-", false); break;
+            emit_simple_binop(emitter, this, "-", false); break;
         case Operator::MUL:
-            compile_simple_binop(out, this, "\\cdot "); break;
+            emit_simple_binop(emitter, this, "\\cdot "); break;
         case Operator::DIV:
-            out << "\\frac{";
-            left->compile(out);
-            out << "}{";
-            right->compile(out);
-            out << "}";
+            emitter << "\\frac{" << left.get() << "}{" << right.get() << "}";
             break;
         case Operator::MOD:
-            out << "\\operatorname{mod}\\left(";
-            left->compile(out);
-            out << ",";
-            right->compile(out);
-            out << "\\right)";
+            emitter << "\\operatorname{mod}\\left(" << left.get() << "," << right.get() << "\\right)";
             break;
         case Operator::EXP:
-            if (left->precedence() > 0) {
-                out << "\\left(";
-                left->compile(out);
-                out << "\\right)";
-            } else {
-                left->compile(out);
-            }
-            out << "^{";
-            right->compile(out);
-            out << "}";
+            emit_operand(emitter, left.get(), left->precedence() > 0);
+            emitter << "^{" << right.get() << "}";
             break;
         case Operator::AND:
-            compile_simple_binop(out, this, "\\cdot "); break;
+            emit_simple_binop(emitter, this, "\\cdot "); break;
         case Operator::OR:
-            out << "\\max\\left(";
-            left->compile(out);
-            out << ",";
-            right->compile(out);
-            out << "\\right)";
+            // \max of lists is a single number, so lists are compared elementwise in a piecewise block instead
+            if (left->type.isList || right->type.isList) {
+                emitter << "\\left\\{" << left.get() << "=1:1," << right.get() << "=1:1,0\\right\\}";
+            } else {
+                emitter << "\\max\\left(" << left.get() << "," << right.get() << "\\right)";
+            }
             break;
+        case Operator::LESS:
+        case Operator::GREATER:
+        case Operator::LESS_EQUAL:
+        case Operator::GREATER_EQUAL:
+        case Operator::EQUAL_EQUAL:
+        case Operator::NOT_EQUAL: {
+            emitter << "\\left\\{";
+            bool negated = emit_condition(emitter, this);
+            emitter << (negated ? ":0,1" : ":1,0") << "\\right\\}";
+            break;
+        }
         default:
             throw std::runtime_error("Invalid binary operator: " + std::to_string(op));
     }
 }
 
 int UnaryOperatorNode::precedence() const {
-    return op == Operator::INVERT ? 5 : 3;
+    switch (op) {
+        case Operator::ABS:
+            return 0;
+        case Operator::INVERT:
+            return 5;
+        default:
+            return 3;
+    }
 }
 
-void UnaryOperatorNode::compile(std::ostream& out) const {
+void UnaryOperatorNode::emit(Emitter& emitter) const {
     switch (op) {
         case Operator::MINUS:
-            out << "-";
-            if (expr->precedence() > precedence()) {
-                out << "\\left(";
-                expr->compile(out);
-                out << "\\right)";
-            } else {
-                expr->compile(out);
-            }
+            emitter << "-";
+            // A fraction is already set apart from the sign by its bar
+            emit_operand(emitter, expr.get(), expr->precedence() > precedence() && !(expr->kind == NodeKind::BINARY_OPERATOR
+                                                                                     && ((const BinaryOperatorNode*) expr.get())->op == Operator::DIV));
             break;
         case Operator::INVERT:
-            out << "1-";
-            if (expr->precedence() >= precedence()) {
-                out << "\\left(";
-                expr->compile(out);
-                out << "\\right)";
-            } else {
-                expr->compile(out);
-            }
+            emitter << "1-";
+            emit_operand(emitter, expr.get(), expr->precedence() >= precedence());
+            break;
+        case Operator::ABS:
+            emitter << "\\left|" << expr.get() << "\\right|";
             break;
         default:
             throw std::runtime_error("Invalid unary operator: " + std::to_string(op));
     }
 }
 
+void TernaryOperatorNode::emit(Emitter& emitter) const {
+    // Conditionals nested in the fallback branch are merged into one multi-branch piecewise block.
+    // A condition that was already tested earlier in the block can never be reached, so it is skipped,
+    // and a conditional in a taken branch that repeats the enclosing test is replaced by its taken branch.
+    std::unordered_set<std::string> tested;
+    const ExpressionNode* fallback = this;
+
+    emitter << "\\left\\{";
+    while (auto node = dynamic_cast<const TernaryOperatorNode*>(fallback)) {
+        std::string condition;
+        const ExpressionNode* taken = taken_branch(node, condition);
+        fallback = fallback_branch(node);
+        if (tested.contains(condition)) {
+            if (!fallback) {break;}
+            continue;
+        }
+
+        std::string innerCondition;
+        while (auto inner = dynamic_cast<const TernaryOperatorNode*>(taken)) {
+            const ExpressionNode* innerTaken = taken_branch(inner, innerCondition);
+            if (innerCondition != condition) {break;}
+            taken = innerTaken;
+        }
+
+        if (!tested.empty()) {emitter << ",";}
+        emitter << condition << ":";
+        if (taken) {
+            emitter << taken;
+        } else {
+            emit_undefined(emitter);
+        }
+        tested.insert(std::move(condition));
+    }
+    if (fallback) {
+        emitter << "," << fallback;
+    }
+    emitter << "\\right\\}";
+}
+
 void StatementBlockNode::compile(std::ostream& out) const {
     for (auto& statement : statements) {
         statement->compile(out);
@@ -158,14 +513,116 @@ void StatementBlockNode::compile(std::ostream& out) const {
 }
 
 void InitializationStatementNode::compile(std::ostream& out) const {
+    // Struct instances are emitted as part of their struct's lists
+    if (dynamic_cast<const StructInitializerNode*>(value.get())) {return;}
+    // An equation that isn't constant is a regression, which defines the unknown itself
+    if (value->kind == NodeKind::SOLVE && !((const SolveNode*) value.get())->root) {
+        ((const SolveNode*) value.get())->compile_regression(out);
+        return;
+    }
+
     declaration->compile(out);
+    if (declaration->isFunction()) {
+        compile_parameters(out, (const FunctionDeclarationNode*) declaration.get());
+    }
     out << " = ";
     value->compile(out);
     out << std::endl;
 }
 
+void StructDefinitionNode::compile(std::ostream& out) const {
+    for (size_t i = 0; i < declaration->fields.size(); i++) {
+        compile_field(out, i);
+    }
+    for (auto& member : declaration->members) {
+        member->compile(out);
+    }
+}
+
+void StructDefinitionNode::compile_field(std::ostream& out, size_t field) const {
+    declaration->fields[field]->compile(out);
+    out << " = \\left[";
+    for (size_t j = 0; j < declaration->instances.size(); j++) {
+        if (j > 0) {out << ",";}
+        auto initializer = (const StructInitializerNode*) declaration->instances[j]->value.get();
+        initializer->arguments[field]->compile(out);
+    }
+    out << "\\right]" << std::endl;
+}
+
+void AssignmentStatementNode::compile(std::ostream& out) const {
+    throw std::runtime_error("Assignments are compiled as part of their action");
+}
+
+void ActionCallStatementNode::compile(std::ostream& out) const {
+    throw std::runtime_error("Action calls are inlined into the calling action");
+}
+
+void ActionDeclarationNode::compile_name(std::ostream& out) const {
+    compile_action_identifier(out, identifier);
+}
+
+void ActionDefinitionNode::compile(std::ostream& out) const {
+    compile_action(out, declaration.get());
+}
+
+void ActionDefinitionNode::compile_action(std::ostream& out, const ActionDeclarationNode* declaration) {
+    // An action that doesn't assign anything has nothing to emit
+    if (declaration->assignments.empty()) {return;}
+
+    declaration->compile(out);
+    if (declaration->hasParameters) {
+        compile_parameters(out, declaration);
+    }
+    out << " = ";
+    for (size_t i = 0; i < declaration->assignments.size(); i++) {
+        if (i > 0) {out << ",";}
+        auto& [variable, value] = declaration->assignments[i];
+        variable->compile(out);
+        out << "\\to ";
+        value->compile(out);
+    }
+    out << std::endl;
+}
+
+void TickerNode::compile(std::ostream& out) const {
+    // Compiled as part of the ticker schedule
+}
+
+void ImportStatementNode::compile(std::ostream& out) const {
+    if (module) {module->compile(out);}
+}
+
+void TickerStateDeclarationNode::compile_name(std::ostream& out) const {
+    out << "T_{" << identifier << "}";
+}
+
+void HoistedDeclarationNode::compile_name(std::ostream& out) const {
+    out << "H_{" << number << "}";
+}
+
+void TickerScheduleNode::compile(std::ostream& out) const {
+    if (!dispatch || dispatch->assignments.empty()) {return;}
+
+    for (auto& variable : state) {
+        variable->compile(out);
+        out << " = 0" << std::endl;
+    }
+    ActionDefinitionNode::compile_action(out, dispatch.get());
+
+    // The ticker itself isn't an expression, so it is described for the user to set up
+    out << "% Ticker: run ";
+    dispatch->compile(out);
+    if (basePeriod > 0) {
+        out << " every " << basePeriod << " ms" << std::endl;
+    } else {
+        out << " as often as possible" << std::endl;
+    }
+}
+
 void MainBlockNode::compile(std::ostream& out) const {
-    for (auto& statement : statements) {
+    for (auto statement : emissionOrder) {
         statement->compile(out);
     }
+    tickerSchedule.compile(out);
 }
@@ -0,0 +1,166 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#ifndef DESMOS_COMPILER_BUILTINS_H
+#define DESMOS_COMPILER_BUILTINS_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "compiler.h"
+
+// Desmos' own functions, which programs can call by name, or with a '$' in front of the name to skip past
+// declarations of their own with the same name. The catalog and the hash table that finds its entries are
+// both built at compile time, so looking a name up is a hash and one comparison.
+namespace builtins {
+
+    struct Parameter {
+        Type::Primitive primitive;
+        bool isList;
+    };
+
+    struct Builtin {
+        // How a call is spelled in LaTeX
+        enum Spelling : uint8_t {
+            OPERATOR, // \sin\left(x\right)
+            BRACES    // \sqrt{x}
+        };
+
+        std::string_view name;
+        std::string_view latex;
+        Spelling spelling;
+        std::array<Parameter, 3> parameters;
+        uint8_t parameterCount;
+        Parameter result;
+        bool isPure; // Always gives the same result for the same arguments, so calls on constants can be folded
+        // How to evaluate the builtin, for builtins of numbers and of lists of numbers respectively (nullptr otherwise).
+        // Builtins of lists with both combine two numbers with evaluate, so they can also be called on two or more
+        // numbers, like max(x, 0).
+        double (*evaluate)(const double* arguments);
+        double (*reduce)(const std::vector<double>& list);
+
+        bool is_variadic(size_t argumentCount) const {return reduce && evaluate && argumentCount >= 2;}
+
+        Type parameter_type(size_t i) const {return {parameters[i].primitive, false, parameters[i].isList};}
+        Type result_type() const {return {result.primitive, false, result.isList};}
+    };
+
+    namespace detail {
+        constexpr Parameter NUM = {Type::NUM, false};
+        constexpr Parameter NUMS = {Type::NUM, true};
+        constexpr Parameter COLOR = {Type::COLOR, false};
+
+        constexpr Builtin number(std::string_view name, std::string_view latex, double (*evaluate)(const double*)) {
+            return {name, latex, Builtin::OPERATOR, {NUM}, 1, NUM, true, evaluate, nullptr};
+        }
+
+        constexpr Builtin list(std::string_view name, std::string_view latex, double (*reduce)(const std::vector<double>&),
+                               double (*combine)(const double*) = nullptr) {
+            return {name, latex, Builtin::OPERATOR, {NUMS}, 1, NUM, true, combine, reduce};
+        }
+
+        inline constexpr std::array CATALOG = {
+            Builtin {"sqrt", "\\sqrt", Builtin::BRACES, {NUM}, 1, NUM, true, [](const double* a) {return std::sqrt(a[0]);}, nullptr},
+            number("sin", "\\sin", [](const double* a) {return std::sin(a[0]);}),
+            number("cos", "\\cos", [](const double* a) {return std::cos(a[0]);}),
+            number("tan", "\\tan", [](const double* a) {return std::tan(a[0]);}),
+            number("arcsin", "\\arcsin", [](const double* a) {return std::asin(a[0]);}),
+            number("arccos", "\\arccos", [](const double* a) {return std::acos(a[0]);}),
+            number("arctan", "\\arctan", [](const double* a) {return std::atan(a[0]);}),
+            number("sinh", "\\sinh", [](const double* a) {return std::sinh(a[0]);}),
+            number("cosh", "\\cosh", [](const double* a) {return std::cosh(a[0]);}),
+            number("tanh", "\\tanh", [](const double* a) {return std::tanh(a[0]);}),
+            number("ln", "\\ln", [](const double* a) {return std::log(a[0]);}),
+            number("log", "\\log", [](const double* a) {return std::log10(a[0]);}),
+            number("exp", "\\exp", [](const double* a) {return std::exp(a[0]);}),
+            number("floor", "\\operatorname{floor}", [](const double* a) {return std::floor(a[0]);}),
+            number("ceil", "\\operatorname{ceil}", [](const double* a) {return std::ceil(a[0]);}),
+            number("round", "\\operatorname{round}", [](const double* a) {return std::round(a[0]);}),
+            number("sign", "\\operatorname{sign}", [](const double* a) {return (double) ((a[0] > 0) - (a[0] < 0));}),
+            // Takes the sign of the divisor, like the % operator
+            Builtin {"mod", "\\operatorname{mod}", Builtin::OPERATOR, {NUM, NUM}, 2, NUM, true,
+                     [](const double* a) {return a[0] - a[1] * std::floor(a[0] / a[1]);}, nullptr},
+            list("total", "\\operatorname{total}", [](const std::vector<double>& l) {return std::accumulate(l.begin(), l.end(), 0.0);}),
+            list("mean", "\\operatorname{mean}", [](const std::vector<double>& l) {
+                return l.empty() ? NAN : std::accumulate(l.begin(), l.end(), 0.0) / (double) l.size();
+            }),
+            list("length", "\\operatorname{length}", [](const std::vector<double>& l) {return (double) l.size();}),
+            // Undefined if either number is, like the or operator
+            list("min", "\\min", [](const std::vector<double>& l) {return l.empty() ? NAN : *std::min_element(l.begin(), l.end());},
+                 [](const double* a) {return (std::isnan(a[0]) || std::isnan(a[1])) ? NAN : std::min(a[0], a[1]);}),
+            list("max", "\\max", [](const std::vector<double>& l) {return l.empty() ? NAN : *std::max_element(l.begin(), l.end());},
+                 [](const double* a) {return (std::isnan(a[0]) || std::isnan(a[1])) ? NAN : std::max(a[0], a[1]);}),
+            Builtin {"sort", "\\operatorname{sort}", Builtin::OPERATOR, {NUMS}, 1, NUMS, true, nullptr, nullptr},
+            Builtin {"rgb", "\\operatorname{rgb}", Builtin::OPERATOR, {NUM, NUM, NUM}, 3, COLOR, true, nullptr, nullptr},
+            Builtin {"hsv", "\\operatorname{hsv}", Builtin::OPERATOR, {NUM, NUM, NUM}, 3, COLOR, true, nullptr, nullptr},
+            // Differs on every evaluation
+            Builtin {"random", "\\operatorname{random}", Builtin::OPERATOR, {}, 0, NUM, false, nullptr, nullptr},
+        };
+
+        constexpr uint32_t hash(std::string_view name, uint32_t seed) {
+            // FNV-1a, starting from the seed
+            uint32_t hash = 2166136261u ^ seed;
+            for (char c : name) {
+                hash = (hash ^ (uint8_t) c) * 16777619u;
+            }
+            // The low bits of a product only depend on the low bits of its factors, so the high bits are folded in
+            return hash ^ (hash >> 16);
+        }
+
+        // A power of two. At over four times the size of the catalog, a seed that gives each builtin its own slot is
+        // found after a few tries.
+        constexpr size_t TABLE_SIZE = 128;
+        static_assert(TABLE_SIZE >= 4 * CATALOG.size() && (TABLE_SIZE & (TABLE_SIZE - 1)) == 0);
+
+        constexpr bool is_perfect(uint32_t seed) {
+            std::array<bool, TABLE_SIZE> used = {};
+            for (auto& builtin : CATALOG) {
+                uint32_t slot = hash(builtin.name, seed) & (TABLE_SIZE - 1);
+                if (used[slot]) {return false;}
+                used[slot] = true;
+            }
+            return true;
+        }
+
+        // The first seed that gives every builtin a slot of its own
+        constexpr uint32_t find_seed() {
+            uint32_t seed = 0;
+            while (!is_perfect(seed)) {seed++;}
+            return seed;
+        }
+
+        constexpr uint32_t SEED = find_seed();
+
+        // Catalog indices plus one, or 0 for empty slots
+        constexpr std::array<uint8_t, TABLE_SIZE> build_table() {
+            std::array<uint8_t, TABLE_SIZE> table = {};
+            for (size_t i = 0; i < CATALOG.size(); i++) {
+                table[hash(CATALOG[i].name, SEED) & (TABLE_SIZE - 1)] = (uint8_t) (i + 1);
+            }
+            return table;
+        }
+
+        inline constexpr std::array<uint8_t, TABLE_SIZE> TABLE = build_table();
+    }
+
+    constexpr const Builtin* find(std::string_view name) {
+        uint8_t entry = detail::TABLE[detail::hash(name, detail::SEED) & (detail::TABLE_SIZE - 1)];
+        if (entry == 0) {return nullptr;}
+        const Builtin* builtin = &detail::CATALOG[entry - 1];
+        return builtin->name == name ? builtin : nullptr;
+    }
+
+    // Position in the catalog, for bytecode operands
+    constexpr uint16_t index(const Builtin* builtin) {return (uint16_t) (builtin - detail::CATALOG.data());}
+    constexpr const Builtin* at(uint16_t index) {return &detail::CATALOG[index];}
+
+    static_assert(find("sqrt")->name == "sqrt" && find("rgb")->name == "rgb");
+}
+
+#endif //DESMOS_COMPILER_BUILTINS_H
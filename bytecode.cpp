@@ -0,0 +1,473 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "vm.h"
+#include "ast.h"
+#include "builtins.h"
+
+using namespace AST;
+using vm::OpCode;
+
+static constexpr double UNDEFINED = std::numeric_limits<double>::quiet_NaN();
+
+uint32_t vm::Assembler::allocate(size_t count) {
+    // Checked before narrowing, since list and call operands count registers in 32 bits too
+    if (count > std::numeric_limits<uint32_t>::max() - (size_t) top) {
+        throw std::runtime_error("Too many registers needed for '" + chunk.name + "'");
+    }
+    uint32_t first = top;
+    top += count;
+    chunk.registerCount = std::max(chunk.registerCount, top);
+    return first;
+}
+
+size_t vm::Assembler::emit(OpCode op, uint32_t dest, uint32_t a, uint32_t b, uint32_t c) {
+    chunk.code.push_back({op, dest, a, b, c});
+    return chunk.code.size() - 1;
+}
+
+void vm::Assembler::finish() {
+    while (true) {
+        for (auto step = pending.rbegin(); step != pending.rend(); step++) {
+            stack.push_back(std::move(*step));
+        }
+        pending.clear();
+        if (stack.empty()) {return;}
+
+        Step step = std::move(stack.back());
+        stack.pop_back();
+        if (step.node) {
+            step.node->compile_bytecode(*this, step.dest);
+        } else {
+            step.then();
+        }
+    }
+}
+
+void vm::Assembler::patch_jump(size_t jump, size_t target) {
+    if (target > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Too much code in '" + chunk.name + "'");
+    }
+    Instruction& instruction = chunk.code[jump];
+    if (instruction.op == OpCode::JUMP) {
+        instruction.a = target;
+    } else {
+        instruction.b = target;
+    }
+}
+
+uint32_t vm::Assembler::constant(Value value) {
+    if (program.constants.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Too many constants");
+    }
+    program.constants.push_back(std::move(value));
+    return program.constants.size() - 1;
+}
+
+void vm::Assembler::load(const DeclarationNode* declaration, uint32_t dest) {
+    if (auto local = locals.find(declaration); local != locals.end()) {
+        emit(OpCode::MOVE, dest, local->second);
+    } else {
+        emit(OpCode::LOAD_GLOBAL, dest, global(declaration));
+    }
+}
+
+uint32_t vm::Assembler::function(const DeclarationNode* declaration) const {
+    auto function = program.symbols.functions.find(declaration);
+    if (function == program.symbols.functions.end()) {
+        throw std::runtime_error("'" + std::string(declaration->identifier) + "' is not a compiled function");
+    }
+    return function->second;
+}
+
+uint32_t vm::Assembler::global(const DeclarationNode* declaration) const {
+    auto global = program.symbols.globals.find(declaration);
+    if (global == program.symbols.globals.end()) {
+        throw std::runtime_error("'" + std::string(declaration->identifier) + "' has no value");
+    }
+    return global->second;
+}
+
+static vm::Value undefined(const Type& type) {
+    return type.element().matches_primitive(Type::POINT) ? vm::Value::point(UNDEFINED, UNDEFINED) : vm::Value::number(UNDEFINED);
+}
+
+// Loaded by a single instruction, so they don't hold any registers while they are compiled
+static bool is_leaf(const ExpressionNode* expr) {
+    return expr->kind == NodeKind::LITERAL || expr->kind == NodeKind::IDENTIFIER || expr->kind == NodeKind::SOLVE;
+}
+
+// Compiles two operands, then emits the instruction that combines them with emit(leftRegister, rightRegister).
+// The operand compiled first goes into dest, and the other only takes a register once the first has been computed,
+// so a chain like a + b + c + ... reuses the same register. Chains that nest on the right, like a^b^c, are compiled
+// right operand first for the same reason, which is fine since expressions have no side effects.
+template <class Emit>
+static void compile_operands(vm::Assembler& assembler, uint32_t dest, const ExpressionNode* left, const ExpressionNode* right, Emit emit) {
+    bool rightFirst = is_leaf(left) && !is_leaf(right);
+    assembler.compile(rightFirst ? right : left, dest);
+    assembler.then([=, &assembler] {
+        uint32_t other = assembler.allocate();
+        assembler.compile(rightFirst ? left : right, other);
+        assembler.then([=, &assembler] {
+            if (rightFirst) {
+                emit(other, dest);
+            } else {
+                emit(dest, other);
+            }
+            assembler.release(other);
+        });
+    });
+}
+
+
+void LiteralNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    assembler.emit(OpCode::LOAD_CONST, dest, assembler.constant(vm::Value::number(value)));
+}
+
+void IdentifierNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    if (!declaration) {
+        throw std::runtime_error("Unresolved identifier: '" + std::string(identifier) + "'");
+    }
+    assembler.load(declaration, dest);
+}
+
+void PointNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    compile_operands(assembler, dest, x.get(), y.get(), [&assembler, dest](uint32_t x, uint32_t y) {
+        assembler.emit(OpCode::MAKE_POINT, dest, x, y);
+    });
+}
+
+void ListNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    uint32_t first = assembler.allocate(elements.size());
+    for (size_t i = 0; i < elements.size(); i++) {
+        assembler.compile(elements[i].get(), first + i);
+    }
+    bool isPoint = type.element().matches_primitive(Type::POINT) && !type.isUnknown;
+    assembler.then([&assembler, dest, first, size = elements.size(), isPoint] {
+        assembler.emit(OpCode::MAKE_LIST, dest, first, size, isPoint);
+        assembler.release(first);
+    });
+}
+
+void IndexNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    compile_operands(assembler, dest, list.get(), index.get(), [&assembler, dest](uint32_t list, uint32_t index) {
+        assembler.emit(OpCode::INDEX, dest, list, index);
+    });
+}
+
+void CallNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    auto identifier = (const IdentifierNode*) function.get();
+    const builtins::Builtin* called = builtin();
+    if (called && !called->evaluate && !called->reduce) {
+        throw std::runtime_error("Builtin function '" + std::string(called->name) + "' can't be evaluated headlessly");
+    }
+    uint32_t first = assembler.allocate(arguments.size());
+    for (size_t i = 0; i < arguments.size(); i++) {
+        assembler.compile(arguments[i].get(), first + i);
+    }
+    assembler.then([&assembler, identifier, called, dest, first, count = arguments.size()] {
+        if (called) {
+            assembler.emit(OpCode::BUILTIN, dest, builtins::index(called), first, count);
+        } else {
+            assembler.emit(OpCode::CALL, dest, assembler.function(identifier->declaration), first, count);
+        }
+        assembler.release(first);
+    });
+}
+
+void MemberAccessNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    if (!memberDeclaration) {
+        // Point coordinate
+        assembler.compile(object.get(), dest);
+        assembler.then([&assembler, dest, opcode = member == "x" ? OpCode::POINT_X : OpCode::POINT_Y] {assembler.emit(opcode, dest, dest);});
+        return;
+    }
+
+    assembler.load(memberDeclaration, dest);
+    if (memberDeclaration->isPerInstance) {
+        auto instance = ((const IdentifierNode*) object.get())->declaration;
+        long index = instance->instanceIndex;
+        uint32_t indexRegister = assembler.allocate();
+        assembler.emit(OpCode::LOAD_CONST, indexRegister, assembler.constant(vm::Value::number((double) index)));
+        assembler.emit(OpCode::INDEX, dest, dest, indexRegister);
+        assembler.release(indexRegister);
+    }
+}
+
+void StructInitializerNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    throw std::runtime_error("Struct initializers are compiled as part of their struct definition");
+}
+
+void BinaryOperatorNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    OpCode opcode;
+    switch (op) {
+        case Operator::PLUS: opcode = OpCode::ADD; break;
+        case Operator::MINUS: opcode = OpCode::SUB; break;
+        case Operator::MUL: opcode = OpCode::MUL; break;
+        case Operator::DIV: opcode = OpCode::DIV; break;
+        case Operator::MOD: opcode = OpCode::MOD; break;
+        case Operator::EXP: opcode = OpCode::POW; break;
+        case Operator::AND: opcode = OpCode::AND; break;
+        case Operator::OR: opcode = OpCode::OR; break;
+        case Operator::LESS: opcode = OpCode::LESS; break;
+        case Operator::GREATER: opcode = OpCode::GREATER; break;
+        case Operator::LESS_EQUAL: opcode = OpCode::LESS_EQUAL; break;
+        case Operator::GREATER_EQUAL: opcode = OpCode::GREATER_EQUAL; break;
+        case Operator::EQUAL_EQUAL: opcode = OpCode::EQUAL; break;
+        case Operator::NOT_EQUAL: opcode = OpCode::NOT_EQUAL; break;
+        default:
+            throw std::runtime_error("Invalid binary operator: " + std::to_string(op));
+    }
+
+    compile_operands(assembler, dest, left.get(), right.get(), [&assembler, opcode, dest](uint32_t left, uint32_t right) {
+        assembler.emit(opcode, dest, left, right);
+    });
+}
+
+void UnaryOperatorNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    OpCode opcode;
+    switch (op) {
+        case Operator::MINUS: opcode = OpCode::NEG; break;
+        case Operator::ABS: opcode = OpCode::ABS; break;
+        case Operator::INVERT: opcode = OpCode::NOT; break;
+        default:
+            throw std::runtime_error("Invalid unary operator: " + std::to_string(op));
+    }
+
+    assembler.compile(expr.get(), dest);
+    assembler.then([&assembler, opcode, dest] {assembler.emit(opcode, dest, dest);});
+}
+
+void TernaryOperatorNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    // Only the taken branch is evaluated, which is what lets recursive functions terminate. Desmos picks a
+    // branch for each element of a list condition though, so those evaluate both branches and select between them.
+    // Members of structs are lists without having list types, so this is decided at runtime.
+    // The false branch is computed in dest, which SELECT can read from while it writes the result.
+    uint32_t conditionRegister = assembler.allocate();
+    assembler.compile(condition.get(), conditionRegister);
+    assembler.then([this, &assembler, dest, conditionRegister] {
+        size_t toElse = assembler.emit(OpCode::JUMP_UNLESS, 0, conditionRegister);
+        uint32_t trueRegister = assembler.allocate();
+        assembler.compile(ifTrue.get(), trueRegister);
+        assembler.then([this, &assembler, dest, conditionRegister, trueRegister, toElse] {
+            size_t toSelect = assembler.emit(OpCode::JUMP_IF_SINGLE, 0, conditionRegister);
+            assembler.patch_jump(toElse, assembler.position());
+            if (ifFalse) {
+                assembler.compile(ifFalse.get(), dest);
+            } else {
+                assembler.emit(OpCode::LOAD_CONST, dest, assembler.constant(undefined(type)));
+            }
+            assembler.then([&assembler, dest, conditionRegister, trueRegister, toSelect] {
+                assembler.patch_jump(toSelect, assembler.position());
+                assembler.emit(OpCode::SELECT, dest, conditionRegister, trueRegister, dest);
+                assembler.release(conditionRegister);
+            });
+        });
+    });
+}
+
+void ComprehensionNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    if (unrolled) {
+        assembler.compile(unrolled.get(), dest);
+        return;
+    }
+    // The body is compiled as a function of the variable (see vm::compile), which is called on each element of the range
+    compile_operands(assembler, dest, start.get(), end.get(), [this, &assembler, dest](uint32_t start, uint32_t end) {
+        assembler.emit(OpCode::RANGE, dest, start, end);
+        assembler.emit(OpCode::CALL, dest, assembler.function(variable.get()), dest, 1);
+    });
+}
+
+
+void SolveNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    if (!root) {
+        throw std::runtime_error("Equations that depend on variables can't be solved headlessly");
+    }
+    assembler.emit(OpCode::LOAD_CONST, dest, assembler.constant(vm::Value::number(*root)));
+}
+
+void DerivativeNode::compile_bytecode(vm::Assembler& assembler, uint32_t dest) const {
+    assembler.compile(derivative.get(), dest);
+}
+
+// Globals are recomputed in an order where everything a global depends on comes first.
+// Functions and struct instances aren't globals themselves, but the globals they reference are.
+// The depth-first search keeps its own stack of declarations and how many of their dependencies it has visited.
+static void order_globals(const DeclarationNode* root, const DependencyGraph& graph, const vm::Symbols& symbols,
+                          std::unordered_set<const DeclarationNode*>& visited, std::vector<const DeclarationNode*>& order) {
+    if (!visited.insert(root).second) {return;}
+    std::vector<std::pair<const DeclarationNode*, size_t>> stack = {{root, 0}};
+    while (!stack.empty()) {
+        auto [declaration, next] = stack.back();
+        auto& dependencies = graph.dependencies(declaration);
+        if (next < dependencies.size()) {
+            stack.back().second++;
+            if (visited.insert(dependencies[next]).second) {
+                stack.push_back({dependencies[next], 0});
+            }
+            continue;
+        }
+        if (symbols.globals.contains(declaration)) {
+            order.push_back(declaration);
+        }
+        stack.pop_back();
+    }
+}
+
+static void compile_definition(vm::Assembler& assembler, const DeclarationNode* declaration, uint32_t dest) {
+    if (declaration->value) {
+        assembler.compile(declaration->value, dest);
+        assembler.finish();
+        return;
+    }
+    if (!declaration->parentStruct) {
+        // Ticker state starts at 0
+        assembler.emit(OpCode::LOAD_CONST, dest, assembler.constant(vm::Value::number(0)));
+        return;
+    }
+
+    // A struct field is the list of that field's argument in every instance
+    auto structType = declaration->parentStruct;
+    size_t field = 0;
+    while (structType->fields[field].get() != declaration) {field++;}
+
+    uint32_t first = assembler.allocate(structType->instances.size());
+    for (size_t i = 0; i < structType->instances.size(); i++) {
+        auto initializer = (const StructInitializerNode*) structType->instances[i]->value.get();
+        assembler.compile(initializer->arguments[field].get(), first + i);
+    }
+    assembler.finish();
+    assembler.emit(OpCode::MAKE_LIST, dest, first, structType->instances.size(), declaration->type.matches_primitive(Type::POINT));
+    assembler.release(first);
+}
+
+static void compile_action(vm::Program& program, vm::Chunk& chunk, const ActionDeclarationNode* action) {
+    chunk.name = action->identifier;
+    vm::Assembler assembler(program, chunk);
+
+    // Every value is computed from the variables as they were before the action, then they are all assigned at once
+    std::vector<uint32_t> values;
+    for (auto& [variable, value] : action->assignments) {
+        values.push_back(assembler.allocate());
+        assembler.compile(value.get(), values.back());
+        assembler.finish();
+    }
+    for (size_t i = 0; i < action->assignments.size(); i++) {
+        assembler.emit(OpCode::ASSIGN_GLOBAL, values[i], assembler.global(action->assignments[i].first));
+    }
+}
+
+vm::Program vm::compile(const Compiler* compiler) {
+    Program program;
+    Symbols& symbols = program.symbols;
+    const MainBlockNode* main = compiler->ast.get();
+
+    std::vector<const DeclarationNode*> declarations;
+    for (auto statement : main->emissionOrder) {
+        statement->provided_declarations(declarations);
+    }
+
+    std::vector<const DeclarationNode*> functions;
+    std::vector<const ComprehensionNode*> comprehensions;
+    std::vector<const ActionDeclarationNode*> actions;
+    auto add_global = [&](const DeclarationNode* declaration, std::string name) {
+        symbols.globals[declaration] = program.globalNames.size();
+        program.globalNames.push_back(std::move(name));
+    };
+    for (auto declaration : declarations) {
+        if (declaration->isStruct() || dynamic_cast<const StructInitializerNode*>(declaration->value)) {
+            // Structs and their instances only exist through their field and member lists
+            continue;
+        } else if (auto action = dynamic_cast<const ActionDeclarationNode*>(declaration)) {
+            // Actions with parameters are only ever inlined into other actions
+            if (!action->hasParameters) {actions.push_back(action);}
+        } else if (declaration->isFunction()) {
+            symbols.functions[declaration] = functions.size();
+            functions.push_back(declaration);
+        } else if (declaration->parentStruct) {
+            add_global(declaration, std::string(declaration->parentStruct->identifier) + "." + std::string(declaration->identifier));
+        } else {
+            add_global(declaration, std::string(declaration->identifier));
+            // Comprehensions are only ever whole definitions
+            if (declaration->value && declaration->value->kind == NodeKind::COMPREHENSION && !((const ComprehensionNode*) declaration->value)->unrolled) {
+                comprehensions.push_back((const ComprehensionNode*) declaration->value);
+            }
+        }
+    }
+    for (auto& variable : main->tickerSchedule.state) {
+        add_global(variable.get(), "ticker." + variable->name);
+    }
+
+    // Registered as functions of their variables, so that their bodies can be called on each element
+    for (size_t i = 0; i < comprehensions.size(); i++) {
+        symbols.functions[comprehensions[i]->variable.get()] = functions.size() + i;
+    }
+
+    // Chunks are created up front so that they don't move while they are being compiled
+    program.functions.resize(functions.size() + comprehensions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        auto function = (const FunctionDeclarationNode*) functions[i];
+        Chunk& chunk = program.functions[i];
+        chunk.name = function->identifier;
+
+        Assembler assembler(program, chunk);
+        uint32_t parameters = assembler.allocate(function->parameters.size());
+        for (size_t k = 0; k < function->parameters.size(); k++) {
+            assembler.bind_local(function->parameters[k].get(), parameters + k);
+        }
+        uint32_t result = assembler.allocate();
+        assembler.compile(function->value, result);
+        assembler.finish();
+        assembler.emit(OpCode::RETURN, result);
+    }
+    for (size_t i = 0; i < comprehensions.size(); i++) {
+        auto variable = comprehensions[i]->variable.get();
+        Chunk& chunk = program.functions[functions.size() + i];
+        chunk.name = "for " + std::string(variable->identifier);
+
+        Assembler assembler(program, chunk);
+        assembler.bind_local(variable, assembler.allocate());
+        uint32_t result = assembler.allocate();
+        assembler.compile(comprehensions[i]->body.get(), result);
+        assembler.finish();
+        assembler.emit(OpCode::RETURN, result);
+    }
+
+    std::unordered_set<const DeclarationNode*> visited;
+    std::vector<const DeclarationNode*> order;
+    for (auto declaration : declarations) {
+        order_globals(declaration, compiler->dependencies, symbols, visited, order);
+    }
+    for (auto& variable : main->tickerSchedule.state) {
+        order.push_back(variable.get());
+    }
+    program.update.name = "update";
+    Assembler assembler(program, program.update);
+    for (auto declaration : order) {
+        uint32_t value = assembler.allocate();
+        compile_definition(assembler, declaration, value);
+        assembler.emit(OpCode::DEFINE_GLOBAL, value, symbols.globals.at(declaration));
+        assembler.release(value);
+    }
+
+    auto& dispatch = main->tickerSchedule.dispatch;
+    bool hasTicker = dispatch && !dispatch->assignments.empty();
+    program.actions.resize(actions.size() + hasTicker);
+    for (size_t i = 0; i < actions.size(); i++) {
+        compile_action(program, program.actions[i], actions[i]);
+    }
+    if (hasTicker) {
+        program.ticker = (long) actions.size();
+        program.tickerPeriod = main->tickerSchedule.basePeriod;
+        compile_action(program, program.actions.back(), dispatch.get());
+    }
+
+    return program;
+}
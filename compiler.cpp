@@ -1,20 +1,36 @@
 //
 // Created by Cooper Roalson on 8/30/24.
 //
+#include <algorithm>
+#include <unordered_set>
+
 #include "compiler.h"
 #include "ast.h"
+#include "module.h"
 
-bool Compiler::compile_program(std::string& source, std::ostream& out) {
+bool Compiler::compile_program(std::string& source, std::ostream& out, const CompileOptions& options) {
     Compiler compiler;
+    compiler.moduleDirectories = options.moduleDirectories;
+    compiler.shareSubexpressions = options.shareSubexpressions;
+    if (options.prelude) {
+        compiler.prelude = modules::Module::open(options.prelude, {}, compiler.signatures);
+        compiler.symbolTable.import_prelude(compiler.prelude.get());
+    }
     if (!compiler.compile_frontend(source)) {return false;}
+    compiler.narrow_ranges(source, options.narrowRanges);
+    if (options.hoistInvariants) {compiler.hoist_invariants();}
+    if (options.minifyNames) {compiler.minify_names(options.nameMap);}
+    if (!compiler.check_costs(source, options)) {return false;}
     compiler.compile_backend(out);
     return true;
 }
 
-Compiler::Compiler() : ast(), symbolTable() {}
+Compiler::Compiler() : source(), ast(), symbolTable(), dependencies(), signatures(), moduleDirectories(), importedModules(), prelude(), shareSubexpressions(false) {}
+
+Compiler::~Compiler() = default;
 
 SymbolScope* SymbolScope::create_child_scope(std::string childName) {
-    SymbolScope& child = childScopes.emplace_back();
+    SymbolScope& child = *childScopes.emplace_back(std::make_unique<SymbolScope>());
     child.parentScope = this;
     child.name = std::move(childName);
     return &child;
@@ -26,12 +42,139 @@ bool SymbolScope::add_symbol(AST::DeclarationNode* declaration) {
     return true;
 }
 
+bool SymbolScope::add_overload(AST::FunctionDeclarationNode* function) {
+    auto existing = symbols.find(function->identifier);
+    if (existing == symbols.end() || !existing->second->isFunction()) {return false;}
+
+    auto& functions = overloads[function->identifier];
+    if (functions.empty()) {
+        auto first = (AST::FunctionDeclarationNode*) existing->second;
+        first->isOverloaded = true;
+        functions[first->signature] = first;
+    }
+    if (!functions.try_emplace(function->signature, function).second) {return false;}
+    function->isOverloaded = true;
+    return true;
+}
+
+AST::FunctionDeclarationNode* SymbolScope::find_overload(std::string_view identifier, uint32_t signature) {
+    auto functions = overloads.find(identifier);
+    if (functions == overloads.end()) {return nullptr;}
+    auto function = functions->second.find(signature);
+    return function == functions->second.end() ? nullptr : function->second;
+}
+
 AST::DeclarationNode* SymbolScope::find_symbol(std::string_view identifier) {
     if (symbols.contains(identifier)) {
         return symbols[identifier];
-    } else if (parentScope) {
+    }
+    for (auto module : imports) {
+        if (auto declaration = module->import_symbol(identifier, this)) {return declaration;}
+    }
+    if (parentScope) {
         return parentScope->find_symbol(identifier);
+    } else if (prelude) {
+        return prelude->import_symbol(identifier, this);
     } else {
         return nullptr;
     }
 }
+
+std::string SignatureTable::key(const std::vector<Type>& parameters) {
+    std::string result;
+    for (auto& parameter : parameters) {
+        result += parameter.name();
+        result += ',';
+    }
+    return result;
+}
+
+uint32_t SignatureTable::intern(const std::vector<Type>& parameters) {
+    return ids.try_emplace(key(parameters), (uint32_t) ids.size()).first->second;
+}
+
+bool SignatureTable::find(const std::vector<Type>& parameters, uint32_t& signature) const {
+    auto it = ids.find(key(parameters));
+    if (it == ids.end()) {return false;}
+    signature = it->second;
+    return true;
+}
+
+void DependencyGraph::add_dependency(const AST::DeclarationNode* declaration, const AST::DeclarationNode* dependency) {
+    Declarations& existing = dependencyMap[declaration];
+    if (std::find(existing.begin(), existing.end(), dependency) != existing.end()) {return;}
+    existing.push_back(dependency);
+    dependentMap[dependency].push_back(declaration);
+}
+
+const DependencyGraph::Declarations& DependencyGraph::dependencies(const AST::DeclarationNode* declaration) const {
+    static const Declarations none;
+    auto it = dependencyMap.find(declaration);
+    return it == dependencyMap.end() ? none : it->second;
+}
+
+const DependencyGraph::Declarations& DependencyGraph::direct_dependents(const AST::DeclarationNode* declaration) const {
+    static const Declarations none;
+    auto it = dependentMap.find(declaration);
+    return it == dependentMap.end() ? none : it->second;
+}
+
+DependencyGraph::Declarations DependencyGraph::dependents(const AST::DeclarationNode* declaration) const {
+    Declarations result;
+    std::unordered_set<const AST::DeclarationNode*> visited = {declaration};
+    std::vector<const AST::DeclarationNode*> stack = {declaration};
+    while (!stack.empty()) {
+        const AST::DeclarationNode* current = stack.back();
+        stack.pop_back();
+        for (auto dependent : direct_dependents(current)) {
+            if (visited.insert(dependent).second) {
+                result.push_back(dependent);
+                stack.push_back(dependent);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<DependencyGraph::Declarations> DependencyGraph::find_cycles() const {
+    // Iterative depth-first search; an edge back to a declaration still on the path closes a cycle
+    enum State {UNVISITED, ON_PATH, DONE};
+    std::unordered_map<const AST::DeclarationNode*, State> states;
+    std::vector<Declarations> cycles;
+
+    // Visit in a deterministic order so that errors don't depend on hashing
+    Declarations roots;
+    for (auto& [declaration, _] : dependencyMap) {roots.push_back(declaration);}
+    std::sort(roots.begin(), roots.end(), [](auto a, auto b) {return a->pos.i < b->pos.i;});
+
+    for (auto root : roots) {
+        if (states[root] != UNVISITED) {continue;}
+
+        std::vector<std::pair<const AST::DeclarationNode*, size_t>> path = {{root, 0}};
+        states[root] = ON_PATH;
+        while (!path.empty()) {
+            auto& [current, next] = path.back();
+            const Declarations& edges = dependencies(current);
+            if (next == edges.size()) {
+                states[current] = DONE;
+                path.pop_back();
+                continue;
+            }
+
+            const AST::DeclarationNode* dependency = edges[next++];
+            State& state = states[dependency];
+            if (state == UNVISITED) {
+                state = ON_PATH;
+                path.emplace_back(dependency, 0);
+            } else if (state == ON_PATH) {
+                Declarations cycle;
+                auto start = std::find_if(path.begin(), path.end(), [&](auto& entry) {return entry.first == dependency;});
+                for (auto it = start; it != path.end(); it++) {cycle.push_back(it->first);}
+                if (std::any_of(cycle.begin(), cycle.end(), [](auto declaration) {return !declaration->isFunction();})) {
+                    cycles.push_back(std::move(cycle));
+                }
+            }
+        }
+    }
+    return cycles;
+}
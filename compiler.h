@@ -6,83 +6,199 @@
 #define DESMOS_COMPILER_COMPILER_H
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
 
 struct Type {
-    static constexpr const char* PRIMITIVE_STRS[5] = {"num", "point", "bool", "color", "polygon"};
+    static constexpr const char* PRIMITIVE_STRS[6] = {"num", "point", "bool", "color", "polygon", "action"};
     enum Primitive {
         NUM,
         POINT,
         BOOL,
         COLOR,
-        POLYGON
+        POLYGON,
+        ACTION // Lexed as KW_ACTION rather than as a primitive
     };
 
     bool isUnknown;
     bool isPrimitive;
     bool isConst;
+    bool isList;
     union {
         Primitive primitive;
         std::string_view identifier;
     } value;
 
-    Type() : isUnknown(true), value{} {}
-    Type(Primitive primitive, bool isConst = false) : isUnknown(false), isPrimitive(true), isConst(isConst), value{primitive} {}
-    Type(std::string_view identifier, bool isConst = false) : isUnknown(false), isPrimitive(false), isConst(isConst), value{.identifier = identifier} {}
+    Type() : isUnknown(true), isPrimitive(false), isConst(false), isList(false), value{} {}
+    Type(Primitive primitive, bool isConst = false, bool isList = false) : isUnknown(false), isPrimitive(true), isConst(isConst), isList(isList), value{primitive} {}
+    Type(std::string_view identifier, bool isConst = false, bool isList = false) : isUnknown(false), isPrimitive(false), isConst(isConst), isList(isList), value{.identifier = identifier} {}
 
     bool matches(const Type& other) const {
-        if (isUnknown) {return true;}
+        if (isUnknown || other.isUnknown) {return true;}
+        if (isList != other.isList) {return false;}
         if (isPrimitive) {return other.isPrimitive && value.primitive == other.value.primitive;}
         return !other.isPrimitive && value.identifier == other.value.identifier;
     }
 
+    // Only matches single values; use element() to check the element type of a list
     bool matches_primitive(Primitive primitive) const {
-        return isUnknown || (isPrimitive && value.primitive == primitive);
+        return isUnknown || (isPrimitive && !isList && value.primitive == primitive);
+    }
+
+    // The type of a single element of this type (the type itself if it isn't a list)
+    Type element() const {
+        Type result = *this;
+        result.isList = false;
+        return result;
+    }
+
+    Type list() const {
+        Type result = *this;
+        result.isList = !isUnknown;
+        return result;
     }
 
     std::string name() const {
         if (isUnknown) {return "unknown";}
-        if (isPrimitive) {return PRIMITIVE_STRS[value.primitive];}
-        return std::string(value.identifier);
+        std::string result = isPrimitive ? PRIMITIVE_STRS[value.primitive] : std::string(value.identifier);
+        return isList ? result + "[]" : result;
     }
 };
 
 // Forward declarations
-namespace AST {struct MainBlockNode; struct DeclarationNode;}
+namespace AST {struct MainBlockNode; struct DeclarationNode; struct FunctionDeclarationNode; struct ExpressionNode;}
 namespace frontend {class Parser;}
+namespace sampler {struct Options;}
+namespace modules {class Module; class SharedModule;}
+
+// Interns the parameter types of functions, so that an overload can be found by its name and a small id
+class SignatureTable {
+    std::unordered_map<std::string, uint32_t> ids;
+
+    static std::string key(const std::vector<Type>& parameters);
+
+public:
+    SignatureTable() : ids() {}
+
+    uint32_t intern(const std::vector<Type>& parameters);
+    // Without interning it, for lookups; returns false if no function has the signature
+    bool find(const std::vector<Type>& parameters, uint32_t& signature) const;
+};
 
 class SymbolScope {
 
     std::unordered_map<std::string_view, AST::DeclarationNode*> symbols;
-    std::vector<SymbolScope> childScopes;
+    // Functions that share a name, by signature (see SignatureTable); symbols holds the first one declared
+    std::unordered_map<std::string_view, std::unordered_map<uint32_t, AST::FunctionDeclarationNode*>> overloads;
+    std::vector<std::unique_ptr<SymbolScope>> childScopes; // Held by pointer so that scopes never move
+    std::vector<modules::Module*> imports; // Searched after this scope's own symbols
+    modules::Module* prelude; // Searched after everything else, from the root scope
     SymbolScope* parentScope;
     std::string name;
 
 public:
-    SymbolScope() : symbols(), childScopes(), parentScope(nullptr), name() {}
+    SymbolScope() : symbols(), overloads(), childScopes(), imports(), prelude(nullptr), parentScope(nullptr), name() {}
 
     bool add_symbol(AST::DeclarationNode* declaration);
+    // Adds a function with the name of another function in this scope.
+    // Returns false if the name isn't a function's, or one already has the same signature.
+    bool add_overload(AST::FunctionDeclarationNode* function);
+    // Of the functions declared in this scope with the name
+    AST::FunctionDeclarationNode* find_overload(std::string_view identifier, uint32_t signature);
+    void import_module(modules::Module* module) {imports.push_back(module);}
+    void import_prelude(modules::Module* module) {prelude = module;}
     SymbolScope* create_child_scope(std::string childName = "");
     SymbolScope* get_parent_scope() {return parentScope;}
     AST::DeclarationNode* find_symbol(std::string_view identifier);
 };
 
+// Which declarations reference which, recorded during semantic analysis
+class DependencyGraph {
+    using Declarations = std::vector<const AST::DeclarationNode*>;
+
+    std::unordered_map<const AST::DeclarationNode*, Declarations> dependencyMap;
+    std::unordered_map<const AST::DeclarationNode*, Declarations> dependentMap;
+
+public:
+    DependencyGraph() : dependencyMap(), dependentMap() {}
+
+    void add_dependency(const AST::DeclarationNode* declaration, const AST::DeclarationNode* dependency);
+
+    // What a declaration directly references
+    const Declarations& dependencies(const AST::DeclarationNode* declaration) const;
+    // What directly references a declaration
+    const Declarations& direct_dependents(const AST::DeclarationNode* declaration) const;
+    // Everything that has to be recompiled if a declaration changes
+    Declarations dependents(const AST::DeclarationNode* declaration) const;
+
+    // Each cycle is returned in order, e.g. {a, b} for a -> b -> a.
+    // Cycles made up only of functions are left out, since recursive functions are allowed.
+    std::vector<Declarations> find_cycles() const;
+};
+
+// Limits on each emitted statement (0 for no limit)
+struct CostBudget {
+    size_t bytes = 0; // Of LaTeX
+    size_t operators = 0;
+    size_t depth = 0;
+    size_t calls = 0;
+    double cost = 0; // Estimated evaluation cost
+    bool isError = false; // Whether going over the budget is an error rather than a warning
+
+    bool is_set() const {return bytes || operators || depth || calls || cost;}
+};
+
+struct CompileOptions {
+    std::ostream* costReport = nullptr; // Where to write the cost of every emitted statement, if anywhere
+    CostBudget budget;
+    std::vector<std::string> moduleDirectories; // Searched for imported modules after the working directory
+    bool shareSubexpressions = false; // Hash-cons identical subexpressions into one node, for repetitive programs
+    bool hoistInvariants = false; // Move subexpressions that never change into definitions of their own
+    bool narrowRanges = false; // Drop absolute values, maxima and conditionals that can't change a value
+    bool minifyNames = false; // Emit the shortest Desmos names, shortest for the most referenced declarations
+    std::ostream* nameMap = nullptr; // Where to write which source name each minified name stands for, if anywhere
+    // Definitions every program can use without importing them, built once and shared (see SharedModule)
+    std::shared_ptr<const modules::SharedModule> prelude;
+};
+
 class Compiler {
-    friend bool compile_program(std::string&, std::ostream&);
+    friend bool compile_program(std::string&, std::ostream&, const CompileOptions&);
 
     bool compile_frontend(std::string& source);
+    // Warns about branches that are never taken, and drops them along with other redundant operations if simplifying
+    void narrow_ranges(std::string& source, bool simplify);
+    void hoist_invariants();
+    void minify_names(std::ostream* nameMap);
+    bool check_costs(std::string& source, const CompileOptions& options);
     void compile_backend(std::ostream& out);
 
 public:
+    std::string_view source; // For reporting positions
     std::unique_ptr<AST::MainBlockNode> ast;
     SymbolScope symbolTable;
+    DependencyGraph dependencies;
+    SignatureTable signatures;
+    std::vector<std::string> moduleDirectories;
+    std::vector<std::unique_ptr<modules::Module>> importedModules;
+    std::unique_ptr<modules::Module> prelude; // This compiler's view of the shared prelude, if there is one
+    bool shareSubexpressions; // Whether the parser makes the AST a DAG (see parser.cpp)
 
     Compiler();
-
-    static bool compile_program(std::string& source, std::ostream& out);
+    ~Compiler();
+
+    static bool compile_program(std::string& source, std::ostream& out, const CompileOptions& options = {});
+    // Compiles a program into a module interface that other programs can import
+    static bool compile_module(std::string& source, std::ostream& out);
+    // Runs the program's ticker headlessly and prints the final value of every variable
+    static bool simulate_program(std::string& source, long ticks, std::ostream& out);
+    // Samples a function of one or two variables over a grid and writes an image or CSV of the samples
+    static bool sample_program(std::string& source, const sampler::Options& options, std::ostream& out);
 };
 
 // Order of operations:
-//  0. (expr), |expr|, lit, ident
+//  0. (expr), |expr|, (x,y), [list], lit, ident
 //  1. func(), arr[], foo.bar (left)
 //  2. x^y (right)
 //  3. -x, !x (right)
@@ -0,0 +1,411 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <unordered_set>
+
+#include "compiler.h"
+#include "ast.h"
+
+using namespace AST;
+
+namespace {
+
+    struct Cost {
+        size_t bytes = 0;
+        size_t operators = 0;
+        size_t depth = 0;
+        size_t calls = 0;
+        double cost = 0;
+
+        // Combines the costs of separate expressions in one statement
+        void add(const Cost& other) {
+            bytes += other.bytes;
+            operators += other.operators;
+            depth = std::max(depth, other.depth);
+            calls += other.calls;
+            cost += other.cost;
+        }
+    };
+
+    // One Desmos expression in the output
+    struct EmittedStatement {
+        SrcPos pos;
+        std::string name;
+        Cost cost;
+    };
+
+    // Rough number of times Desmos evaluates an equation to fit a regression to it
+    constexpr double REGRESSION_EVALUATIONS = 10;
+
+    // Rough relative cost of evaluating each operator in Desmos
+    double operator_cost(Operator op) {
+        switch (op) {
+            case Operator::DIV:
+            case Operator::OR:
+                return 2;
+            case Operator::MOD:
+                return 4;
+            case Operator::EXP:
+                return 8;
+            default:
+                return 1;
+        }
+    }
+
+    class CostEstimator {
+        std::unordered_map<const DeclarationNode*, double> functionCosts;
+        std::unordered_set<const DeclarationNode*> estimating; // Functions whose cost is being estimated, for recursion
+
+        // The function whose body has to be measured to cost the call, if it hasn't been yet. Recursive calls are
+        // only counted once.
+        const DeclarationNode* unmeasured_function(const ExpressionNode* expr) const {
+            auto call = dynamic_cast<const CallNode*>(expr);
+            if (!call || call->builtin()) {return nullptr;}
+            auto function = ((const IdentifierNode*) call->function.get())->declaration;
+            if (!function || !function->value || functionCosts.contains(function) || estimating.contains(function)) {return nullptr;}
+            return function;
+        }
+
+        // The subexpressions whose costs the expression's cost is made up of (see total)
+        static void find_operands(const ExpressionNode* expr, std::vector<const ExpressionNode*>& operands) {
+            switch (expr->kind) {
+                case NodeKind::POINT:
+                    operands.push_back(((const PointNode*) expr)->x.get());
+                    operands.push_back(((const PointNode*) expr)->y.get());
+                    return;
+                case NodeKind::LIST:
+                    for (auto& element : ((const ListNode*) expr)->elements) {operands.push_back(element.get());}
+                    return;
+                case NodeKind::INDEX:
+                    operands.push_back(((const IndexNode*) expr)->list.get());
+                    operands.push_back(((const IndexNode*) expr)->index.get());
+                    return;
+                case NodeKind::CALL:
+                    for (auto& argument : ((const CallNode*) expr)->arguments) {operands.push_back(argument.get());}
+                    return;
+                case NodeKind::MEMBER_ACCESS:
+                    operands.push_back(((const MemberAccessNode*) expr)->object.get());
+                    return;
+                case NodeKind::BINARY_OPERATOR:
+                    operands.push_back(((const BinaryOperatorNode*) expr)->left.get());
+                    operands.push_back(((const BinaryOperatorNode*) expr)->right.get());
+                    return;
+                case NodeKind::UNARY_OPERATOR:
+                    operands.push_back(((const UnaryOperatorNode*) expr)->expr.get());
+                    return;
+                case NodeKind::TERNARY_OPERATOR: {
+                    auto ternary = (const TernaryOperatorNode*) expr;
+                    operands.push_back(ternary->condition.get());
+                    operands.push_back(ternary->ifTrue.get());
+                    if (ternary->ifFalse) {operands.push_back(ternary->ifFalse.get());}
+                    return;
+                }
+                case NodeKind::COMPREHENSION: {
+                    auto comprehension = (const ComprehensionNode*) expr;
+                    if (comprehension->unrolled) {
+                        operands.push_back(comprehension->unrolled.get());
+                    } else {
+                        operands.push_back(comprehension->start.get());
+                        operands.push_back(comprehension->end.get());
+                        operands.push_back(comprehension->body.get());
+                    }
+                    return;
+                }
+                case NodeKind::SOLVE: {
+                    auto solve = (const SolveNode*) expr;
+                    if (!solve->root) {
+                        operands.push_back(solve->left.get());
+                        operands.push_back(solve->right.get());
+                    }
+                    return;
+                }
+                case NodeKind::DERIVATIVE:
+                    operands.push_back(((const DerivativeNode*) expr)->derivative.get());
+                    return;
+                case NodeKind::STRUCT_INITIALIZER:
+                    for (auto& argument : ((const StructInitializerNode*) expr)->arguments) {operands.push_back(argument.get());}
+                    return;
+                default:
+                    return;
+            }
+        }
+
+        // The expression's cost from its operands' costs, as found by find_operands
+        Cost total(const ExpressionNode* expr, const Cost* operands, size_t count) {
+            auto combine = [&](size_t first, size_t end) {
+                Cost result;
+                for (size_t i = first; i < end; i++) {result.add(operands[i]);}
+                result.depth++;
+                return result;
+            };
+            switch (expr->kind) {
+                case NodeKind::POINT:
+                case NodeKind::LIST:
+                case NodeKind::STRUCT_INITIALIZER:
+                    return combine(0, count);
+                case NodeKind::INDEX:
+                case NodeKind::UNARY_OPERATOR: {
+                    Cost result = combine(0, count);
+                    result.operators++;
+                    result.cost++;
+                    return result;
+                }
+                case NodeKind::CALL: {
+                    auto call = (const CallNode*) expr;
+                    Cost result = combine(0, call->arguments.size());
+                    if (call->builtin()) {
+                        // Desmos evaluates its own functions directly, like operators
+                        result.operators++;
+                        result.cost++;
+                        return result;
+                    }
+                    // Evaluating a call evaluates the function's body
+                    auto function = ((const IdentifierNode*) call->function.get())->declaration;
+                    auto known = functionCosts.find(function);
+                    result.calls++;
+                    result.cost += 1 + (known != functionCosts.end() ? known->second : 0);
+                    return result;
+                }
+                case NodeKind::MEMBER_ACCESS: {
+                    Cost result = combine(0, count);
+                    auto memberDeclaration = ((const MemberAccessNode*) expr)->memberDeclaration;
+                    if (memberDeclaration && memberDeclaration->isPerInstance) {
+                        // Indexes the member's list
+                        result.operators++;
+                        result.cost++;
+                    }
+                    return result;
+                }
+                case NodeKind::BINARY_OPERATOR: {
+                    Cost result = combine(0, count);
+                    result.operators++;
+                    result.cost += operator_cost(((const BinaryOperatorNode*) expr)->op);
+                    return result;
+                }
+                case NodeKind::TERNARY_OPERATOR: {
+                    // Only one branch is evaluated, so count the more expensive one
+                    const Cost& condition = operands[0];
+                    const Cost& ifTrue = operands[1];
+                    Cost ifFalse = count > 2 ? operands[2] : Cost();
+                    Cost result = condition;
+                    result.operators += 1 + ifTrue.operators + ifFalse.operators;
+                    result.depth = 1 + std::max({condition.depth, ifTrue.depth, ifFalse.depth});
+                    result.calls += ifTrue.calls + ifFalse.calls;
+                    result.cost += 1 + std::max(ifTrue.cost, ifFalse.cost);
+                    return result;
+                }
+                case NodeKind::COMPREHENSION: {
+                    auto comprehension = (const ComprehensionNode*) expr;
+                    if (comprehension->unrolled) {return operands[0];}
+                    // The body is evaluated for each element, and a range whose length isn't known has at least one
+                    const Cost& body = operands[2];
+                    Cost result = combine(0, 2);
+                    result.operators += body.operators;
+                    result.depth = std::max(result.depth, body.depth + 1);
+                    result.calls += body.calls;
+                    result.cost += body.cost * comprehension->size().value_or(1);
+                    return result;
+                }
+                case NodeKind::SOLVE: {
+                    if (count == 0) {
+                        // Written as a number
+                        Cost result;
+                        result.depth = 1;
+                        return result;
+                    }
+                    Cost result = combine(0, count);
+                    result.operators++;
+                    result.depth++;
+                    result.cost = (result.cost + 1) * REGRESSION_EVALUATIONS;
+                    return result;
+                }
+                case NodeKind::DERIVATIVE:
+                    return operands[0];
+                default: {
+                    // Literals and identifiers
+                    Cost result;
+                    result.depth = 1;
+                    return result;
+                }
+            }
+        }
+
+    public:
+        CostEstimator() : functionCosts(), estimating() {}
+
+        // Everything but the byte size of an expression. Measured without recursing, so that deeply nested
+        // expressions can't overflow the stack. The bodies of called functions are measured on the same stack, just
+        // before the calls that need them.
+        Cost measure(const ExpressionNode* root) {
+            struct Frame {
+                const ExpressionNode* expr;
+                bool isExpanded;
+                size_t operandCount;
+                const DeclarationNode* function; // Whose body is measured after the operands, if any
+            };
+            std::vector<Frame> stack = {{root, false, 0, nullptr}};
+            std::vector<Cost> costs; // Of the operands of expanded frames
+            std::vector<const ExpressionNode*> operands;
+            while (!stack.empty()) {
+                Frame& frame = stack.back();
+                if (!frame.isExpanded) {
+                    frame.isExpanded = true;
+                    operands.clear();
+                    find_operands(frame.expr, operands);
+                    frame.operandCount = operands.size();
+                    frame.function = unmeasured_function(frame.expr);
+                    const ExpressionNode* body = nullptr;
+                    if (frame.function) {
+                        estimating.insert(frame.function);
+                        body = frame.function->value;
+                    }
+                    // Pushed in reverse, so that they are measured in order and the body comes last
+                    if (body) {stack.push_back({body, false, 0, nullptr});}
+                    for (auto it = operands.rbegin(); it != operands.rend(); it++) {stack.push_back({*it, false, 0, nullptr});}
+                    continue;
+                }
+
+                size_t first = costs.size() - frame.operandCount - (frame.function != nullptr);
+                if (frame.function) {
+                    functionCosts[frame.function] = costs.back().cost;
+                    estimating.erase(frame.function);
+                }
+                Cost result = total(frame.expr, costs.data() + first, frame.operandCount);
+                costs.resize(first);
+                costs.push_back(result);
+                stack.pop_back();
+            }
+            return costs.back();
+        }
+    };
+
+    size_t byte_size(const std::string& latex) {
+        // Without the trailing newline
+        return latex.empty() || latex.back() != '\n' ? latex.size() : latex.size() - 1;
+    }
+
+    void collect_statements(const StatementNode* statement, CostEstimator& estimator, std::vector<EmittedStatement>& emitted) {
+        if (auto block = dynamic_cast<const StatementBlockNode*>(statement)) {
+            for (auto& inner : block->statements) {
+                collect_statements(inner.get(), estimator, emitted);
+            }
+        } else if (auto initialization = dynamic_cast<const InitializationStatementNode*>(statement)) {
+            // Struct instances are emitted as part of their struct
+            if (dynamic_cast<const StructInitializerNode*>(initialization->value.get())) {return;}
+
+            std::stringstream latex;
+            initialization->compile(latex);
+            EmittedStatement& result = emitted.emplace_back(initialization->declaration->pos, std::string(initialization->declaration->identifier), estimator.measure(initialization->value.get()));
+            result.cost.bytes = byte_size(latex.str());
+            if (auto parentStruct = initialization->declaration->parentStruct) {
+                result.name = std::string(parentStruct->identifier) + "." + result.name;
+                // Per-instance members are evaluated once for every instance
+                if (initialization->declaration->isPerInstance) {result.cost.cost *= (double) parentStruct->instances.size();}
+            }
+        } else if (auto definition = dynamic_cast<const StructDefinitionNode*>(statement)) {
+            auto declaration = definition->declaration.get();
+            for (size_t i = 0; i < declaration->fields.size(); i++) {
+                Cost cost;
+                for (auto instance : declaration->instances) {
+                    cost.add(estimator.measure(((const StructInitializerNode*) instance->value.get())->arguments[i].get()));
+                }
+                cost.depth++;
+                std::stringstream latex;
+                definition->compile_field(latex, i);
+                cost.bytes = byte_size(latex.str());
+                emitted.emplace_back(declaration->fields[i]->pos, std::string(declaration->identifier) + "." + std::string(declaration->fields[i]->identifier), cost);
+            }
+            for (auto& member : declaration->members) {
+                collect_statements(member.get(), estimator, emitted);
+            }
+        } else if (auto action = dynamic_cast<const ActionDefinitionNode*>(statement)) {
+            if (action->declaration->assignments.empty()) {return;}
+
+            Cost cost;
+            for (auto& [variable, value] : action->declaration->assignments) {
+                cost.add(estimator.measure(value.get()));
+            }
+            std::stringstream latex;
+            action->compile(latex);
+            cost.bytes = byte_size(latex.str());
+            emitted.emplace_back(action->declaration->pos, std::string(action->declaration->identifier), cost);
+        }
+    }
+
+    void collect_ticker(const TickerScheduleNode& schedule, CostEstimator& estimator, std::vector<EmittedStatement>& emitted) {
+        if (!schedule.dispatch || schedule.dispatch->assignments.empty()) {return;}
+
+        Cost cost;
+        for (auto& [variable, value] : schedule.dispatch->assignments) {
+            cost.add(estimator.measure(value.get()));
+        }
+        std::stringstream latex;
+        ActionDefinitionNode::compile_action(latex, schedule.dispatch.get());
+        cost.bytes = byte_size(latex.str());
+        emitted.emplace_back(schedule.tickers.front()->pos, "ticker", cost);
+    }
+
+    void write_report(std::ostream& out, const std::vector<EmittedStatement>& emitted, const SourceMap& lines) {
+        out << "Cost report (estimated cost is in weighted operations per evaluation)\n";
+        out << std::left << std::setw(10) << "Position" << std::setw(24) << "Statement" << std::right
+            << std::setw(8) << "Bytes" << std::setw(8) << "Ops" << std::setw(8) << "Depth" << std::setw(8) << "Calls" << std::setw(10) << "Cost" << "\n";
+
+        Cost total;
+        for (auto& statement : emitted) {
+            SrcLocation location = lines.locate(statement.pos);
+            std::string position = std::to_string(location.line + 1) + ":" + std::to_string(location.col + 1);
+            out << std::left << std::setw(10) << position << std::setw(24) << statement.name << std::right
+                << std::setw(8) << statement.cost.bytes << std::setw(8) << statement.cost.operators << std::setw(8) << statement.cost.depth
+                << std::setw(8) << statement.cost.calls << std::setw(10) << statement.cost.cost << "\n";
+            total.add(statement.cost);
+        }
+        out << std::left << std::setw(34) << "Total" << std::right
+            << std::setw(8) << total.bytes << std::setw(8) << total.operators << std::setw(8) << total.depth
+            << std::setw(8) << total.calls << std::setw(10) << total.cost << std::endl;
+    }
+
+    template <class T>
+    void check_limit(std::string& message, const char* name, T value, T limit) {
+        if (limit == 0 || value <= limit) {return;}
+        std::stringstream ss;
+        ss << (message.empty() ? "" : ", ") << value << " " << name << " (budget " << limit << ")";
+        message += ss.str();
+    }
+}
+
+bool Compiler::check_costs(std::string& source, const CompileOptions& options) {
+    if (!options.costReport && !options.budget.is_set()) {return true;}
+
+    CostEstimator estimator;
+    std::vector<EmittedStatement> emitted;
+    for (auto statement : ast->emissionOrder) {
+        collect_statements(statement, estimator, emitted);
+    }
+    collect_ticker(ast->tickerSchedule, estimator, emitted);
+
+    if (options.costReport) {
+        write_report(*options.costReport, emitted, SourceMap(source));
+    }
+
+    const CostBudget& budget = options.budget;
+    std::vector<Error> diagnostics;
+    for (auto& statement : emitted) {
+        std::string message;
+        check_limit(message, "LaTeX bytes", statement.cost.bytes, budget.bytes);
+        check_limit(message, "operators", statement.cost.operators, budget.operators);
+        check_limit(message, "levels deep", statement.cost.depth, budget.depth);
+        check_limit(message, "function calls", statement.cost.calls, budget.calls);
+        check_limit(message, "estimated cost", statement.cost.cost, budget.cost);
+        if (!message.empty()) {
+            diagnostics.emplace_back(statement.pos, "'" + statement.name + "' is over budget: " + message);
+        }
+    }
+    if (!diagnostics.empty()) {
+        frontend::print_diagnostics(diagnostics, source, budget.isError);
+    }
+    return diagnostics.empty() || !budget.isError;
+}
@@ -0,0 +1,62 @@
+# Stress test for deeply nested expressions: each kind of nesting is generated about a million levels deep and
+# compiled under a 1 MB stack, once with the defaults and once with every optional pass, both with a cost report,
+# then evaluated with --simulate. A function nested as deep as the sampler allows is sampled as well.
+# A compiler, evaluator or sampler pass that recurses on the depth of an expression overflows the stack and fails the test.
+# Run by ctest (see CMakeLists.txt) as cmake -DCOMPILER=... -DWORK_DIR=... -P deep_nesting_test.cmake
+
+set(DEPTH 1000000)
+# Kernels keep a batch of results for each of their instructions, so the sampler takes at most 65535 of them
+set(SAMPLE_DEPTH 15000)
+
+# Sets <kind>_value to each kind of nesting, depth levels deep, around the variable var
+function(nest depth var)
+    string(REPEAT " + ${var}" ${depth} sum)
+    string(REPEAT "(" ${depth} open)
+    string(REPEAT ")" ${depth} close)
+    string(REPEAT "-" ${depth} prefix)
+    string(REPEAT "${var} > 0 ? 1 : " ${depth} ternary)
+    string(REPEAT "${var}^" ${depth} power)
+    string(REPEAT " + 1" ${depth} ones)
+
+    set(sum_value "${var}${sum}" PARENT_SCOPE)
+    set(parentheses_value "${open}${var}${close}" PARENT_SCOPE)
+    set(prefix_value "${prefix}${var}" PARENT_SCOPE)
+    set(ternary_value "${ternary}${var}" PARENT_SCOPE)
+    set(power_value "${power}${var}" PARENT_SCOPE)
+    # Only for the definition named deep, which the equation solves for
+    set(solve_value "$solve(deep${ones} = 0)" PARENT_SCOPE)
+endfunction()
+
+# Runs the compiler with the given arguments under a 1 MB stack
+function(run_compiler description)
+    execute_process(
+            COMMAND sh -c "ulimit -s 1024 && exec \"$0\" \"$@\" > /dev/null" ${COMPILER} ${ARGN}
+            RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${description} failed: ${result}")
+    endif ()
+endfunction()
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+nest(${DEPTH} a)
+foreach (kind sum parentheses prefix ternary power solve)
+    set(input ${WORK_DIR}/deep_${kind}.des)
+    file(WRITE ${input} "num a = 1;\nnum deep = ${${kind}_value};\n")
+
+    foreach (flags "" "--narrow-ranges --hoist-invariants --minify-names --share-subexpressions")
+        separate_arguments(flag_list UNIX_COMMAND "${flags}")
+        run_compiler("Compiling ${DEPTH} levels of ${kind} with '${flags}'"
+                --cost-report ${flag_list} -o ${WORK_DIR}/deep_${kind}.out ${input})
+    endforeach ()
+    run_compiler("Simulating ${DEPTH} levels of ${kind}" --simulate 1 ${input})
+    message(STATUS "${kind}: ok")
+endforeach ()
+
+nest(${SAMPLE_DEPTH} x)
+foreach (kind sum parentheses prefix ternary power)
+    set(input ${WORK_DIR}/sample_${kind}.des)
+    file(WRITE ${input} "num f(num x) = ${${kind}_value};\n")
+    run_compiler("Sampling ${SAMPLE_DEPTH} levels of ${kind}" --sample f --size 4x4 -o ${WORK_DIR}/sample_${kind}.csv ${input})
+    message(STATUS "${kind} sampled: ok")
+endforeach ()
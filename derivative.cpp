@@ -0,0 +1,725 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ast.h"
+#include "builtins.h"
+#include "visitor.h"
+
+using namespace AST;
+
+// Derivatives are built bottom up from those of the subexpressions, without recursing. A derivative of nullptr
+// stands for zero, so that whatever doesn't depend on the variable drops out of sums and products as they are
+// built. Definitions and functions that depend on the variable are differentiated through their values, with
+// calls' arguments substituted for the parameters. The derivative is simplified as it is built: constants are
+// combined, and additions of zero and multiplications by zero or one are left out. Once it is built, like terms
+// of each sum are collected (a + 2a is 3a) and the constant factors of each product multiplied together.
+namespace {
+
+    // The value of a literal or a negated literal
+    std::optional<double> number(const ExpressionNode* node) {
+        if (node->kind == NodeKind::LITERAL) {return ((const LiteralNode*) node)->value;}
+        if (node->kind == NodeKind::UNARY_OPERATOR && ((const UnaryOperatorNode*) node)->op == Operator::MINUS
+            && ((const UnaryOperatorNode*) node)->expr->kind == NodeKind::LITERAL) {
+            return -((const LiteralNode*) ((const UnaryOperatorNode*) node)->expr.get())->value;
+        }
+        return std::nullopt;
+    }
+
+    bool is_negation(const ExpressionNode* node) {
+        return node->kind == NodeKind::UNARY_OPERATOR && ((const UnaryOperatorNode*) node)->op == Operator::MINUS;
+    }
+
+    // Takes the operand out of a negation
+    unq_ptr<ExpressionNode> negated(unq_ptr<ExpressionNode> negation) {
+        return std::move(((UnaryOperatorNode*) negation.get())->expr);
+    }
+
+    unq_ptr<ExpressionNode> copy(const ExpressionNode* node) {
+        return node->substitute({});
+    }
+
+    bool is_operator(const ExpressionNode* node, Operator op) {
+        return node->kind == NodeKind::BINARY_OPERATOR && ((const BinaryOperatorNode*) node)->op == op;
+    }
+
+    // Sums and products of numbers, points and lists, which are simplified as a whole from their outermost node.
+    // Shared nodes are left as they are, since their other parents still hold them.
+    bool is_sum(const ExpressionNode* node) {
+        return node->owners == 1 && (is_operator(node, Operator::PLUS) || is_operator(node, Operator::MINUS))
+               && !node->type.element().matches_primitive(Type::BOOL);
+    }
+
+    bool is_product(const ExpressionNode* node) {
+        return node->owners == 1 && is_operator(node, Operator::MUL) && !node->type.element().matches_primitive(Type::BOOL);
+    }
+
+    // Hashes and compares expressions by their structure, for finding like terms
+    size_t hash_structure(const ExpressionNode* root) {
+        size_t hash = 0;
+        std::vector<const ExpressionNode*> stack = {root};
+        while (!stack.empty()) {
+            const ExpressionNode* node = stack.back();
+            stack.pop_back();
+            size_t value = (size_t) node->kind;
+            switch (node->kind) {
+                case NodeKind::LITERAL: value ^= std::hash<double>()(((const LiteralNode*) node)->value); break;
+                case NodeKind::IDENTIFIER: value ^= std::hash<const void*>()(((const IdentifierNode*) node)->declaration); break;
+                case NodeKind::BINARY_OPERATOR: value ^= (size_t) ((const BinaryOperatorNode*) node)->op << 8; break;
+                case NodeKind::UNARY_OPERATOR: value ^= (size_t) ((const UnaryOperatorNode*) node)->op << 8; break;
+                default: break;
+            }
+            hash = hash * 31 + value;
+            for_each_slot((ExpressionNode*) node, [&](unq_ptr<ExpressionNode>& child) {stack.push_back(child.get());});
+        }
+        return hash;
+    }
+
+    bool is_same(const ExpressionNode* a, const ExpressionNode* b) {
+        std::vector<std::pair<const ExpressionNode*, const ExpressionNode*>> stack = {{a, b}};
+        std::vector<ExpressionNode*> children;
+        while (!stack.empty()) {
+            auto [x, y] = stack.back();
+            stack.pop_back();
+            if (x->kind != y->kind) {return false;}
+            switch (x->kind) {
+                case NodeKind::LITERAL:
+                    if (((const LiteralNode*) x)->value != ((const LiteralNode*) y)->value) {return false;}
+                    break;
+                case NodeKind::IDENTIFIER:
+                    if (((const IdentifierNode*) x)->declaration != ((const IdentifierNode*) y)->declaration) {return false;}
+                    if (((const IdentifierNode*) x)->builtin != ((const IdentifierNode*) y)->builtin) {return false;}
+                    break;
+                case NodeKind::BINARY_OPERATOR:
+                    if (((const BinaryOperatorNode*) x)->op != ((const BinaryOperatorNode*) y)->op) {return false;}
+                    break;
+                case NodeKind::UNARY_OPERATOR:
+                    if (((const UnaryOperatorNode*) x)->op != ((const UnaryOperatorNode*) y)->op) {return false;}
+                    break;
+                case NodeKind::CALL: {
+                    auto f = (const IdentifierNode*) ((const CallNode*) x)->function.get();
+                    auto g = (const IdentifierNode*) ((const CallNode*) y)->function.get();
+                    if (f->declaration != g->declaration || f->builtin != g->builtin) {return false;}
+                    break;
+                }
+                case NodeKind::MEMBER_ACCESS:
+                    if (((const MemberAccessNode*) x)->member != ((const MemberAccessNode*) y)->member) {return false;}
+                    if (((const MemberAccessNode*) x)->memberDeclaration != ((const MemberAccessNode*) y)->memberDeclaration) {return false;}
+                    break;
+                case NodeKind::POINT:
+                case NodeKind::LIST:
+                case NodeKind::INDEX:
+                case NodeKind::TERNARY_OPERATOR:
+                    break;
+                default:
+                    return false;
+            }
+            children.clear();
+            for_each_slot((ExpressionNode*) x, [&](unq_ptr<ExpressionNode>& child) {children.push_back(child.get());});
+            size_t count = 0;
+            for_each_slot((ExpressionNode*) y, [&](unq_ptr<ExpressionNode>& child) {
+                if (count < children.size()) {stack.emplace_back(children[count], child.get());}
+                count++;
+            });
+            if (count != children.size()) {return false;}
+        }
+        return true;
+    }
+
+    class Differentiator {
+        Compiler* compiler;
+        std::vector<Error>& errors;
+        const DeclarationNode* variable;
+        SymbolScope* scope; // Where the names of builtins are resolved
+        SrcPos pos; // Of the derivative, for the nodes built for it
+        std::unordered_set<const DeclarationNode*> dependents; // Whatever changes with the variable
+        std::vector<unq_ptr<ExpressionNode>> inlined; // Bodies of called functions, with the arguments substituted in
+        std::vector<const DeclarationNode*> calls; // The functions whose inlined bodies are being differentiated
+
+        // Nodes are typed from their operands like any other node
+        template <class Node>
+        unq_ptr<ExpressionNode> typed(unq_ptr<Node> node) {
+            node->semantic_analysis(compiler, errors);
+            return node;
+        }
+
+        unq_ptr<ExpressionNode> literal(double value) {
+            // Negative numbers are negations, as in the source
+            if (value < 0) {return typed(std::make_unique<UnaryOperatorNode>(pos, Operator::MINUS, literal(-value)));}
+            return std::make_unique<LiteralNode>(pos, Type(Type::NUM, true), value + 0.0);
+        }
+
+        unq_ptr<ExpressionNode> binary(Operator op, unq_ptr<ExpressionNode> left, unq_ptr<ExpressionNode> right) {
+            return typed(std::make_unique<BinaryOperatorNode>(pos, op, std::move(left), std::move(right)));
+        }
+
+        unq_ptr<ExpressionNode> call(std::string_view name, unq_ptr<ExpressionNode> argument) {
+            auto function = std::make_unique<IdentifierNode>(pos, name, scope, nullptr);
+            function->builtin = builtins::find(name);
+            function->isExplicitBuiltin = true;
+            auto node = std::make_unique<CallNode>(pos, std::move(function));
+            node->arguments.push_back(std::move(argument));
+            return typed(std::move(node));
+        }
+
+        unq_ptr<ExpressionNode> negate(unq_ptr<ExpressionNode> a) {
+            if (!a) {return nullptr;}
+            if (auto x = number(a.get())) {return literal(-*x);}
+            if (is_negation(a.get())) {return negated(std::move(a));}
+            return typed(std::make_unique<UnaryOperatorNode>(pos, Operator::MINUS, std::move(a)));
+        }
+
+        unq_ptr<ExpressionNode> add(unq_ptr<ExpressionNode> a, unq_ptr<ExpressionNode> b) {
+            if (!a) {return b;}
+            if (!b) {return a;}
+            std::optional<double> x = number(a.get()), y = number(b.get());
+            if (x && y) {return literal(*x + *y);}
+            if (is_negation(b.get())) {return binary(Operator::MINUS, std::move(a), negated(std::move(b)));}
+            return binary(Operator::PLUS, std::move(a), std::move(b));
+        }
+
+        unq_ptr<ExpressionNode> subtract(unq_ptr<ExpressionNode> a, unq_ptr<ExpressionNode> b) {
+            if (!b) {return a;}
+            if (!a) {return negate(std::move(b));}
+            std::optional<double> x = number(a.get()), y = number(b.get());
+            if (x && y) {return literal(*x - *y);}
+            if (is_negation(b.get())) {return binary(Operator::PLUS, std::move(a), negated(std::move(b)));}
+            return binary(Operator::MINUS, std::move(a), std::move(b));
+        }
+
+        unq_ptr<ExpressionNode> multiply(unq_ptr<ExpressionNode> a, unq_ptr<ExpressionNode> b) {
+            if (!a || !b) {return nullptr;}
+            std::optional<double> x = number(a.get()), y = number(b.get());
+            if (x && y) {return literal(*x * *y);}
+            // Constant factors go first, and are combined
+            if (y) {
+                std::swap(a, b);
+                std::swap(x, y);
+            }
+            if (x) {
+                if (*x == 0) {return nullptr;}
+                if (*x == 1) {return b;}
+                if (*x == -1) {return negate(std::move(b));}
+                if (b->kind == NodeKind::BINARY_OPERATOR && ((BinaryOperatorNode*) b.get())->op == Operator::MUL) {
+                    auto product = (BinaryOperatorNode*) b.get();
+                    if (auto z = number(product->left.get())) {return multiply(literal(*x * *z), std::move(product->right));}
+                }
+            }
+            if (is_negation(a.get())) {return negate(multiply(negated(std::move(a)), std::move(b)));}
+            if (is_negation(b.get())) {return negate(multiply(std::move(a), negated(std::move(b))));}
+            return binary(Operator::MUL, std::move(a), std::move(b));
+        }
+
+        unq_ptr<ExpressionNode> divide(unq_ptr<ExpressionNode> a, unq_ptr<ExpressionNode> b) {
+            if (!a) {return nullptr;}
+            std::optional<double> x = number(a.get()), y = number(b.get());
+            if (y && *y == 1) {return a;}
+            if (x && y && *y != 0) {return literal(*x / *y);}
+            if (a->kind == NodeKind::IDENTIFIER && b->kind == NodeKind::IDENTIFIER
+                && ((const IdentifierNode*) a.get())->declaration == ((const IdentifierNode*) b.get())->declaration) {
+                return literal(1);
+            }
+            if (is_negation(a.get())) {return negate(divide(negated(std::move(a)), std::move(b)));}
+            return binary(Operator::DIV, std::move(a), std::move(b));
+        }
+
+        unq_ptr<ExpressionNode> power(unq_ptr<ExpressionNode> a, unq_ptr<ExpressionNode> b) {
+            std::optional<double> y = number(b.get());
+            if (y && *y == 1) {return a;}
+            if (y && *y == 0) {return literal(1);}
+            return binary(Operator::EXP, std::move(a), std::move(b));
+        }
+
+        // Collects the like terms of the sum in the slot, whose terms are already simplified. Each term is a constant
+        // factor (or 1) times the rest of the term, and terms with the same rest are added together.
+        void collect_terms(unq_ptr<ExpressionNode>& sum) {
+            struct Term {
+                double coefficient;
+                unq_ptr<ExpressionNode>* rest; // nullptr for the constant term
+            };
+            std::vector<Term> terms;
+            std::unordered_multimap<size_t, size_t> found; // Hashes of the rests of the terms, to their indices
+            std::vector<std::pair<unq_ptr<ExpressionNode>*, double>> stack = {{&sum, 1}};
+            while (!stack.empty()) {
+                auto [slot, sign] = stack.back();
+                stack.pop_back();
+                ExpressionNode* node = slot->get();
+                if (is_sum(node)) {
+                    auto binop = (BinaryOperatorNode*) node;
+                    stack.emplace_back(&binop->right, binop->op == Operator::MINUS ? -sign : sign);
+                    stack.emplace_back(&binop->left, sign);
+                    continue;
+                }
+                if (is_negation(node) && node->owners == 1) {
+                    stack.emplace_back(&((UnaryOperatorNode*) node)->expr, -sign);
+                    continue;
+                }
+
+                double coefficient = sign;
+                unq_ptr<ExpressionNode>* rest = slot;
+                if (auto x = number(node)) {
+                    coefficient *= *x;
+                    rest = nullptr;
+                } else if (is_product(node)) {
+                    // Products are simplified to their constant factor times the rest
+                    auto product = (BinaryOperatorNode*) node;
+                    if (auto x = number(product->left.get())) {
+                        coefficient *= *x;
+                        rest = &product->right;
+                    }
+                }
+
+                size_t hash = rest ? hash_structure(rest->get()) : 0;
+                auto [first, last] = found.equal_range(hash);
+                auto like = std::find_if(first, last, [&](const auto& entry) {
+                    unq_ptr<ExpressionNode>* other = terms[entry.second].rest;
+                    return rest && other ? is_same(rest->get(), other->get()) : rest == other;
+                });
+                if (like != last) {
+                    terms[like->second].coefficient += coefficient;
+                } else {
+                    found.emplace(hash, terms.size());
+                    terms.push_back({coefficient, rest});
+                }
+            }
+
+            // Terms that cancel out of a sum of points or lists leave it as it is, rather than as a number
+            bool isZero = std::all_of(terms.begin(), terms.end(), [](const Term& term) {return term.coefficient == 0;});
+            if (isZero && (sum->type.isList || !sum->type.matches_primitive(Type::NUM))) {return;}
+            unq_ptr<ExpressionNode> result;
+            for (auto& term : terms) {
+                if (term.coefficient == 0) {continue;}
+                result = add(std::move(result), term.rest ? multiply(literal(term.coefficient), std::move(*term.rest)) : literal(term.coefficient));
+            }
+            sum = result ? std::move(result) : literal(0);
+        }
+
+        // Multiplies together the constant factors of the product in the slot, whose factors are already simplified,
+        // and puts the result first
+        void collect_factors(unq_ptr<ExpressionNode>& product) {
+            double coefficient = 1;
+            std::vector<unq_ptr<ExpressionNode>*> factors;
+            std::vector<unq_ptr<ExpressionNode>*> stack = {&product};
+            while (!stack.empty()) {
+                unq_ptr<ExpressionNode>* slot = stack.back();
+                stack.pop_back();
+                ExpressionNode* node = slot->get();
+                if (is_product(node)) {
+                    stack.push_back(&((BinaryOperatorNode*) node)->right);
+                    stack.push_back(&((BinaryOperatorNode*) node)->left);
+                } else if (is_negation(node) && node->owners == 1) {
+                    coefficient = -coefficient;
+                    stack.push_back(&((UnaryOperatorNode*) node)->expr);
+                } else if (auto x = number(node)) {
+                    coefficient *= *x;
+                } else {
+                    factors.push_back(slot);
+                }
+            }
+
+            if (coefficient == 0 && !product->type.isList && product->type.matches_primitive(Type::NUM)) {
+                product = literal(0);
+                return;
+            }
+            unq_ptr<ExpressionNode> result;
+            for (auto factor : factors) {
+                result = result ? binary(Operator::MUL, std::move(result), std::move(*factor)) : std::move(*factor);
+            }
+            if (!result) {
+                product = literal(coefficient);
+            } else if (coefficient == 0) {
+                product = binary(Operator::MUL, literal(0), std::move(result));
+            } else {
+                product = multiply(literal(coefficient), std::move(result));
+            }
+        }
+
+        // Simplifies every sum and product in the derivative, innermost first. A sum or product is only taken apart
+        // from its outermost node, so each is walked once.
+        unq_ptr<ExpressionNode> simplify(unq_ptr<ExpressionNode> root) {
+            std::vector<std::pair<unq_ptr<ExpressionNode>*, bool>> stack = {{&root, false}}; // (slot, whether its operands are done)
+            while (!stack.empty()) {
+                auto [slot, isExpanded] = stack.back();
+                ExpressionNode* node = slot->get();
+                if (isExpanded) {
+                    stack.pop_back();
+                    if (is_sum(node)) {
+                        collect_terms(*slot);
+                    } else if (is_product(node)) {
+                        collect_factors(*slot);
+                    }
+                    continue;
+                }
+                if (node->owners > 1) {
+                    stack.pop_back();
+                    continue;
+                }
+                stack.back().second = true;
+
+                // The operands of a sum or product are what's left once the nodes that make it up are taken apart
+                bool isSum = is_sum(node), isProduct = is_product(node);
+                if (!isSum && !isProduct) {
+                    for_each_slot(node, [&](unq_ptr<ExpressionNode>& child) {stack.emplace_back(&child, false);});
+                    continue;
+                }
+                std::vector<unq_ptr<ExpressionNode>*> members = {slot};
+                while (!members.empty()) {
+                    unq_ptr<ExpressionNode>* member = members.back();
+                    members.pop_back();
+                    ExpressionNode* memberNode = member->get();
+                    if (member != slot && !(isSum ? is_sum(memberNode) : is_product(memberNode)) && !(is_negation(memberNode) && memberNode->owners == 1)) {
+                        stack.emplace_back(member, false);
+                        continue;
+                    }
+                    for_each_slot(memberNode, [&](unq_ptr<ExpressionNode>& child) {members.push_back(&child);});
+                }
+            }
+            return root;
+        }
+
+        // Zero of the same type as the node
+        unq_ptr<ExpressionNode> zero_like(const ExpressionNode* node) {
+            if (node->type.isList) {return binary(Operator::MUL, literal(0), copy(node));}
+            if (node->type.matches_primitive(Type::POINT) && !node->type.isUnknown) {
+                return typed(std::make_unique<PointNode>(pos, literal(0), literal(0)));
+            }
+            return literal(0);
+        }
+
+        unq_ptr<ExpressionNode> or_zero(unq_ptr<ExpressionNode> derivative, const ExpressionNode* node) {
+            return derivative ? std::move(derivative) : zero_like(node);
+        }
+
+        bool depends(const DeclarationNode* declaration) const {
+            return declaration == variable || dependents.contains(declaration);
+        }
+
+        // Whether anything in the expression changes with the variable
+        bool depends(ExpressionNode* root) const {
+            std::vector<ASTNode*> stack = {root};
+            while (!stack.empty()) {
+                ASTNode* node = stack.back();
+                stack.pop_back();
+                if (node->kind == NodeKind::IDENTIFIER && depends(((const IdentifierNode*) node)->declaration)) {return true;}
+                if (node->kind == NodeKind::MEMBER_ACCESS && depends(((const MemberAccessNode*) node)->memberDeclaration)) {return true;}
+                for_each_child(node, [&](ASTNode* child) {stack.push_back(child);});
+            }
+            return false;
+        }
+
+        void fail(SrcPos at, const std::string& what) {
+            errors.emplace_back(at, "Cannot differentiate " + what);
+        }
+
+        // A definition whose value can stand in for its name
+        static bool is_inlinable(const DeclarationNode* declaration) {
+            return declaration->value && !declaration->isFunction() && !declaration->parentStruct
+                   && declaration->value->kind != NodeKind::STRUCT_INITIALIZER;
+        }
+
+        // The subexpressions whose derivatives the node's derivative is built from
+        void find_operands(ExpressionNode* node, std::vector<ExpressionNode*>& operands) {
+            switch (node->kind) {
+                case NodeKind::IDENTIFIER: {
+                    auto declaration = ((IdentifierNode*) node)->declaration;
+                    if (declaration == variable || !dependents.contains(declaration)) {return;}
+                    if (!is_inlinable(declaration)) {
+                        fail(node->pos, "'" + std::string(declaration->identifier) + "'");
+                        return;
+                    }
+                    operands.push_back(declaration->value);
+                    return;
+                }
+                case NodeKind::POINT:
+                    operands.push_back(((PointNode*) node)->x.get());
+                    operands.push_back(((PointNode*) node)->y.get());
+                    return;
+                case NodeKind::LIST:
+                    for (auto& element : ((ListNode*) node)->elements) {operands.push_back(element.get());}
+                    return;
+                case NodeKind::INDEX:
+                    operands.push_back(((IndexNode*) node)->list.get());
+                    return;
+                case NodeKind::MEMBER_ACCESS: {
+                    auto access = (MemberAccessNode*) node;
+                    if (!access->memberDeclaration) {
+                        operands.push_back(access->object.get());
+                    } else if (depends(access->memberDeclaration)) {
+                        fail(node->pos, "struct member '" + std::string(access->member) + "'");
+                    }
+                    return;
+                }
+                case NodeKind::CALL:
+                    for (auto& argument : ((CallNode*) node)->arguments) {operands.push_back(argument.get());}
+                    return;
+                case NodeKind::BINARY_OPERATOR: {
+                    // Conditions are constant wherever they are defined
+                    auto binop = (BinaryOperatorNode*) node;
+                    if (binop->type.element().matches_primitive(Type::BOOL)) {return;}
+                    operands.push_back(binop->left.get());
+                    operands.push_back(binop->right.get());
+                    return;
+                }
+                case NodeKind::UNARY_OPERATOR:
+                    if (((UnaryOperatorNode*) node)->op != Operator::INVERT) {operands.push_back(((UnaryOperatorNode*) node)->expr.get());}
+                    return;
+                case NodeKind::TERNARY_OPERATOR: {
+                    auto ternary = (TernaryOperatorNode*) node;
+                    operands.push_back(ternary->ifTrue.get());
+                    if (ternary->ifFalse) {operands.push_back(ternary->ifFalse.get());}
+                    return;
+                }
+                case NodeKind::DERIVATIVE: {
+                    auto derivative = (DerivativeNode*) node;
+                    derivative->differentiate(compiler, errors);
+                    if (derivative->derivative) {operands.push_back(derivative->derivative.get());}
+                    return;
+                }
+                case NodeKind::COMPREHENSION:
+                    if (auto& unrolled = ((ComprehensionNode*) node)->unrolled) {
+                        operands.push_back(unrolled.get());
+                    } else if (depends(node)) {
+                        fail(node->pos, "a range");
+                    }
+                    return;
+                case NodeKind::SOLVE:
+                    // Only reached through a definition that depends on the variable
+                    fail(node->pos, "an equation");
+                    return;
+                default:
+                    return;
+            }
+        }
+
+        unq_ptr<ExpressionNode> differentiate_builtin(const CallNode* call, const builtins::Builtin* builtin, unq_ptr<ExpressionNode>* d) {
+            std::string_view name = builtin->name;
+            if (name == "mod") {
+                // Like the % operator
+                if (!d[1]) {return std::move(d[0]);}
+                auto quotient = divide(copy(call->arguments[0].get()), copy(call->arguments[1].get()));
+                return subtract(std::move(d[0]), multiply(std::move(d[1]), this->call("floor", std::move(quotient))));
+            }
+            for (size_t i = 0; i < call->arguments.size(); i++) {
+                if (d[i] && i > 0) {
+                    fail(call->pos, "'" + std::string(name) + "'");
+                    return nullptr;
+                }
+            }
+            if (builtin->parameterCount == 0 || !d[0]) {return nullptr;}
+
+            unq_ptr<ExpressionNode>& du = d[0];
+            auto u = [&]() {return copy(call->arguments[0].get());};
+            if (name == "sqrt") {return divide(std::move(du), multiply(literal(2), this->call("sqrt", u())));}
+            if (name == "sin") {return multiply(this->call("cos", u()), std::move(du));}
+            if (name == "cos") {return negate(multiply(this->call("sin", u()), std::move(du)));}
+            if (name == "tan") {return divide(std::move(du), power(this->call("cos", u()), literal(2)));}
+            if (name == "arcsin") {return divide(std::move(du), this->call("sqrt", subtract(literal(1), power(u(), literal(2)))));}
+            if (name == "arccos") {return negate(divide(std::move(du), this->call("sqrt", subtract(literal(1), power(u(), literal(2))))));}
+            if (name == "arctan") {return divide(std::move(du), add(literal(1), power(u(), literal(2))));}
+            if (name == "sinh") {return multiply(this->call("cosh", u()), std::move(du));}
+            if (name == "cosh") {return multiply(this->call("sinh", u()), std::move(du));}
+            if (name == "tanh") {return divide(std::move(du), power(this->call("cosh", u()), literal(2)));}
+            if (name == "ln") {return divide(std::move(du), u());}
+            if (name == "log") {return divide(std::move(du), multiply(u(), this->call("ln", literal(10))));}
+            if (name == "exp") {return multiply(this->call("exp", u()), std::move(du));}
+            // Steps, which are flat wherever they are continuous
+            if (name == "floor" || name == "ceil" || name == "round" || name == "sign" || name == "length") {return nullptr;}
+            // Sums of the elements
+            if (name == "total" || name == "mean") {return this->call(name, std::move(du));}
+            fail(call->pos, "'" + std::string(name) + "'");
+            return nullptr;
+        }
+
+        // The node's derivative from those of its operands (see find_operands)
+        unq_ptr<ExpressionNode> combine(ExpressionNode* node, unq_ptr<ExpressionNode>* d) {
+            switch (node->kind) {
+                case NodeKind::IDENTIFIER:
+                    if (((IdentifierNode*) node)->declaration == variable) {return literal(1);}
+                    return dependents.contains(((IdentifierNode*) node)->declaration) ? std::move(d[0]) : nullptr;
+                case NodeKind::POINT: {
+                    auto point = (PointNode*) node;
+                    if (!d[0] && !d[1]) {return nullptr;}
+                    return typed(std::make_unique<PointNode>(pos, or_zero(std::move(d[0]), point->x.get()), or_zero(std::move(d[1]), point->y.get())));
+                }
+                case NodeKind::LIST: {
+                    auto list = (ListNode*) node;
+                    bool isZero = true;
+                    for (size_t i = 0; i < list->elements.size(); i++) {isZero = isZero && !d[i];}
+                    if (isZero) {return nullptr;}
+                    auto result = std::make_unique<ListNode>(pos);
+                    for (size_t i = 0; i < list->elements.size(); i++) {
+                        result->elements.push_back(or_zero(std::move(d[i]), list->elements[i].get()));
+                    }
+                    return typed(std::move(result));
+                }
+                case NodeKind::INDEX:
+                    if (!d[0]) {return nullptr;}
+                    return typed(std::make_unique<IndexNode>(pos, std::move(d[0]), copy(((IndexNode*) node)->index.get())));
+                case NodeKind::MEMBER_ACCESS: {
+                    if (!d[0]) {return nullptr;}
+                    // A coordinate of a point written out is just that coordinate
+                    std::string_view member = ((MemberAccessNode*) node)->member;
+                    if (d[0]->kind == NodeKind::POINT) {
+                        auto point = (PointNode*) d[0].get();
+                        return std::move(member == "x" ? point->x : point->y);
+                    }
+                    return typed(std::make_unique<MemberAccessNode>(pos, std::move(d[0]), member));
+                }
+                case NodeKind::CALL: {
+                    auto call = (CallNode*) node;
+                    if (auto builtin = call->builtin()) {return differentiate_builtin(call, builtin, d);}
+                    return nullptr; // Calls of declared functions are inlined instead
+                }
+                case NodeKind::BINARY_OPERATOR: {
+                    auto binop = (BinaryOperatorNode*) node;
+                    if (binop->type.element().matches_primitive(Type::BOOL)) {return nullptr;}
+                    unq_ptr<ExpressionNode>& du = d[0];
+                    unq_ptr<ExpressionNode>& dv = d[1];
+                    auto u = [&]() {return copy(binop->left.get());};
+                    auto v = [&]() {return copy(binop->right.get());};
+                    switch (binop->op) {
+                        case Operator::PLUS:
+                            return add(std::move(du), std::move(dv));
+                        case Operator::MINUS:
+                            return subtract(std::move(du), std::move(dv));
+                        case Operator::MUL: {
+                            auto left = du ? multiply(std::move(du), v()) : nullptr;
+                            auto right = dv ? multiply(u(), std::move(dv)) : nullptr;
+                            return add(std::move(left), std::move(right));
+                        }
+                        case Operator::DIV: {
+                            if (!dv) {return divide(std::move(du), v());}
+                            auto left = du ? multiply(std::move(du), v()) : nullptr;
+                            return divide(subtract(std::move(left), multiply(u(), std::move(dv))), power(v(), literal(2)));
+                        }
+                        case Operator::EXP: {
+                            if (!du && !dv) {return nullptr;}
+                            if (!dv) {
+                                // Power rule
+                                return multiply(multiply(v(), power(u(), subtract(v(), literal(1)))), std::move(du));
+                            }
+                            if (!du) {return multiply(multiply(copy(binop), call("ln", u())), std::move(dv));}
+                            auto rate = add(multiply(std::move(dv), call("ln", u())), divide(multiply(v(), std::move(du)), u()));
+                            return multiply(copy(binop), std::move(rate));
+                        }
+                        case Operator::MOD: {
+                            if (!dv) {return std::move(du);}
+                            return subtract(std::move(du), multiply(std::move(dv), call("floor", divide(u(), v()))));
+                        }
+                        default:
+                            return nullptr;
+                    }
+                }
+                case NodeKind::UNARY_OPERATOR: {
+                    auto unop = (UnaryOperatorNode*) node;
+                    if (unop->op == Operator::MINUS) {return negate(std::move(d[0]));}
+                    if (unop->op == Operator::ABS && d[0]) {return multiply(call("sign", copy(unop->expr.get())), std::move(d[0]));}
+                    return nullptr;
+                }
+                case NodeKind::TERNARY_OPERATOR: {
+                    auto ternary = (TernaryOperatorNode*) node;
+                    bool hasElse = ternary->ifFalse != nullptr;
+                    if (!d[0] && (!hasElse || !d[1])) {return nullptr;}
+                    auto ifTrue = or_zero(std::move(d[0]), ternary->ifTrue.get());
+                    auto ifFalse = hasElse ? or_zero(std::move(d[1]), ternary->ifFalse.get()) : nullptr;
+                    return typed(std::make_unique<TernaryOperatorNode>(pos, copy(ternary->condition.get()), std::move(ifTrue), std::move(ifFalse)));
+                }
+                case NodeKind::COMPREHENSION:
+                    return ((ComprehensionNode*) node)->unrolled ? std::move(d[0]) : nullptr;
+                case NodeKind::DERIVATIVE:
+                    return ((DerivativeNode*) node)->derivative ? std::move(d[0]) : nullptr;
+                default:
+                    return nullptr;
+            }
+        }
+
+        // A call of a declared function that depends on the variable, as the function's body with the arguments
+        // in place of the parameters, or nullptr if it doesn't depend on the variable
+        ExpressionNode* inline_call(const CallNode* call, bool hasDerivative) {
+            auto function = (const FunctionDeclarationNode*) ((const IdentifierNode*) call->function.get())->declaration;
+            if (!function || !function->value || (!hasDerivative && !dependents.contains(function))) {return nullptr;}
+            if (std::find(calls.begin(), calls.end(), function) != calls.end()) {
+                fail(call->pos, "recursive function '" + std::string(function->identifier) + "'");
+                return nullptr;
+            }
+            Bindings bindings;
+            for (size_t i = 0; i < function->parameters.size() && i < call->arguments.size(); i++) {
+                bindings[function->parameters[i].get()] = call->arguments[i].get();
+            }
+            calls.push_back(function);
+            inlined.push_back(function->value->substitute(bindings));
+            return inlined.back().get();
+        }
+
+    public:
+        Differentiator(Compiler* compiler, std::vector<Error>& errors, const IdentifierNode* variable, SrcPos pos)
+            : compiler(compiler), errors(errors), variable(variable->declaration), scope(variable->scope), pos(pos), dependents(), inlined(), calls() {
+            auto found = compiler->dependencies.dependents(this->variable);
+            dependents.insert(found.begin(), found.end());
+        }
+
+        unq_ptr<ExpressionNode> run(ExpressionNode* root) {
+            // Stage 0 before the operands are pushed, 1 once their derivatives are done, and 2 once an inlined body's is
+            struct Frame {
+                ExpressionNode* node;
+                int stage;
+                size_t operandCount;
+            };
+            std::vector<Frame> stack = {{root, 0, 0}};
+            std::vector<unq_ptr<ExpressionNode>> values; // Derivatives of the operands done so far whose nodes aren't done yet
+            std::vector<ExpressionNode*> operands;
+            size_t errorCount = errors.size();
+            while (!stack.empty()) {
+                Frame& frame = stack.back();
+                ExpressionNode* node = frame.node;
+                if (frame.stage == 0) {
+                    operands.clear();
+                    find_operands(node, operands);
+                    frame.stage = 1;
+                    frame.operandCount = operands.size();
+                    // Pushed in reverse, so that they are done in order
+                    for (auto it = operands.rbegin(); it != operands.rend(); it++) {stack.push_back({*it, 0, 0});}
+                    continue;
+                }
+
+                unq_ptr<ExpressionNode>* d = values.data() + values.size() - frame.operandCount;
+                if (frame.stage == 1 && node->kind == NodeKind::CALL && !((CallNode*) node)->builtin()) {
+                    bool hasDerivative = false;
+                    for (size_t i = 0; i < frame.operandCount; i++) {hasDerivative = hasDerivative || d[i];}
+                    values.resize(values.size() - frame.operandCount);
+                    frame.operandCount = 0;
+                    if (ExpressionNode* body = inline_call((CallNode*) node, hasDerivative)) {
+                        frame.stage = 2;
+                        frame.operandCount = 1;
+                        stack.push_back({body, 0, 0});
+                        continue;
+                    }
+                    d = values.data() + values.size();
+                }
+
+                unq_ptr<ExpressionNode> result;
+                if (frame.stage == 2) {
+                    result = std::move(d[0]);
+                    calls.pop_back();
+                } else if (errors.size() == errorCount) {
+                    result = combine(node, d);
+                }
+                values.resize(values.size() - frame.operandCount);
+                values.push_back(std::move(result));
+                stack.pop_back();
+            }
+            return values.back() ? simplify(std::move(values.back())) : zero_like(root);
+        }
+    };
+}
+
+void DerivativeNode::differentiate(Compiler* compiler, std::vector<Error>& errors) {
+    auto identifier = (const IdentifierNode*) variable.get();
+    if (derivative || !identifier->declaration) {return;}
+    derivative = Differentiator(compiler, errors, identifier, pos).run(expr.get());
+}
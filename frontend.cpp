@@ -2,29 +2,54 @@
 // Created by Cooper Roalson on 7/10/24.
 //
 
-#include <cstdio>
 #include <iostream>
+#include <algorithm>
 
 #include "frontend.h"
 #include "ast.h"
 
 namespace frontend {
 
-    static void print_errors(std::vector<Error>& errors, std::string& source) {
-        std::cerr << errors.size() << " errors found during compilation:\n\n";
-        for (auto& error: errors) {
-            long begin = error.pos.i;
-            while (begin-1 >= 0 && source[begin] != '\n') {begin--;}
-            if (source[begin] == '\n') begin++;
-            long end = error.pos.i;
-            while (end+1 < source.size() && source[end] != '\n') {end++;}
-            if (source[end] == '\n') end--;
-
-            fprintf(stderr, "Error at line %lu, col %lu: %s\n", error.pos.line + 1, error.pos.col + 1, error.message.c_str());
-            std::cerr << "   " << std::string_view (source.data() + begin, end - begin + 1) << std::endl;
-            std::cerr << std::string(3 + error.pos.i - begin, ' ') << '^' << std::endl << std::endl;
+    SourceMap::SourceMap(std::string_view source) : lineStarts{0} {
+        for (uint32_t i = 0; i < source.size(); i++) {
+            if (source[i] == '\n') {lineStarts.push_back(i + 1);}
         }
-        exit(1);
+    }
+
+    SrcLocation SourceMap::locate(SrcPos pos) const {
+        size_t line = std::upper_bound(lineStarts.begin(), lineStarts.end(), pos.i) - lineStarts.begin() - 1;
+        return {line, pos.i - lineStarts[line]};
+    }
+
+    std::pair<size_t, size_t> SourceMap::line_bounds(size_t line, size_t sourceSize) const {
+        return {lineStarts[line], line + 1 < lineStarts.size() ? lineStarts[line + 1] - 1 : sourceSize};
+    }
+
+    void write_diagnostics(std::ostream& out, const std::vector<Error>& diagnostics, const std::string& source, bool isError) {
+        if (isError) {
+            out << diagnostics.size() << " errors found during compilation:\n\n";
+        } else {
+            out << diagnostics.size() << " warnings found during compilation:\n\n";
+        }
+        SourceMap lines(source);
+        for (auto& error: diagnostics) {
+            SrcLocation location = lines.locate(error.pos);
+            auto [begin, end] = lines.line_bounds(location.line, source.size());
+
+            // Long lines are cut down to the part around the error
+            constexpr size_t CONTEXT = 60;
+            begin = std::max(begin, error.pos.i > CONTEXT ? error.pos.i - CONTEXT : 0);
+            end = std::min(end, (size_t) error.pos.i + CONTEXT);
+
+            out << (isError ? "Error" : "Warning") << " at line " << location.line + 1 << ", col " << location.col + 1 << ": " << error.message << "\n";
+            out << "   " << std::string_view(source.data() + begin, end - begin) << std::endl;
+            out << std::string(3 + error.pos.i - begin, ' ') << '^' << std::endl << std::endl;
+        }
+    }
+
+    void print_diagnostics(const std::vector<Error>& diagnostics, const std::string& source, bool isError) {
+        write_diagnostics(std::cerr, diagnostics, source, isError);
+        if (isError) {exit(1);}
     }
 
 }
@@ -32,23 +57,24 @@ namespace frontend {
 using namespace frontend;
 bool Compiler::compile_frontend(std::string& source) {
     std::vector<Error> errors;
+    this->source = source;
 
-    std::vector<Token> tokens;
+    TokenStream tokens;
     lex(source, tokens, errors);
     if (!errors.empty()) {
-        print_errors(errors, source);
+        print_diagnostics(errors, source, true);
         return false;
     }
 
     parse(this, tokens, errors);
     if (!errors.empty()) {
-        print_errors(errors, source);
+        print_diagnostics(errors, source, true);
         return false;
     }
 
     semantic_analysis(this, errors);
     if (!errors.empty()) {
-        print_errors(errors, source);
+        print_diagnostics(errors, source, true);
         return false;
     }
 
@@ -7,6 +7,8 @@
 
 #include <vector>
 #include <string>
+#include <ostream>
+#include <cstdint>
 
 #include "compiler.h"
 
@@ -15,21 +17,36 @@ namespace AST {struct MainBlockNode;}
 
 namespace frontend {
 
+    // An offset into the source. Lines and columns are only needed for diagnostics, so SourceMap finds them on demand.
     struct SrcPos {
-        size_t i, line, col;
+        uint32_t i;
+    };
+
+    struct SrcLocation {
+        size_t line, col; // From 0
+    };
+
+    class SourceMap {
+        std::vector<uint32_t> lineStarts;
+
+    public:
+        explicit SourceMap(std::string_view source);
+        SrcLocation locate(SrcPos pos) const;
+        // The offsets of the first character and the end (excluding the newline) of a line
+        std::pair<size_t, size_t> line_bounds(size_t line, size_t sourceSize) const;
     };
 
     struct Token {
-        enum Type {
+        enum Type : uint8_t {
             FILE_END,
 
             NUM_LITERAL, BOOL_LITERAL, IDENTIFIER, PRIMITIVE,
 
-            KW_CONST, KW_ACTION, KW_STRUCT, KW_PLOT, KW_TICKER, KW_HIDDEN, KW_AUTO, KW_IF, KW_ELSE,
+            KW_CONST, KW_ACTION, KW_STRUCT, KW_PLOT, KW_TICKER, KW_HIDDEN, KW_AUTO, KW_IF, KW_ELSE, KW_IMPORT, KW_FOR, KW_IN,
 
             LEFT_PAREN, RIGHT_PAREN, LEFT_BRACE, RIGHT_BRACE, LEFT_BRACKET, RIGHT_BRACKET,
 
-            SEMICOLON, COMMA, DOLLAR, DOT, QUESTION, COLON,
+            SEMICOLON, COMMA, DOLLAR, DOT, ELLIPSIS, QUESTION, COLON,
 
             EQUALS, ASSIGN, PLUS_ASSIGN, MINUS_ASSIGN, MUL_ASSIGN, DIV_ASSIGN, MOD_ASSIGN,
             PLUS, MINUS, MUL, DIV, MOD, EXP, ABS, INVERT, AND, OR,
@@ -37,23 +54,30 @@ namespace frontend {
             LESS, GREATER, LESS_EQUAL, GREATER_EQUAL, EQUAL_EQUAL, NOT_EQUAL
         } type;
         SrcPos pos;
-        union {
-            double num;
-            size_t uint;
-            bool boolean;
-            std::string_view string;
-        } value;
-
-        static constexpr const char* NAMES[49] = {
+        // NUM_LITERAL and IDENTIFIER: an index into TokenStream::numbers or TokenStream::identifiers.
+        // BOOL_LITERAL: 0 or 1. PRIMITIVE: a Type::Primitive.
+        uint32_t payload;
+
+        static constexpr const char* NAMES[53] = {
                 "end of file", "number literal", "boolean literal", "identifier", "primitive",
-                "'const'", "'action'", "'struct'", "'plot'", "'ticker'", "'hidden'", "'auto'", "'if'", "'else'",
-                "'('", "')'", "'{'", "'}'", "'['", "']'", "';'", "','", "'$'", "'.'", "'?'", "':'",
+                "'const'", "'action'", "'struct'", "'plot'", "'ticker'", "'hidden'", "'auto'", "'if'", "'else'", "'import'", "'for'", "'in'",
+                "'('", "')'", "'{'", "'}'", "'['", "']'", "';'", "','", "'$'", "'.'", "'...'", "'?'", "':'",
                 "'='", "':='", "'+='", "'-='", "'*='", "'/='", "'%='",
                 "'+'", "'-'", "'*'", "'/'", "'%'", "'^'", "'|'", "'!'", "'&&'", "'||'",
                 "'<'", "'>'", "'<='", "'>='", "'=='", "'!='"
         };
         std::string name() const {return NAMES[type];}
     };
+    static_assert(sizeof(Token) <= 16);
+
+    struct TokenStream {
+        std::vector<Token> tokens;
+        std::vector<double> numbers;
+        std::vector<std::string_view> identifiers; // Slices of the source
+
+        double number(const Token& token) const {return numbers[token.payload];}
+        std::string_view identifier(const Token& token) const {return identifiers[token.payload];}
+    };
 
     struct Error {
         SrcPos pos;
@@ -62,9 +86,13 @@ namespace frontend {
         Error(SrcPos pos, std::string message) : pos(pos), message(std::move(message)) {}
     };
 
-    void lex(std::string& source, std::vector<Token>& tokens, std::vector<Error>& errors);
-    void parse(Compiler* compiler, const std::vector<Token>& tokens, std::vector<Error>& errors);
+    void lex(std::string& source, TokenStream& tokens, std::vector<Error>& errors);
+    void parse(Compiler* compiler, const TokenStream& tokens, std::vector<Error>& errors);
     void semantic_analysis(Compiler* compiler, std::vector<Error>& errors);
+
+    void write_diagnostics(std::ostream& out, const std::vector<Error>& diagnostics, const std::string& source, bool isError);
+    // Errors end compilation, warnings don't
+    void print_diagnostics(const std::vector<Error>& diagnostics, const std::string& source, bool isError);
 }
 
 
@@ -0,0 +1,37 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <sstream>
+
+#include "fuzz.h"
+#include "compiler.h"
+#include "frontend.h"
+#include "ast.h"
+
+namespace fuzz {
+    using namespace frontend;
+
+    size_t run_phase(Phase phase, std::string_view input) {
+        std::string source(input);
+        std::vector<Error> errors;
+
+        TokenStream tokens;
+        lex(source, tokens, errors);
+        if (errors.empty() && phase != Phase::LEX) {
+            Compiler compiler;
+            compiler.source = source;
+            parse(&compiler, tokens, errors);
+            if (errors.empty() && phase != Phase::PARSE) {
+                semantic_analysis(&compiler, errors);
+            }
+        }
+
+        if (phase == Phase::DIAGNOSTICS) {
+            // Formats the errors of whichever phase stopped
+            std::ostringstream out;
+            write_diagnostics(out, errors, source, true);
+        }
+        return errors.size();
+    }
+}
@@ -0,0 +1,23 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#ifndef DESMOS_COMPILER_FUZZ_H
+#define DESMOS_COMPILER_FUZZ_H
+
+#include <string_view>
+#include <cstddef>
+
+// Entry points that run the frontend on arbitrary bytes, for libFuzzer (fuzz_target.cpp) and the performance
+// driver (perf_driver.cpp). Unlike Compiler::compile_program, they never print or exit on errors.
+namespace fuzz {
+
+    // Each phase runs the ones before it first, stopping after the first that reports errors
+    enum class Phase {LEX, PARSE, ANALYZE, DIAGNOSTICS};
+    constexpr const char* PHASE_NAMES[4] = {"lex", "parse", "analyze", "diagnostics"};
+
+    // Returns the number of diagnostics
+    size_t run_phase(Phase phase, std::string_view input);
+}
+
+#endif //DESMOS_COMPILER_FUZZ_H
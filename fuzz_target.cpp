@@ -0,0 +1,17 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <cstdint>
+
+#include "fuzz.h"
+
+// One libFuzzer target per phase, chosen when building it (see CMakeLists.txt)
+#ifndef FUZZ_PHASE
+#define FUZZ_PHASE ANALYZE
+#endif
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzz::run_phase(fuzz::Phase::FUZZ_PHASE, std::string_view((const char*) data, size));
+    return 0;
+}
@@ -0,0 +1,248 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "compiler.h"
+#include "ast.h"
+#include "builtins.h"
+#include "visitor.h"
+
+using namespace AST;
+
+// Desmos recomputes a definition whenever anything it references changes, so a definition that mixes values
+// changed by sliders, actions or the ticker with ones that never change recomputes all of it on every change.
+// Each largest subexpression that only depends on unchanging values is moved into a definition of its own,
+// which Desmos keeps until one of its own inputs changes.
+namespace {
+
+    bool is_leaf(const ASTNode* node) {
+        return node->kind == NodeKind::LITERAL || node->kind == NodeKind::IDENTIFIER;
+    }
+
+    // Takes a subexpression out of its slot, copying it if other parents share it
+    unq_ptr<ExpressionNode> take(unq_ptr<ExpressionNode>& slot) {
+        if (slot->owners == 1) {return std::move(slot);}
+        unq_ptr<ExpressionNode> copy = slot->substitute({});
+        slot->owners--;
+        slot.release();
+        return copy;
+    }
+
+    class InvariantHoister {
+        Compiler* compiler;
+        std::unordered_set<const DeclarationNode*> changing; // Can change while the graph is running
+        std::unordered_set<const DeclarationNode*> recursive; // The function being split and whatever calls it back
+        // Literal-only subexpressions are left alone, since Desmos doesn't have to look anything up to evaluate them
+        enum Stability {CHANGING, LITERAL, STABLE};
+        std::unordered_map<const ASTNode*, Stability> stability; // Of each subexpression of the expression being split
+        std::unordered_map<std::string, HoistedDeclarationNode*> hoisted; // By LaTeX, so that repeats share a definition
+        std::vector<unq_ptr<StatementNode>> definitions; // Hoisted out of the statements since the last flush
+
+        // Sliders, and whatever actions and the ticker assign, along with everything that depends on them
+        void find_changing() {
+            std::vector<const DeclarationNode*> stack;
+            for (auto& statement : compiler->ast->statements) {
+                if (auto initialization = dynamic_cast<const InitializationStatementNode*>(statement.get())) {
+                    auto declaration = initialization->declaration.get();
+                    auto value = initialization->value.get();
+                    if (value->kind == NodeKind::UNARY_OPERATOR && ((const UnaryOperatorNode*) value)->op == Operator::MINUS) {
+                        value = ((const UnaryOperatorNode*) value)->expr.get();
+                    }
+                    // Desmos gives a definition of a plain number a slider
+                    if (!declaration->type.isConst && !declaration->isFunction() && value->kind == NodeKind::LITERAL) {
+                        stack.push_back(declaration);
+                    }
+                } else if (auto action = dynamic_cast<const ActionDefinitionNode*>(statement.get())) {
+                    for (auto& [variable, value] : action->declaration->assignments) {stack.push_back(variable);}
+                }
+            }
+            if (auto dispatch = compiler->ast->tickerSchedule.dispatch.get()) {
+                for (auto& [variable, value] : dispatch->assignments) {stack.push_back(variable);}
+            }
+
+            changing.insert(stack.begin(), stack.end());
+            while (!stack.empty()) {
+                const DeclarationNode* current = stack.back();
+                stack.pop_back();
+                for (auto dependent : compiler->dependencies.direct_dependents(current)) {
+                    if (changing.insert(dependent).second) {stack.push_back(dependent);}
+                }
+            }
+        }
+
+        // Parameters, imported declarations and struct fields and members are treated as changing, since their
+        // values aren't known here
+        bool is_unchanging(const DeclarationNode* declaration) const {
+            return declaration && declaration->value && !declaration->parentStruct && !changing.contains(declaration) && !recursive.contains(declaration);
+        }
+
+        Stability find_stability(ExpressionNode* node) {
+            switch (node->kind) {
+                case NodeKind::LITERAL:
+                    return LITERAL;
+                case NodeKind::IDENTIFIER: {
+                    auto identifier = (const IdentifierNode*) node;
+                    // The name of a builtin being called, which only changes the call's value if it's impure
+                    if (identifier->builtin) {return identifier->builtin->isPure ? LITERAL : CHANGING;}
+                    return is_unchanging(identifier->declaration) ? STABLE : CHANGING;
+                }
+                case NodeKind::MEMBER_ACCESS:
+                    // Point coordinates only
+                    if (((const MemberAccessNode*) node)->memberDeclaration) {return CHANGING;}
+                    return stability[((const MemberAccessNode*) node)->object.get()];
+                case NodeKind::STRUCT_INITIALIZER:
+                    return CHANGING;
+                default: {
+                    Stability result = LITERAL;
+                    for_each_child(node, [&](ASTNode* child) {
+                        Stability childStability = stability[child];
+                        if (result == CHANGING || childStability == CHANGING) {
+                            result = CHANGING;
+                        } else if (childStability == STABLE) {
+                            result = STABLE;
+                        }
+                    });
+                    return result;
+                }
+            }
+        }
+
+        // Finds the stability of every subexpression, children first, without recursing
+        void classify(ExpressionNode* root) {
+            std::vector<std::pair<ExpressionNode*, bool>> stack = {{root, false}}; // (node, whether its children are done)
+            while (!stack.empty()) {
+                auto [node, isExpanded] = stack.back();
+                if (isExpanded) {
+                    stack.pop_back();
+                    stability[node] = find_stability(node);
+                    continue;
+                }
+                if (stability.contains(node)) {
+                    // Shared, and already classified
+                    stack.pop_back();
+                    continue;
+                }
+                stack.back().second = true;
+                for_each_child(node, [&](ASTNode* child) {stack.emplace_back((ExpressionNode*) child, false);});
+            }
+        }
+
+        // Single values with at least two operators, or a call; anything smaller costs about as much to look up as
+        // to recompute
+        static bool is_worth_hoisting(ExpressionNode* node) {
+            if (node->type.isUnknown || !node->type.matches_primitive(Type::NUM)) {return false;}
+            switch (node->kind) {
+                case NodeKind::TERNARY_OPERATOR:
+                case NodeKind::CALL:
+                    return true;
+                case NodeKind::BINARY_OPERATOR:
+                case NodeKind::UNARY_OPERATOR:
+                case NodeKind::INDEX:
+                case NodeKind::MEMBER_ACCESS: {
+                    bool hasOperand = false;
+                    for_each_child(node, [&](ASTNode* child) {hasOperand = hasOperand || !is_leaf(child);});
+                    return hasOperand;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        void hoist(unq_ptr<ExpressionNode>& slot) {
+            std::stringstream latex;
+            slot->compile(latex);
+            auto [entry, isNew] = hoisted.try_emplace(latex.str(), nullptr);
+            if (isNew) {
+                auto declaration = std::make_unique<HoistedDeclarationNode>(slot->pos, slot->type, hoisted.size(), &compiler->symbolTable);
+                entry->second = declaration.get();
+                definitions.push_back(std::make_unique<InitializationStatementNode>(std::move(declaration), take(slot)));
+            } else {
+                take(slot).reset();
+            }
+
+            auto reference = std::make_unique<IdentifierNode>(entry->second->pos, entry->second->identifier, &compiler->symbolTable, nullptr);
+            reference->declaration = entry->second;
+            entry->second->uses++;
+            reference->type = entry->second->type;
+            slot = std::move(reference);
+        }
+
+        // Only expressions that change are split; the root of one that doesn't is already a definition.
+        // A definition can't depend on itself, so calls back into a function stay in its body.
+        void process(unq_ptr<ExpressionNode>& root, const DeclarationNode* owner = nullptr) {
+            stability.clear();
+            recursive.clear();
+            if (owner && owner->isFunction()) {
+                auto dependents = compiler->dependencies.dependents(owner);
+                recursive.insert(dependents.begin(), dependents.end());
+                recursive.insert(owner);
+            }
+            classify(root.get());
+            if (stability[root.get()] != CHANGING) {return;}
+
+            // Left to right, so that the definitions are numbered in the order they appear in
+            std::vector<unq_ptr<ExpressionNode>*> stack = {&root};
+            while (!stack.empty()) {
+                unq_ptr<ExpressionNode>& slot = *stack.back();
+                stack.pop_back();
+                if (&slot != &root && stability[slot.get()] == STABLE && is_worth_hoisting(slot.get())) {
+                    hoist(slot);
+                    continue;
+                }
+                size_t first = stack.size();
+                for_each_slot(slot.get(), [&](unq_ptr<ExpressionNode>& child) {stack.push_back(&child);});
+                std::reverse(stack.begin() + (long) first, stack.end());
+            }
+        }
+
+        // Emits the hoisted definitions before the statements they were taken from
+        void flush(std::vector<const StatementNode*>& order) {
+            for (auto& definition : definitions) {
+                order.push_back(definition.get());
+                compiler->ast->statements.push_back(std::move(definition));
+            }
+            definitions.clear();
+        }
+
+    public:
+        explicit InvariantHoister(Compiler* compiler) : compiler(compiler), changing(), recursive(), stability(), hoisted(), definitions() {}
+
+        void run() {
+            find_changing();
+
+            MainBlockNode& ast = *compiler->ast;
+            std::unordered_map<const StatementNode*, StatementNode*> statements;
+            for (auto& statement : ast.statements) {
+                statements[statement.get()] = statement.get();
+            }
+
+            std::vector<const StatementNode*> order;
+            for (auto emitted : ast.emissionOrder) {
+                StatementNode* statement = statements[emitted];
+                if (auto initialization = dynamic_cast<InitializationStatementNode*>(statement)) {
+                    if (initialization->value->kind != NodeKind::STRUCT_INITIALIZER) {
+                        process(initialization->value, initialization->declaration.get());
+                    }
+                } else if (auto action = dynamic_cast<ActionDefinitionNode*>(statement)) {
+                    for (auto& [variable, value] : action->declaration->assignments) {process(value);}
+                }
+                flush(order);
+                order.push_back(emitted);
+            }
+            if (auto dispatch = ast.tickerSchedule.dispatch.get()) {
+                for (auto& [variable, value] : dispatch->assignments) {process(value);}
+                flush(order);
+            }
+            ast.emissionOrder = std::move(order);
+        }
+    };
+}
+
+void Compiler::hoist_invariants() {
+    InvariantHoister(this).run();
+}
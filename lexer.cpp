@@ -2,239 +2,156 @@
 // Created by Cooper Roalson on 7/12/24.
 //
 
+#include <cstdlib>
+
 #include "frontend.h"
 #include "compiler.h"
 
 namespace frontend {
 
+    // The <cctype> functions are undefined for negative chars, which bytes over 127 are on most platforms
+    static bool is_digit(char c) {return isdigit((unsigned char) c);}
+    static bool is_alpha(char c) {return isalpha((unsigned char) c);}
+
     static double read_num_literal(std::string& source, size_t start, int& len) {
-        double result = 0;
         size_t i = start;
-        while (i < source.size() && isdigit(source[i])) {
-            result = result * 10 + (source[i] - '0');
-            i++;
-        }
-        if (source[i] == '.') {
+        while (i < source.size() && is_digit(source[i])) {i++;}
+        // Not the start of a '...'
+        if (i < source.size() && source[i] == '.' && (i + 1 == source.size() || source[i + 1] != '.')) {
             i++;
-            double factor = 0.1;
-            while (i < source.size() && isdigit(source[i])) {
-                result += (source[i] - '0') * factor;
-                factor *= 0.1;
-                i++;
-            }
+            while (i < source.size() && is_digit(source[i])) {i++;}
         }
         len = i - start;
-        return result;
+        // Converted by the C library, which rounds to the nearest double (summing digits would round at each one)
+        return std::strtod(source.substr(start, len).c_str(), nullptr);
     }
 
-    void lex(std::string& source, std::vector<Token>& tokens, std::vector<Error>& errors) {
-        SrcPos pos = {0, 0, (size_t) -1};
-        for (pos.i = 0; pos.i < source.size(); pos.i++) {
-            char c = source[pos.i];
-            char c2 = (pos.i + 1 == source.size()) ? (char) 0 : source[pos.i + 1];
+    static constexpr struct {
+        std::string_view text;
+        Token::Type type;
+        uint32_t payload;
+    } KEYWORDS[] = {
+            {"const", Token::KW_CONST, 0}, {"action", Token::KW_ACTION, 0}, {"struct", Token::KW_STRUCT, 0},
+            {"plot", Token::KW_PLOT, 0}, {"ticker", Token::KW_TICKER, 0}, {"hidden", Token::KW_HIDDEN, 0},
+            {"auto", Token::KW_AUTO, 0}, {"if", Token::KW_IF, 0}, {"else", Token::KW_ELSE, 0}, {"import", Token::KW_IMPORT, 0},
+            {"for", Token::KW_FOR, 0}, {"in", Token::KW_IN, 0},
+            {"true", Token::BOOL_LITERAL, 1}, {"false", Token::BOOL_LITERAL, 0},
+            {"num", Token::PRIMITIVE, Type::NUM}, {"point", Token::PRIMITIVE, Type::POINT}, {"bool", Token::PRIMITIVE, Type::BOOL},
+            {"color", Token::PRIMITIVE, Type::COLOR}, {"polygon", Token::PRIMITIVE, Type::POLYGON}
+    };
 
-            if (c == '/' && c2 == '/') {
-                while (source[++pos.i] != '\n') {}
-                c = source[pos.i];
+    // The token for a two-character operator starting with c, or FILE_END if c and c2 don't form one
+    static Token::Type two_character_operator(char c, char c2) {
+        if (c2 == '=') {
+            switch (c) {
+                case ':': return Token::ASSIGN;
+                case '+': return Token::PLUS_ASSIGN;
+                case '-': return Token::MINUS_ASSIGN;
+                case '*': return Token::MUL_ASSIGN;
+                case '/': return Token::DIV_ASSIGN;
+                case '%': return Token::MOD_ASSIGN;
+                case '<': return Token::LESS_EQUAL;
+                case '>': return Token::GREATER_EQUAL;
+                case '=': return Token::EQUAL_EQUAL;
+                case '!': return Token::NOT_EQUAL;
+                default: return Token::FILE_END;
             }
+        }
+        if (c == '&' && c2 == '&') {return Token::AND;}
+        if (c == '|' && c2 == '|') {return Token::OR;}
+        return Token::FILE_END;
+    }
+
+    static Token::Type one_character_operator(char c) {
+        switch (c) {
+            case '(': return Token::LEFT_PAREN;
+            case ')': return Token::RIGHT_PAREN;
+            case '{': return Token::LEFT_BRACE;
+            case '}': return Token::RIGHT_BRACE;
+            case '[': return Token::LEFT_BRACKET;
+            case ']': return Token::RIGHT_BRACKET;
+            case ';': return Token::SEMICOLON;
+            case ',': return Token::COMMA;
+            case '$': return Token::DOLLAR;
+            case '.': return Token::DOT;
+            case '?': return Token::QUESTION;
+            case ':': return Token::COLON;
+            case '=': return Token::EQUALS;
+            case '+': return Token::PLUS;
+            case '-': return Token::MINUS;
+            case '*': return Token::MUL;
+            case '/': return Token::DIV;
+            case '%': return Token::MOD;
+            case '^': return Token::EXP;
+            case '|': return Token::ABS;
+            case '!': return Token::INVERT;
+            case '<': return Token::LESS;
+            case '>': return Token::GREATER;
+            default: return Token::FILE_END;
+        }
+    }
 
-            pos.col++;
-            if (c == '\n') {
-                pos.line++;
-                pos.col = -1;
+    void lex(std::string& source, TokenStream& stream, std::vector<Error>& errors) {
+        std::vector<Token>& tokens = stream.tokens;
+        if (source.size() >= UINT32_MAX) {
+            errors.push_back({{0}, "Source is too large to compile"});
+            return;
+        }
+        auto size = (uint32_t) source.size();
+        tokens.reserve(size / 4);
+
+        for (uint32_t i = 0; i < size; i++) {
+            char c = source[i];
+            char c2 = (i + 1 == size) ? (char) 0 : source[i + 1];
+
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
                 continue;
             }
 
-            if (c == ' ' || c == '\t') {
+            if (c == '/' && c2 == '/') {
+                while (i + 1 < size && source[i + 1] != '\n') {i++;}
                 continue;
             }
 
-            SrcPos start = pos;
+            SrcPos start = {i};
+            if (c == '.' && c2 == '.' && i + 2 < size && source[i + 2] == '.') {
+                tokens.push_back({Token::ELLIPSIS, start, 0});
+                i += 2;
+            } else if (Token::Type type = two_character_operator(c, c2); type != Token::FILE_END) {
+                tokens.push_back({type, start, 0});
+                i++;
+            } else if (Token::Type type = one_character_operator(c); type != Token::FILE_END) {
+                tokens.push_back({type, start, 0});
+            } else if (is_digit(c)) {
+                int len;
+                double num = read_num_literal(source, i, len);
+                tokens.push_back({Token::NUM_LITERAL, start, (uint32_t) stream.numbers.size()});
+                stream.numbers.push_back(num);
+                i += len - 1;
+                if (i + 1 < size && is_alpha(source[i + 1])) {
+                    errors.push_back({{i + 1}, "Unexpected characters after number literal"});
+                    while (i + 1 < size && is_alpha(source[i + 1])) {i++;}
+                }
+            } else if (is_alpha(c)) {
+                while (i + 1 < size && (is_alpha(source[i + 1]) || is_digit(source[i + 1]))) {i++;}
+                std::string_view word(source.data() + start.i, i + 1 - start.i);
 
-            if (c == '(') {
-                tokens.push_back({Token::LEFT_PAREN, start});
-            } else if (c == ')') {
-                tokens.push_back({Token::RIGHT_PAREN, start});
-            } else if (c == '{') {
-                tokens.push_back({Token::LEFT_BRACE, start});
-            } else if (c == '}') {
-                tokens.push_back({Token::RIGHT_BRACE, start});
-            } else if (c == '[') {
-                tokens.push_back({Token::LEFT_BRACKET, start});
-            } else if (c == ']') {
-                tokens.push_back({Token::RIGHT_BRACKET, start});
-            } else if (c == ';') {
-                tokens.push_back({Token::SEMICOLON, start});
-            } else if (c == ',') {
-                tokens.push_back({Token::COMMA, start});
-            } else if (c == '$') {
-                tokens.push_back({Token::DOLLAR, start});
-            } else if (c == '.') {
-                tokens.push_back({Token::DOT, start});
-            } else if (c == '=' && c2 != '=') {
-                tokens.push_back({Token::EQUALS, start});
-            } else if (c == ':' && c2 == '=') {
-                tokens.push_back({Token::ASSIGN, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '+' && c2 == '=') {
-                tokens.push_back({Token::PLUS_ASSIGN, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '-' && c2 == '=') {
-                tokens.push_back({Token::MINUS_ASSIGN, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '*' && c2 == '=') {
-                tokens.push_back({Token::MUL_ASSIGN, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '/' && c2 == '=') {
-                tokens.push_back({Token::DIV_ASSIGN, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '%' && c2 == '=') {
-                tokens.push_back({Token::MOD_ASSIGN, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '+') {
-                tokens.push_back({Token::PLUS, start});
-            } else if (c == '-') {
-                tokens.push_back({Token::MINUS, start});
-            } else if (c == '*') {
-                tokens.push_back({Token::MUL, start});
-            } else if (c == '/') {
-                tokens.push_back({Token::DIV, start});
-            } else if (c == '%') {
-                tokens.push_back({Token::MOD, start});
-            } else if (c == '^') {
-                tokens.push_back({Token::EXP, start});
-            } else if (c == '&' && c2 == '&') {
-                tokens.push_back({Token::AND, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '|' && c2 == '|') {
-                tokens.push_back({Token::OR, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '?') {
-                tokens.push_back({Token::QUESTION, start});
-            } else if (c == ':') {
-                tokens.push_back({Token::COLON, start});
-            } else if (c == '|' && c2 != '|') {
-                tokens.push_back({Token::ABS, start});
-            } else if (c == '!' && c2 != '=') {
-                tokens.push_back({Token::INVERT, start});
-            } else if (c == '<' && c2 != '=') {
-                tokens.push_back({Token::LESS, start});
-            } else if (c == '>' && c2 != '=') {
-                tokens.push_back({Token::GREATER, start});
-            } else if (c == '<' && c2 == '=') {
-                tokens.push_back({Token::LESS_EQUAL, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '>' && c2 == '=') {
-                tokens.push_back({Token::GREATER_EQUAL, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '=' && c2 == '=') {
-                tokens.push_back({Token::EQUAL_EQUAL, start});
-                pos.i++;
-                pos.col++;
-            } else if (c == '!' && c2 == '=') {
-                tokens.push_back({Token::NOT_EQUAL, start});
-                pos.i++;
-                pos.col++;
-            } else if (pos.i + 4 < source.size() && std::string_view{source.data() + pos.i, 5} == "const") {
-                tokens.push_back({Token::KW_CONST, start});
-                pos.i += 4;
-                pos.col += 4;
-            } else if (pos.i + 5 < source.size() && std::string_view{source.data() + pos.i, 6} == "action") {
-                tokens.push_back({Token::KW_ACTION, start});
-                pos.i += 5;
-                pos.col += 5;
-            } else if (pos.i + 5 < source.size() && std::string_view{source.data() + pos.i, 6} == "struct") {
-                tokens.push_back({Token::KW_STRUCT, start});
-                pos.i += 5;
-                pos.col += 5;
-            } else if (pos.i + 3 < source.size() && std::string_view{source.data() + pos.i, 4} == "plot") {
-                tokens.push_back({Token::KW_PLOT, start});
-                pos.i += 3;
-                pos.col += 3;
-            } else if (pos.i + 5 < source.size() && std::string_view{source.data() + pos.i, 6} == "ticker") {
-                tokens.push_back({Token::KW_TICKER, start});
-                pos.i += 5;
-                pos.col += 5;
-            } else if (pos.i + 5 < source.size() && std::string_view{source.data() + pos.i, 6} == "hidden") {
-                tokens.push_back({Token::KW_HIDDEN, start});
-                pos.i += 5;
-                pos.col += 5;
-            } else if (pos.i + 3 < source.size() && std::string_view{source.data() + pos.i, 4} == "auto") {
-                tokens.push_back({Token::KW_AUTO, start});
-                pos.i += 3;
-                pos.col += 3;
-            } else if (pos.i + 1 < source.size() && std::string_view{source.data() + pos.i, 2} == "if") {
-                tokens.push_back({Token::KW_IF, start});
-                pos.i += 1;
-                pos.col += 1;
-            } else if (pos.i + 3 < source.size() && std::string_view{source.data() + pos.i, 4} == "else") {
-                tokens.push_back({Token::KW_ELSE, start});
-                pos.i += 3;
-                pos.col += 3;
-            } else if (pos.i + 3 < source.size() && std::string_view{source.data() + pos.i, 4} == "true") {
-                tokens.push_back({Token::BOOL_LITERAL, start, .value.boolean = true});
-                pos.i += 3;
-                pos.col += 3;
-            } else if (pos.i + 4 < source.size() && std::string_view{source.data() + pos.i, 5} == "false") {
-                tokens.push_back({Token::BOOL_LITERAL, start, .value.boolean = false});
-                pos.i += 4;
-                pos.col += 4;
-            } else {
-                bool found = false;
-                for (size_t i = 0; i < sizeof(Type::PRIMITIVE_STRS) / sizeof(Type::PRIMITIVE_STRS[0]); i++) {
-                    auto& primitive = Type::PRIMITIVE_STRS[i];
-                    auto len = strlen(primitive);
-                    if (pos.i + (len - 1) >= source.size()) continue;
-                    std::string_view slice(source.data() + pos.i, len);
-                    if (slice == primitive) {
-                        tokens.push_back({Token::PRIMITIVE, start, .value.uint = i});
-                        pos.i += len - 1;
-                        pos.col += len - 1;
-                        found = true;
+                bool isKeyword = false;
+                for (auto& keyword : KEYWORDS) {
+                    if (word == keyword.text) {
+                        tokens.push_back({keyword.type, start, keyword.payload});
+                        isKeyword = true;
                         break;
                     }
                 }
-                if (found) continue;
-
-                if (isdigit(c)) {
-                    int len;
-                    double num = read_num_literal(source, pos.i, len);
-                    tokens.push_back({Token::NUM_LITERAL, start, .value.num = num});
-                    pos.i += len - 1;
-                    pos.col += len - 1;
-                    bool f = false;
-                    while (pos.i + 1 < source.size() && isalpha(source[pos.i + 1])) {
-                        pos.i++;
-                        pos.col++;
-                        if (!f) {
-                            f = true;
-                            errors.push_back({pos, "Unexpected characters after number literal"});
-                        }
-                    }
-                } else if (isalpha(c)) {
-                    while (isalnum(c)) {
-                        c = source[++pos.i];
-                    }
-                    std::string_view slice(source.data() + start.i, pos.i - start.i);
-                    tokens.push_back({Token::IDENTIFIER, start, .value.string = slice});
-                    pos.i--;
-                    pos.col += pos.i - start.i;
-                } else {
-                    errors.push_back({pos, "Unexpected character '" + std::string(1, c) + "'"});
+                if (!isKeyword) {
+                    tokens.push_back({Token::IDENTIFIER, start, (uint32_t) stream.identifiers.size()});
+                    stream.identifiers.push_back(word);
                 }
+            } else {
+                errors.push_back({start, "Unexpected character '" + std::string(1, c) + "'"});
             }
         }
-        pos.col++;
-        tokens.push_back({Token::FILE_END, pos});
+        tokens.push_back({Token::FILE_END, {size}, 0});
     }
 }
@@ -1,13 +1,117 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstdio>
+#include <filesystem>
 
 #include "compiler.h"
+#include "sampler.h"
+#include "module.h"
 
-int main() {
-    std::ifstream inFile("test.des", std::ios_base::in);
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [input.des] [-o output] [--simulate ticks]\n"
+              << "       " << program << " module.des --module [-o module.desm]\n"
+              << "       " << program << " [input.des] [-o output] [-I module-directory] [--cost-report] [--cost-budget bytes=N,ops=N,depth=N,calls=N,cost=N] [--cost-budget-errors] [--share-subexpressions] [--hoist-invariants] [--narrow-ranges] [--minify-names] [--name-map path] [--prelude prelude.des]\n"
+              << "       " << program << " [input.des] --sample function [--range xmin:xmax[:ymin:ymax]] [--size WxH] [-o output.ppm|output.csv]" << std::endl;
+}
+
+// bytes=N,ops=N,depth=N,calls=N,cost=N, in any order and with any omitted
+static bool parse_budget(std::string_view spec, CostBudget& budget) {
+    while (!spec.empty()) {
+        size_t comma = spec.find(',');
+        std::string entry(spec.substr(0, comma));
+        spec = comma == std::string_view::npos ? "" : spec.substr(comma + 1);
+
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos) {return false;}
+        std::string key = entry.substr(0, equals);
+        char* end;
+        double limit = std::strtod(entry.c_str() + equals + 1, &end);
+        if (*end != '\0' || end == entry.c_str() + equals + 1 || limit < 0) {return false;}
+
+        if (key == "bytes") {budget.bytes = (size_t) limit;}
+        else if (key == "ops") {budget.operators = (size_t) limit;}
+        else if (key == "depth") {budget.depth = (size_t) limit;}
+        else if (key == "calls") {budget.calls = (size_t) limit;}
+        else if (key == "cost") {budget.cost = limit;}
+        else {return false;}
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string inPath = "test.des";
+    std::string outPath;
+    std::string nameMapPath;
+    std::string preludePath;
+    long simulateTicks = -1;
+    sampler::Options sampleOptions;
+    CompileOptions compileOptions;
+    bool compileModule = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (arg == "--simulate" && i + 1 < argc) {
+            char* end;
+            simulateTicks = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || simulateTicks < 0) {
+                std::cerr << "Error: Invalid number of ticks: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--sample" && i + 1 < argc) {
+            sampleOptions.function = argv[++i];
+        } else if (arg == "--range" && i + 1 < argc) {
+            sampler::Options& o = sampleOptions;
+            int count = sscanf(argv[++i], "%lf:%lf:%lf:%lf", &o.xMin, &o.xMax, &o.yMin, &o.yMax);
+            if ((count != 2 && count != 4) || !(o.xMin < o.xMax) || !(o.yMin < o.yMax)) {
+                std::cerr << "Error: Invalid range: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--size" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%zux%zu", &sampleOptions.width, &sampleOptions.height) != 2
+                || sampleOptions.width == 0 || sampleOptions.height == 0) {
+                std::cerr << "Error: Invalid size: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "-I" && i + 1 < argc) {
+            compileOptions.moduleDirectories.emplace_back(argv[++i]);
+        } else if (arg == "--module") {
+            compileModule = true;
+        } else if (arg == "--cost-report") {
+            compileOptions.costReport = &std::cout;
+        } else if (arg == "--cost-budget" && i + 1 < argc) {
+            if (!parse_budget(argv[++i], compileOptions.budget)) {
+                std::cerr << "Error: Invalid cost budget: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--cost-budget-errors") {
+            compileOptions.budget.isError = true;
+        } else if (arg == "--share-subexpressions") {
+            compileOptions.shareSubexpressions = true;
+        } else if (arg == "--hoist-invariants") {
+            compileOptions.hoistInvariants = true;
+        } else if (arg == "--narrow-ranges") {
+            compileOptions.narrowRanges = true;
+        } else if (arg == "--minify-names") {
+            compileOptions.minifyNames = true;
+        } else if (arg == "--name-map" && i + 1 < argc) {
+            compileOptions.minifyNames = true;
+            nameMapPath = argv[++i];
+        } else if (arg == "--prelude" && i + 1 < argc) {
+            preludePath = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            inPath = arg;
+        }
+    }
+
+    std::ifstream inFile(inPath, std::ios_base::in);
     if (!inFile.is_open()) {
-        std::cerr << "Error: Could not open inFile" << std::endl;
+        std::cerr << "Error: Could not open " << inPath << std::endl;
         return 1;
     }
 
@@ -15,17 +119,68 @@ int main() {
     buffer << inFile.rdbuf();
     std::string source = buffer.str();
 
+    if (simulateTicks >= 0) {
+        return Compiler::simulate_program(source, simulateTicks, std::cout) ? 0 : 1;
+    }
+
+    if (!sampleOptions.function.empty()) {
+        if (outPath.empty()) {outPath = sampleOptions.function + ".ppm";}
+        sampleOptions.csv = outPath.ends_with(".csv");
+        std::ofstream outFile(outPath, std::ios_base::out | std::ios_base::binary);
+        if (!Compiler::sample_program(source, sampleOptions, outFile)) {return 1;}
+        std::cout << "Successfully wrote samples to " << outPath << std::endl;
+        return 0;
+    }
+
+    if (compileModule) {
+        if (outPath.empty()) {outPath = std::filesystem::path(inPath).replace_extension(".desm").string();}
+        std::stringstream result;
+        if (!Compiler::compile_module(source, result)) {return 1;}
+        std::ofstream outFile(outPath, std::ios_base::out | std::ios_base::binary);
+        outFile << result.str();
+        std::cout << "Successfully wrote module to " << outPath << std::endl;
+        return 0;
+    }
+
+    if (outPath.empty()) {outPath = "test.out";}
+
+    if (!preludePath.empty()) {
+        std::ifstream preludeFile(preludePath, std::ios_base::in);
+        if (!preludeFile.is_open()) {
+            std::cerr << "Error: Could not open " << preludePath << std::endl;
+            return 1;
+        }
+        std::stringstream preludeBuffer;
+        preludeBuffer << preludeFile.rdbuf();
+        std::string preludeSource = preludeBuffer.str();
+        compileOptions.prelude = modules::SharedModule::build("prelude", preludeSource);
+        if (!compileOptions.prelude) {return 1;}
+    }
+
+    std::ofstream nameMapFile;
+    if (!nameMapPath.empty()) {
+        nameMapFile.open(nameMapPath, std::ios_base::out);
+        if (!nameMapFile.is_open()) {
+            std::cerr << "Error: Could not open " << nameMapPath << std::endl;
+            return 1;
+        }
+        compileOptions.nameMap = &nameMapFile;
+    }
+
     std::stringstream result;
-    if (Compiler::compile_program(source, result)) {
-        std::ofstream outFile("test.out", std::ios_base::out);
+    if (Compiler::compile_program(source, result, compileOptions)) {
+        std::ofstream outFile(outPath, std::ios_base::out);
         outFile << result.str();
         outFile.close();
-        std::cout << "Successfully wrote output to test.out" << std::endl;
+        std::cout << "Successfully wrote output to " << outPath << std::endl;
     }
 
     // For testing:
     std::cout << "Compiling to cout:" << std::endl;
-    Compiler::compile_program(source, std::cout);
+    CompileOptions testOptions;
+    testOptions.moduleDirectories = compileOptions.moduleDirectories;
+    testOptions.prelude = compileOptions.prelude;
+    Compiler::compile_program(source, std::cout, testOptions);
 
     return 0;
 }
@@ -0,0 +1,107 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <ostream>
+#include <string>
+#include <algorithm>
+#include <unordered_set>
+
+#include "compiler.h"
+#include "frontend.h"
+#include "ast.h"
+
+using namespace AST;
+
+// Every name the program emits is replaced by the shortest Desmos name left, with the most referenced
+// declarations getting the shortest ones. Desmos names are a single letter with an optional subscript.
+// Single letters are used first, then lowercase letters with numbered subscripts. Those never clash with the
+// names imported modules emit, which all have an uppercase letter and a subscript.
+namespace {
+
+    // Desmos gives these a meaning of their own (e for Euler's number, x, y, r and t for plotting, d for
+    // derivatives, i for the imaginary unit)
+    constexpr std::string_view LOWERCASE = "abcfghjklmnopqsuvwz";
+    constexpr std::string_view UPPERCASE = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    std::string short_name(size_t index) {
+        if (index < LOWERCASE.size()) {return std::string(1, LOWERCASE[index]);}
+        index -= LOWERCASE.size();
+        if (index < UPPERCASE.size()) {return std::string(1, UPPERCASE[index]);}
+        index -= UPPERCASE.size();
+        return std::string(1, LOWERCASE[index % LOWERCASE.size()]) + "_{" + std::to_string(index / LOWERCASE.size()) + "}";
+    }
+
+    // What the declaration is called in the source, qualified by the struct or function it belongs to
+    std::string source_name(const DeclarationNode* declaration, const DeclarationNode* owner) {
+        std::string name;
+        if (declaration->parentStruct) {
+            name = std::string(declaration->parentStruct->identifier) + ".";
+        } else if (owner) {
+            name = std::string(owner->identifier) + ".";
+        }
+        return name + std::string(declaration->identifier);
+    }
+
+    struct Renamed {
+        DeclarationNode* declaration;
+        const DeclarationNode* owner; // The function or action a parameter belongs to, or the definition of a comprehension variable
+    };
+
+    // Everything the program itself emits a name for, in emission order
+    std::vector<Renamed> find_emitted(MainBlockNode& ast) {
+        std::vector<Renamed> result;
+        std::unordered_set<const DeclarationNode*> seen;
+        auto add = [&](const DeclarationNode* declaration, const DeclarationNode* owner) {
+            // Struct instances are emitted as their members, so only their members need names
+            bool isInstance = !declaration->isFunction() && !declaration->type.isUnknown && !declaration->type.isPrimitive;
+            if (declaration->isStruct() || isInstance || !seen.insert(declaration).second) {return;}
+            result.push_back({(DeclarationNode*) declaration, owner});
+        };
+        auto add_with_parameters = [&](const DeclarationNode* declaration) {
+            add(declaration, nullptr);
+            if (auto function = dynamic_cast<const FunctionDeclarationNode*>(declaration); function && function->isFunction()) {
+                for (auto& parameter : function->parameters) {add(parameter.get(), function);}
+            }
+            // The variable of a comprehension is named like a parameter, unless the comprehension was unrolled
+            if (declaration->value && declaration->value->kind == NodeKind::COMPREHENSION) {
+                auto comprehension = (const ComprehensionNode*) declaration->value;
+                if (!comprehension->unrolled) {add(comprehension->variable.get(), declaration);}
+            }
+        };
+
+        for (auto statement : ast.emissionOrder) {
+            std::vector<const DeclarationNode*> provided;
+            statement->provided_declarations(provided);
+            for (auto declaration : provided) {add_with_parameters(declaration);}
+        }
+        for (auto& state : ast.tickerSchedule.state) {add_with_parameters(state.get());}
+        if (ast.tickerSchedule.dispatch) {add_with_parameters(ast.tickerSchedule.dispatch.get());}
+        return result;
+    }
+}
+
+void Compiler::minify_names(std::ostream* nameMap) {
+    std::vector<Renamed> renamed = find_emitted(*ast);
+    std::stable_sort(renamed.begin(), renamed.end(), [](const Renamed& a, const Renamed& b) {
+        return a.declaration->uses > b.declaration->uses;
+    });
+    for (size_t i = 0; i < renamed.size(); i++) {
+        renamed[i].declaration->minifiedName = short_name(i);
+        // The unknown of a regression is the definition itself
+        auto value = renamed[i].declaration->value;
+        if (value && value->kind == NodeKind::SOLVE) {
+            ((SolveNode*) value)->unknown->minifiedName = renamed[i].declaration->minifiedName;
+        }
+    }
+
+    if (!nameMap) {return;}
+    frontend::SourceMap lines(source);
+    *nameMap << "Emitted\tSource\tPosition\n";
+    for (auto& [declaration, owner] : renamed) {
+        frontend::SrcLocation location = lines.locate(declaration->pos);
+        *nameMap << declaration->minifiedName << "\t" << source_name(declaration, owner) << "\t"
+                 << location.line + 1 << ":" << location.col + 1 << "\n";
+    }
+    nameMap->flush();
+}
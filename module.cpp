@@ -0,0 +1,379 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <unordered_set>
+
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define DESMOS_MMAP
+#endif
+
+#include "module.h"
+#include "ast.h"
+
+using namespace AST;
+using namespace modules;
+
+static uint32_t hash_name(std::string_view name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ (uint8_t) c) * 16777619u;
+    }
+    return hash;
+}
+
+static TypeRecord to_record(const Type& type) {
+    // Only primitive types are exported, so struct types are recorded as unknown
+    return {(uint8_t) (type.isPrimitive ? type.value.primitive : UINT8_MAX), type.isConst, type.isList, 0};
+}
+
+static Type to_type(const TypeRecord& record) {
+    if (record.primitive > Type::ACTION) {return {};}
+    return {(Type::Primitive) record.primitive, (bool) record.isConst, (bool) record.isList};
+}
+
+static bool is_exportable(const DeclarationNode* declaration) {
+    if (declaration->isStruct() || dynamic_cast<const ActionDeclarationNode*>(declaration)) {return false;}
+    if (!declaration->type.isPrimitive) {return false;}
+    if (auto function = dynamic_cast<const FunctionDeclarationNode*>(declaration)) {
+        for (auto& parameter : function->parameters) {
+            if (!parameter->type.isPrimitive) {return false;}
+        }
+    }
+    return true;
+}
+
+void modules::write(const Compiler* compiler, std::ostream& out) {
+    std::string strings;
+    auto add_string = [&](std::string_view string) {
+        auto offset = (uint32_t) strings.size();
+        strings += string;
+        return offset;
+    };
+
+    // One unit per top-level statement, in emission order so that units come after their dependencies
+    const auto& statements = compiler->ast->emissionOrder;
+    std::vector<std::vector<const DeclarationNode*>> provided(statements.size());
+    std::unordered_map<const DeclarationNode*, uint32_t> providers;
+    for (uint32_t i = 0; i < statements.size(); i++) {
+        statements[i]->provided_declarations(provided[i]);
+        for (auto declaration : provided[i]) {providers[declaration] = i;}
+    }
+
+    std::vector<Unit> units;
+    std::vector<uint32_t> dependencies;
+    std::vector<Symbol> symbols;
+    std::vector<Parameter> parameters;
+    for (uint32_t i = 0; i < statements.size(); i++) {
+        std::stringstream latex;
+        statements[i]->compile(latex);
+        std::string compiled = latex.str();
+
+        std::vector<uint32_t> unitDependencies;
+        for (auto declaration : provided[i]) {
+            for (auto dependency : compiler->dependencies.dependencies(declaration)) {
+                auto provider = providers.find(dependency);
+                if (provider == providers.end() || provider->second == i) {continue;}
+                unitDependencies.push_back(provider->second);
+            }
+        }
+        std::sort(unitDependencies.begin(), unitDependencies.end());
+        unitDependencies.erase(std::unique(unitDependencies.begin(), unitDependencies.end()), unitDependencies.end());
+
+        units.push_back({add_string(compiled), (uint32_t) compiled.size(), (uint32_t) dependencies.size(), (uint32_t) unitDependencies.size()});
+        dependencies.insert(dependencies.end(), unitDependencies.begin(), unitDependencies.end());
+
+        // Fields and members are reached through their struct
+        for (auto declaration : provided[i]) {
+            if (declaration->parentStruct) {continue;}
+
+            Symbol symbol = {};
+            symbol.name = add_string(declaration->identifier);
+            symbol.nameLength = declaration->identifier.size();
+            symbol.unit = i;
+            symbol.type = to_record(declaration->type);
+            symbol.isExported = is_exportable(declaration);
+            if (declaration->isStruct()) {
+                symbol.kind = Symbol::STRUCT;
+            } else if (dynamic_cast<const ActionDeclarationNode*>(declaration)) {
+                symbol.kind = Symbol::ACTION;
+            } else if (auto function = dynamic_cast<const FunctionDeclarationNode*>(declaration)) {
+                symbol.kind = Symbol::FUNCTION;
+                symbol.isOverloaded = function->isOverloaded;
+                symbol.firstParameter = parameters.size();
+                symbol.parameterCount = function->parameters.size();
+                for (auto& parameter : function->parameters) {
+                    parameters.push_back({add_string(parameter->identifier), (uint32_t) parameter->identifier.size(), to_record(parameter->type)});
+                }
+            } else {
+                symbol.kind = Symbol::VARIABLE;
+            }
+            symbols.push_back(symbol);
+        }
+    }
+
+    // Open addressing with linear probing, at most half full. Buckets hold symbol indices plus one, or 0 if empty.
+    uint32_t bucketCount = 1;
+    while (bucketCount < 2 * symbols.size()) {bucketCount *= 2;}
+    std::vector<uint32_t> buckets(bucketCount, 0);
+    for (uint32_t i = 0; i < symbols.size(); i++) {
+        uint32_t bucket = hash_name(std::string_view(strings.data() + symbols[i].name, symbols[i].nameLength)) & (bucketCount - 1);
+        while (buckets[bucket]) {bucket = (bucket + 1) & (bucketCount - 1);}
+        buckets[bucket] = i + 1;
+    }
+
+    Header header = {};
+    std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+    header.version = VERSION;
+    header.bucketCount = bucketCount;
+    header.symbolCount = symbols.size();
+    header.parameterCount = parameters.size();
+    header.unitCount = units.size();
+    header.dependencyCount = dependencies.size();
+    header.stringsSize = strings.size();
+
+    out.write((const char*) &header, sizeof(header));
+    out.write((const char*) buckets.data(), buckets.size() * sizeof(uint32_t));
+    out.write((const char*) symbols.data(), symbols.size() * sizeof(Symbol));
+    out.write((const char*) parameters.data(), parameters.size() * sizeof(Parameter));
+    out.write((const char*) units.data(), units.size() * sizeof(Unit));
+    out.write((const char*) dependencies.data(), dependencies.size() * sizeof(uint32_t));
+    out.write(strings.data(), strings.size());
+}
+
+Module::Module(std::string name, frontend::SrcPos pos, SignatureTable& signatures) : name(std::move(name)), pos(pos), data(nullptr), size(0), buffer(), shared(),
+                                                                                    signatures(&signatures), header(nullptr), buckets(nullptr), symbols(nullptr), parameters(nullptr),
+                                                                                    units(nullptr), dependencies(nullptr), strings(nullptr), declarations(), overloadScope() {}
+
+Module::~Module() {
+#ifdef DESMOS_MMAP
+    if (data && buffer.empty() && !shared) {munmap((void*) data, size);}
+#endif
+}
+
+std::unique_ptr<Module> Module::open(const std::string& name, const std::string& path, frontend::SrcPos pos,
+                                     SignatureTable& signatures, std::string& error) {
+    std::unique_ptr<Module> module(new Module(name, pos, signatures));
+#ifdef DESMOS_MMAP
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {return nullptr;}
+    struct stat info = {};
+    if (fstat(file, &info) == 0 && info.st_size > 0) {
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapped != MAP_FAILED) {
+            module->data = (const char*) mapped;
+            module->size = info.st_size;
+        }
+    }
+    close(file);
+#else
+    std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+    if (!file.is_open()) {return nullptr;}
+    std::stringstream contents;
+    contents << file.rdbuf();
+    module->buffer = contents.str();
+    module->data = module->buffer.data();
+    module->size = module->buffer.size();
+#endif
+
+    if (!module->validate()) {
+        error = "'" + path + "' is not a valid module (it may have been written by another version of the compiler)";
+        return nullptr;
+    }
+    return module;
+}
+
+std::unique_ptr<Module> Module::open(std::shared_ptr<const SharedModule> module, frontend::SrcPos pos, SignatureTable& signatures) {
+    std::unique_ptr<Module> result(new Module(module->name, pos, signatures));
+    result->data = module->contents.data();
+    result->size = module->contents.size();
+    result->shared = std::move(module);
+    // Checked when it was built
+    result->validate();
+    return result;
+}
+
+std::shared_ptr<const SharedModule> SharedModule::build(std::string name, std::string& source) {
+    std::stringstream contents;
+    if (!Compiler::compile_module(source, contents)) {return nullptr;}
+    return std::shared_ptr<const SharedModule>(new SharedModule(std::move(name), contents.str()));
+}
+
+bool Module::validate() {
+    if (!data || size < sizeof(Header)) {return false;}
+    header = (const Header*) data;
+    if (!std::equal(std::begin(MAGIC), std::end(MAGIC), header->magic) || header->version != VERSION) {return false;}
+    if (header->bucketCount == 0 || (header->bucketCount & (header->bucketCount - 1))) {return false;}
+
+    // Only the section sizes are checked here; entries are checked as they're used
+    uint64_t offset = sizeof(Header);
+    buckets = (const uint32_t*) (data + offset);
+    offset += (uint64_t) header->bucketCount * sizeof(uint32_t);
+    symbols = (const Symbol*) (data + offset);
+    offset += (uint64_t) header->symbolCount * sizeof(Symbol);
+    parameters = (const Parameter*) (data + offset);
+    offset += (uint64_t) header->parameterCount * sizeof(Parameter);
+    units = (const Unit*) (data + offset);
+    offset += (uint64_t) header->unitCount * sizeof(Unit);
+    dependencies = (const uint32_t*) (data + offset);
+    offset += (uint64_t) header->dependencyCount * sizeof(uint32_t);
+    strings = data + offset;
+    offset += header->stringsSize;
+    return offset <= size;
+}
+
+std::string_view Module::string(uint32_t offset, uint32_t length) const {
+    if ((uint64_t) offset + length > header->stringsSize) {return {};}
+    return {strings + offset, length};
+}
+
+const Symbol* Module::find(std::string_view identifier) const {
+    uint32_t mask = header->bucketCount - 1;
+    uint32_t bucket = hash_name(identifier) & mask;
+    for (uint32_t probes = 0; probes < header->bucketCount; probes++) {
+        uint32_t entry = buckets[bucket];
+        if (entry == 0 || entry > header->symbolCount) {return nullptr;}
+        const Symbol* symbol = &symbols[entry - 1];
+        if (string(symbol->name, symbol->nameLength) == identifier) {return symbol;}
+        bucket = (bucket + 1) & mask;
+    }
+    return nullptr;
+}
+
+std::vector<const Symbol*> Module::find_all(std::string_view identifier) const {
+    std::vector<const Symbol*> found;
+    uint32_t mask = header->bucketCount - 1;
+    uint32_t bucket = hash_name(identifier) & mask;
+    for (uint32_t probes = 0; probes < header->bucketCount; probes++) {
+        uint32_t entry = buckets[bucket];
+        if (entry == 0 || entry > header->symbolCount) {break;}
+        const Symbol* symbol = &symbols[entry - 1];
+        if (string(symbol->name, symbol->nameLength) == identifier) {found.push_back(symbol);}
+        bucket = (bucket + 1) & mask;
+    }
+    return found;
+}
+
+std::unique_ptr<FunctionDeclarationNode> Module::import_function(const Symbol* symbol, SymbolScope* scope) const {
+    if ((uint64_t) symbol->firstParameter + symbol->parameterCount > header->parameterCount) {return nullptr;}
+    auto function = std::make_unique<FunctionDeclarationNode>(pos, to_type(symbol->type), string(symbol->name, symbol->nameLength), scope);
+    for (uint32_t i = 0; i < symbol->parameterCount; i++) {
+        const Parameter& parameter = parameters[symbol->firstParameter + i];
+        function->parameters.push_back(std::make_unique<DeclarationNode>(pos, to_type(parameter.type), string(parameter.name, parameter.nameLength), scope));
+    }
+    return function;
+}
+
+DeclarationNode* Module::import_symbol(std::string_view identifier, SymbolScope* scope) {
+    const Symbol* symbol = find(identifier);
+    if (symbol && symbol->isOverloaded) {return import_overloads(identifier);}
+    if (!symbol || !symbol->isExported) {return nullptr;}
+
+    uint32_t index = symbol - symbols;
+    if (auto existing = declarations.find(index); existing != declarations.end()) {return existing->second.get();}
+
+    // Identifiers point into the mapped file, which lives as long as the compiler
+    unq_ptr<DeclarationNode> declaration;
+    if (symbol->kind == Symbol::FUNCTION) {
+        declaration = import_function(symbol, scope);
+        if (!declaration) {return nullptr;}
+    } else {
+        declaration = std::make_unique<DeclarationNode>(pos, to_type(symbol->type), string(symbol->name, symbol->nameLength), scope);
+    }
+    return (declarations[index] = std::move(declaration)).get();
+}
+
+DeclarationNode* Module::import_overloads(std::string_view identifier) {
+    // Each is interned and added to the module's own scope, which calls look for the overload they resolve to in
+    DeclarationNode* first = nullptr;
+    for (auto symbol : find_all(identifier)) {
+        if (!symbol->isExported) {continue;}
+        uint32_t index = symbol - symbols;
+        if (auto existing = declarations.find(index); existing != declarations.end()) {return existing->second.get();}
+
+        auto function = import_function(symbol, &overloadScope);
+        if (!function) {return nullptr;}
+        std::vector<Type> parameterTypes;
+        for (auto& parameter : function->parameters) {parameterTypes.push_back(parameter->type);}
+        function->signature = signatures->intern(parameterTypes);
+        if (!first) {
+            first = function.get();
+            overloadScope.add_symbol(function.get());
+        }
+        // Which marks the first as overloaded too, even if no other overload is exported
+        overloadScope.add_overload(function.get());
+        declarations[index] = std::move(function);
+    }
+    return first;
+}
+
+std::vector<uint32_t> Module::needed_units() const {
+    std::unordered_set<uint32_t> needed;
+    std::vector<uint32_t> stack;
+    for (auto& [index, _] : declarations) {
+        if (needed.insert(symbols[index].unit).second) {stack.push_back(symbols[index].unit);}
+    }
+    while (!stack.empty()) {
+        uint32_t unit = stack.back();
+        stack.pop_back();
+        if (unit >= header->unitCount) {continue;}
+        for (uint32_t i = 0; i < units[unit].dependencyCount; i++) {
+            uint64_t entry = (uint64_t) units[unit].firstDependency + i;
+            if (entry >= header->dependencyCount) {break;}
+            if (needed.insert(dependencies[entry]).second) {stack.push_back(dependencies[entry]);}
+        }
+    }
+
+    std::vector<uint32_t> order(needed.begin(), needed.end());
+    std::sort(order.begin(), order.end());
+    return order;
+}
+
+void Module::compile(std::ostream& out) const {
+    for (uint32_t unit : needed_units()) {
+        if (unit < header->unitCount) {out << string(units[unit].latex, units[unit].latexLength);}
+    }
+}
+
+std::vector<std::string_view> Module::emitted_names() const {
+    // Symbols are written in the order of their units, so each unit's symbols are found by binary search
+    std::vector<std::string_view> names;
+    const Symbol* end = symbols + header->symbolCount;
+    for (uint32_t unit : needed_units()) {
+        auto symbol = std::lower_bound(symbols, end, unit, [](const Symbol& symbol, uint32_t unit) {return symbol.unit < unit;});
+        for (; symbol != end && symbol->unit == unit; symbol++) {
+            names.push_back(string(symbol->name, symbol->nameLength));
+        }
+    }
+    return names;
+}
+
+bool Compiler::compile_module(std::string& source, std::ostream& out) {
+    Compiler compiler;
+    if (!compiler.compile_frontend(source)) {return false;}
+
+    std::vector<Error> errors;
+    for (auto ticker : compiler.ast->tickerSchedule.tickers) {
+        errors.emplace_back(ticker->pos, "Modules can't contain tickers, since a graph can only have one");
+    }
+    for (auto& statement : compiler.ast->statements) {
+        if (dynamic_cast<const ImportStatementNode*>(statement.get())) {
+            errors.emplace_back(statement->pos, "Modules can't import other modules");
+        }
+    }
+    if (!errors.empty()) {
+        frontend::print_diagnostics(errors, source, true);
+        return false;
+    }
+
+    modules::write(&compiler, out);
+    return true;
+}
@@ -0,0 +1,152 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#ifndef DESMOS_COMPILER_MODULE_H
+#define DESMOS_COMPILER_MODULE_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <unordered_map>
+#include <memory>
+
+#include "compiler.h"
+#include "frontend.h"
+
+// Forward declarations
+namespace AST {struct DeclarationNode; struct FunctionDeclarationNode;}
+
+// Precompiled modules let programs share definitions without re-parsing or re-checking them.
+// A module file (.desm) holds the module's compiled LaTeX, split into one unit per top-level statement,
+// and a hash table of its top-level names. Importers map the file and only touch the symbols they use
+// and the units those symbols depend on, so importing doesn't get slower as a module grows.
+namespace modules {
+
+    constexpr char MAGIC[4] = {'D', 'E', 'S', 'M'};
+    constexpr uint32_t VERSION = 2;
+    constexpr const char* EXTENSION = ".desm";
+
+    // The file layout, in order: header, buckets, symbols, parameters, units, dependencies, strings.
+    // Strings are referred to by their offset into the string section.
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t bucketCount; // A power of two
+        uint32_t symbolCount;
+        uint32_t parameterCount;
+        uint32_t unitCount;
+        uint32_t dependencyCount;
+        uint32_t stringsSize;
+    };
+
+    struct TypeRecord {
+        uint8_t primitive;
+        uint8_t isConst;
+        uint8_t isList;
+        uint8_t padding;
+    };
+
+    struct Symbol {
+        enum Kind : uint8_t {VARIABLE, FUNCTION, STRUCT, ACTION};
+
+        uint32_t name, nameLength;
+        uint32_t unit; // The unit that defines it
+        uint32_t firstParameter, parameterCount;
+        TypeRecord type;
+        Kind kind;
+        uint8_t isExported; // Variables and functions of primitive types; everything else is only used inside the module
+        uint8_t isOverloaded; // A function sharing its name with others, which each have a symbol of their own
+        uint8_t padding;
+    };
+
+    struct Parameter {
+        uint32_t name, nameLength;
+        TypeRecord type;
+    };
+
+    struct Unit {
+        uint32_t latex, latexLength;
+        uint32_t firstDependency, dependencyCount; // Units always come after the units they depend on
+    };
+
+    // Writes the module interface of a compiled program
+    void write(const Compiler* compiler, std::ostream& out);
+
+    // A module built in memory, such as a prelude of definitions that every program can use. It is never changed
+    // after it's built, so any number of compilers on any threads can read it without copying or locking.
+    class SharedModule {
+        std::string name;
+        std::string contents; // The module file
+
+        SharedModule(std::string name, std::string contents) : name(std::move(name)), contents(std::move(contents)) {}
+
+        friend class Module;
+
+    public:
+        // Returns nullptr, after printing its errors, if the source isn't a valid module
+        static std::shared_ptr<const SharedModule> build(std::string name, std::string& source);
+
+        const std::string& get_name() const {return name;}
+    };
+
+    class Module {
+        std::string name;
+        frontend::SrcPos pos; // Of the import, which imported declarations are reported at
+        const char* data; // The mapped file
+        size_t size;
+        std::string buffer; // Holds the file where it can't be mapped
+        std::shared_ptr<const SharedModule> shared; // Holds the file if it was built in memory
+        SignatureTable* signatures; // The importer's, which imported overloads are interned in
+
+        const Header* header;
+        const uint32_t* buckets;
+        const Symbol* symbols;
+        const Parameter* parameters;
+        const Unit* units;
+        const uint32_t* dependencies;
+        const char* strings;
+
+        // Declarations are only created for the symbols the importer uses
+        std::unordered_map<uint32_t, std::unique_ptr<AST::DeclarationNode>> declarations;
+        // Of the imported overloads, which calls are resolved in like the overloads of the importer's own scopes
+        SymbolScope overloadScope;
+
+        Module(std::string name, frontend::SrcPos pos, SignatureTable& signatures);
+
+        bool validate();
+        std::string_view string(uint32_t offset, uint32_t length) const;
+        const Symbol* find(std::string_view identifier) const;
+        // Every symbol with the name, which is more than one for overloaded functions
+        std::vector<const Symbol*> find_all(std::string_view identifier) const;
+        std::unique_ptr<AST::FunctionDeclarationNode> import_function(const Symbol* symbol, SymbolScope* scope) const;
+        // Imports every exported overload of a function together, returning the first
+        AST::DeclarationNode* import_overloads(std::string_view identifier);
+        // Everything the imported symbols transitively depend on, in the module's emission order
+        std::vector<uint32_t> needed_units() const;
+
+    public:
+        Module(const Module&) = delete;
+        Module& operator=(const Module&) = delete;
+        ~Module();
+
+        // Returns nullptr if the file doesn't exist, or nullptr and an error if it isn't a valid module
+        static std::unique_ptr<Module> open(const std::string& name, const std::string& path, frontend::SrcPos pos,
+                                            SignatureTable& signatures, std::string& error);
+        // Reads a shared module; only the symbols used are copied into the new module
+        static std::unique_ptr<Module> open(std::shared_ptr<const SharedModule> module, frontend::SrcPos pos, SignatureTable& signatures);
+
+        const std::string& get_name() const {return name;}
+        // Whether the module defines a top-level name, exported or not
+        bool defines(std::string_view identifier) const {return find(identifier);}
+        // The declaration of an exported symbol (the first overload, for overloaded functions), or nullptr
+        AST::DeclarationNode* import_symbol(std::string_view identifier, SymbolScope* scope);
+        // Writes the units that the imported symbols depend on
+        void compile(std::ostream& out) const;
+        // The top-level names defined by the units that compile() writes, exported or not
+        std::vector<std::string_view> emitted_names() const;
+    };
+}
+
+#endif //DESMOS_COMPILER_MODULE_H
@@ -2,9 +2,15 @@
 // Created by Cooper Roalson on 7/12/24.
 //
 
+#include <array>
+#include <unordered_map>
+
 #include "compiler.h"
 #include "frontend.h"
 #include "ast.h"
+#include "module.h"
+#include "builtins.h"
+#include "visitor.h"
 
 namespace frontend {
     using namespace AST;
@@ -12,42 +18,177 @@ namespace frontend {
     template <class T>
     using unq_ptr = std::unique_ptr<T>;
 
+    // Hash-conses subexpressions: structurally identical subexpressions that resolve their names in the same scope
+    // and declaration share one node, so that the AST becomes a DAG. Children are shared before their parents, so
+    // nodes are identical exactly when their own fields match and their children are the same nodes.
+    class ExpressionTable {
+        struct Key {
+            NodeKind kind;
+            int op; // The operator, or the literal's primitive type
+            double value;
+            std::string_view name; // The identifier or member
+            const SymbolScope* scope;
+            const DeclarationNode* context;
+            std::array<const ASTNode*, 3> children; // The first three, which is all of them except in lists and calls
+            std::vector<const ASTNode*> moreChildren;
+
+            bool operator==(const Key& other) const = default;
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const {
+                size_t hash = (size_t) key.kind;
+                auto combine = [&](size_t value) {hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);};
+                combine(std::hash<int>()(key.op));
+                combine(std::hash<double>()(key.value));
+                combine(std::hash<std::string_view>()(key.name));
+                combine(std::hash<const void*>()(key.scope));
+                combine(std::hash<const void*>()(key.context));
+                for (auto child : key.children) {combine(std::hash<const void*>()(child));}
+                for (auto child : key.moreChildren) {combine(std::hash<const void*>()(child));}
+                return hash;
+            }
+        };
+
+        std::unordered_map<Key, ExpressionNode*, KeyHash> nodes; // Each entry counts as one of its node's owners
+
+        static Key make_key(ExpressionNode* node) {
+            Key key{node->kind, 0, 0, {}, nullptr, nullptr, {}, {}};
+            switch (node->kind) {
+                case NodeKind::LITERAL: {
+                    auto literal = static_cast<LiteralNode*>(node);
+                    key.op = literal->type.value.primitive;
+                    key.value = literal->value;
+                    break;
+                }
+                case NodeKind::IDENTIFIER: {
+                    auto identifier = static_cast<IdentifierNode*>(node);
+                    key.name = identifier->identifier;
+                    key.scope = identifier->scope;
+                    key.context = identifier->context; // Which declaration depends on it
+                    // Names of builtins being called aren't the same as the names used outside of calls
+                    key.op = (identifier->builtin != nullptr) + 2 * identifier->isExplicitBuiltin;
+                    break;
+                }
+                case NodeKind::MEMBER_ACCESS:
+                    key.name = static_cast<MemberAccessNode*>(node)->member;
+                    break;
+                case NodeKind::CALL: {
+                    // Callees aren't shared, since resolving an overload sets the callee's declaration, so calls are
+                    // identified by the callee's name and their arguments
+                    auto call = static_cast<CallNode*>(node);
+                    auto callee = static_cast<IdentifierNode*>(call->function.get());
+                    key.name = callee->identifier;
+                    key.scope = callee->scope;
+                    key.context = callee->context;
+                    key.op = (callee->builtin != nullptr) + 2 * callee->isExplicitBuiltin;
+                    for (size_t i = 0; i < call->arguments.size(); i++) {
+                        if (i < key.children.size()) {
+                            key.children[i] = call->arguments[i].get();
+                        } else {
+                            key.moreChildren.push_back(call->arguments[i].get());
+                        }
+                    }
+                    return key;
+                }
+                case NodeKind::BINARY_OPERATOR:
+                    key.op = static_cast<BinaryOperatorNode*>(node)->op;
+                    break;
+                case NodeKind::UNARY_OPERATOR:
+                    key.op = static_cast<UnaryOperatorNode*>(node)->op;
+                    break;
+                case NodeKind::TERNARY_OPERATOR:
+                    // Without an else branch, so that a?b:c and a?b don't have the same children
+                    key.op = static_cast<TernaryOperatorNode*>(node)->ifFalse != nullptr;
+                    break;
+                default:
+                    break;
+            }
+            size_t count = 0;
+            for_each_child(node, [&](ASTNode* child) {
+                if (count < key.children.size()) {
+                    key.children[count++] = child;
+                } else {
+                    key.moreChildren.push_back(child);
+                }
+            });
+            return key;
+        }
+
+    public:
+        ExpressionTable() : nodes() {}
+        ExpressionTable(const ExpressionTable&) = delete;
+        ExpressionTable& operator=(const ExpressionTable&) = delete;
+        ~ExpressionTable() {
+            for (auto& [key, node] : nodes) {
+                if (--node->owners == 0) {delete node;}
+            }
+        }
+
+        // Returns the node identical to the given one that is already in the tree, or else the given node
+        unq_ptr<ExpressionNode> share(unq_ptr<ExpressionNode> node) {
+            // Struct initializers stand for distinct instances
+            if (!node || node->kind == NodeKind::STRUCT_INITIALIZER) {return node;}
+
+            auto [entry, isNew] = nodes.try_emplace(make_key(node.get()), node.get());
+            ExpressionNode* shared = entry->second;
+            shared->owners++;
+            if (isNew) {return node;}
+            // The new copy is destroyed, and its children lose an owner
+            return unq_ptr<ExpressionNode>(shared);
+        }
+    };
+
+    struct PendingOperator;
+
     class Parser {
         Compiler* compiler;
         SymbolScope* currentScope;
+        DeclarationNode* currentDeclaration;
+        const TokenStream& stream;
         const std::vector<Token>& tokens;
         std::vector<Error>& errors;
         long i;
+        bool panicking; // Set by an error, and cleared once the parser is back at the start of a statement
+        size_t errorCount; // Including errors that weren't reported
+        bool isSolving; // In the equation of a $solve
+        ExpressionTable sharedExpressions; // If the compiler shares subexpressions
 
+        void error(SrcPos pos, std::string message);
+        void synchronize(long start);
+        template <class T>
+        void parse_statements(std::vector<unq_ptr<T>>& statements, unq_ptr<T> (Parser::*parse_next)(bool));
         bool accept_token(Token::Type token, bool required = false);
 
-        unq_ptr<ExpressionNode> parse_binary_operator(Token::Type opTypes[4], bool leftAssoc, unq_ptr<ExpressionNode> (Parser::*parse_next)());
-        unq_ptr<ExpressionNode> parse_e0();
-        unq_ptr<ExpressionNode> parse_e1();
-        unq_ptr<ExpressionNode> parse_e2();
-        unq_ptr<ExpressionNode> parse_e3();
-        unq_ptr<ExpressionNode> parse_e4();
-        unq_ptr<ExpressionNode> parse_e5();
-        unq_ptr<ExpressionNode> parse_e6();
-        unq_ptr<ExpressionNode> parse_e7();
-        unq_ptr<ExpressionNode> parse_e8();
-        unq_ptr<ExpressionNode> parse_e9();
-        unq_ptr<ExpressionNode> parse_e10();
-        unq_ptr<ExpressionNode> parse_expression(bool required = false);
+        // Binding levels, from the tightest. An expression parsed at a level can't contain looser binding operators.
+        static constexpr int POSTFIX_LEVEL = 1, EXP_LEVEL = 2, PREFIX_LEVEL = 3, SUM_LEVEL = 5, TERNARY_LEVEL = 10;
+        unq_ptr<ExpressionNode> parse_expression(bool required = false, int loosest = TERNARY_LEVEL);
+        void reduce(std::vector<PendingOperator>& operators, std::vector<unq_ptr<ExpressionNode>>& operands);
+        // Takes a subexpression as it is added to its parent. Only expression nodes hold shared nodes, since their
+        // destructors are what release a shared node (see ast.cpp); the root of an expression is never shared.
+        unq_ptr<ExpressionNode> share(unq_ptr<ExpressionNode> node);
 
         Type parse_type(bool required = false);
         unq_ptr<DeclarationNode> parse_declaration(bool required = false);
         unq_ptr<InitializationStatementNode> parse_initialization_statement(bool required = false);
+        unq_ptr<StructDefinitionNode> parse_struct_definition(bool required = false);
+        unq_ptr<StatementNode> parse_action_statement(bool required = false);
+        unq_ptr<ActionDefinitionNode> parse_action_definition(bool required = false);
+        std::vector<std::pair<Token, unq_ptr<ExpressionNode>>> parse_attributes();
+        unq_ptr<TickerNode> parse_ticker(bool required = false);
+        unq_ptr<ImportStatementNode> parse_import(bool required = false);
+        unq_ptr<InitializationStatementNode> parse_for(bool required = false);
+        unq_ptr<ExpressionNode> parse_solve(SrcPos pos);
         unq_ptr<StatementNode> parse_statement(bool required = false);
         unq_ptr<StatementBlockNode> parse_statement_block(bool required = false);
         unq_ptr<MainBlockNode> parse_main_block();
 
     public:
-        Parser(Compiler* compiler, const std::vector<Token>& tokens, std::vector<Error>& errors) : compiler(compiler), currentScope(&compiler->symbolTable), tokens(tokens), errors(errors), i(0) {}
+        Parser(Compiler* compiler, const TokenStream& stream, std::vector<Error>& errors) : compiler(compiler), currentScope(&compiler->symbolTable), currentDeclaration(nullptr), stream(stream), tokens(stream.tokens), errors(errors), i(0), panicking(false), errorCount(0), isSolving(false), sharedExpressions() {}
         void parse();
     };
 
-    void parse(Compiler* compiler, const std::vector<Token>& tokens, std::vector<Error>& errors) {
+    void parse(Compiler* compiler, const TokenStream& tokens, std::vector<Error>& errors) {
         Parser parser(compiler, tokens, errors);
         parser.parse();
     }
@@ -56,6 +197,96 @@ namespace frontend {
     }
 
 
+    void Parser::error(SrcPos pos, std::string message) {
+        // Errors after the first in a statement are usually caused by it
+        errorCount++;
+        if (panicking) {return;}
+        errors.emplace_back(pos, std::move(message));
+        panicking = true;
+    }
+
+    void Parser::synchronize(long start) {
+        // Skip to the end of the bad statement: past a ';' or a balanced {...}, or up to a '}' closing the
+        // enclosing block or a keyword or declaration that starts a statement. Every token is skipped at most once.
+        if (i == start) {
+            if (tokens[i].type == Token::FILE_END) {return;}
+            if (tokens[i].type == Token::SEMICOLON) {
+                // Stray semicolons
+                while (tokens[i].type == Token::SEMICOLON) {i++;}
+                return;
+            }
+            i++;
+        }
+
+        long depth = 0;
+        long parentheses = 0;
+        while (tokens[i].type != Token::FILE_END) {
+            switch (tokens[i].type) {
+                case Token::LEFT_PAREN:
+                    parentheses++;
+                    break;
+                case Token::RIGHT_PAREN:
+                    parentheses--;
+                    break;
+                case Token::LEFT_BRACE:
+                    depth++;
+                    break;
+                case Token::RIGHT_BRACE:
+                    if (depth == 0) {return;}
+                    if (--depth == 0) {
+                        i++;
+                        // Along with the ';' that ends a statement like a = {...};
+                        if (tokens[i].type == Token::SEMICOLON) {i++;}
+                        return;
+                    }
+                    break;
+                case Token::SEMICOLON:
+                    if (depth == 0) {
+                        i++;
+                        return;
+                    }
+                    break;
+                case Token::KW_STRUCT:
+                case Token::KW_ACTION:
+                case Token::KW_TICKER:
+                case Token::KW_IMPORT:
+                case Token::KW_FOR:
+                case Token::KW_CONST:
+                case Token::KW_PLOT:
+                case Token::KW_HIDDEN:
+                    if (depth == 0) {return;}
+                    break;
+                case Token::PRIMITIVE:
+                    // Only a type that declares something, like "num a" or "num[] a", and not a parameter's. Type
+                    // names are also used in the middle of statements, as in <color=d>.
+                    if (depth == 0 && parentheses <= 0 && (tokens[i + 1].type == Token::IDENTIFIER || tokens[i + 1].type == Token::LEFT_BRACKET)) {return;}
+                    break;
+                default:
+                    break;
+            }
+            i++;
+        }
+    }
+
+    template <class T>
+    void Parser::parse_statements(std::vector<unq_ptr<T>>& statements, unq_ptr<T> (Parser::*parse_next)(bool)) {
+        // Until the '}' closing the block (which is left for the caller) or the end of the file
+        while (tokens[i].type != Token::RIGHT_BRACE && tokens[i].type != Token::FILE_END) {
+            long start = i;
+            size_t previousErrors = errorCount;
+            unq_ptr<T> statement = (this->*parse_next)(true);
+            bool isComplete = statement && (tokens[i - 1].type == Token::SEMICOLON || tokens[i - 1].type == Token::RIGHT_BRACE);
+            if (statement) {
+                statements.push_back(std::move(statement));
+            }
+
+            if (errorCount != previousErrors && !isComplete) {
+                synchronize(start);
+            }
+            panicking = false;
+        }
+    }
+
     bool Parser::accept_token(Token::Type token, bool required) {
         if (i < tokens.size() && tokens[i].type == token) {
             i++;
@@ -63,13 +294,13 @@ namespace frontend {
         }
         if (required) {
             if (i + 1 < tokens.size() && tokens[i + 1].type == token) {
-                errors.emplace_back(tokens[i].pos, std::string("Unexpected token: ") + tokens[i].name());
+                error(tokens[i].pos, std::string("Unexpected token: ") + tokens[i].name());
                 i += 2;
                 return true;
             }
-            std::string message = "Expected token: " + std::to_string(token);
+            std::string message = std::string("Expected token: ") + Token::NAMES[token];
             if (i < tokens.size()) {message = message + ", got: " + tokens[i].name();}
-            errors.emplace_back(tokens[i].pos, message);
+            error(tokens[i].pos, message);
         }
         return false;
     }
@@ -78,34 +309,41 @@ namespace frontend {
         long start = i;
         bool isConst = accept_token(Token::KW_CONST);
 
+        Type type;
         if (accept_token(Token::PRIMITIVE)) {
-            return {(Type::Primitive) tokens[i - 1].value.uint, isConst};
+            type = {(Type::Primitive) tokens[i - 1].payload, isConst};
         } else if (accept_token(Token::IDENTIFIER)) {
-            return {tokens[i - 1].value.string, isConst};
+            type = {stream.identifier(tokens[i - 1]), isConst};
+        } else {
+            if (required) {
+                error(tokens[start].pos, "Expected type");
+            } else {
+                i = start;
+            }
+            return {};
         }
 
-        if (required) {
-            errors.emplace_back(tokens[start].pos, "Expected type");
-        } else {
-            i = start;
+        if (accept_token(Token::LEFT_BRACKET)) {
+            accept_token(Token::RIGHT_BRACKET, true);
+            type.isList = true;
         }
-        return {};
+        return type;
     }
 
     unq_ptr<DeclarationNode> Parser::parse_declaration(bool required) {
         long start = i;
         Type type = parse_type();
         if (type.isUnknown) {
-            if (required) {errors.emplace_back(tokens[start].pos, "Expected declaration");}
+            if (required) {error(tokens[start].pos, "Expected declaration");}
             return nullptr;
         }
 
         if (!accept_token(Token::IDENTIFIER)) {
-            if (required) {errors.emplace_back(tokens[start].pos, "Expected declaration");}
+            if (required) {error(tokens[start].pos, "Expected declaration");}
             i = start;
             return nullptr;
         }
-        std::string_view identifier = tokens[i - 1].value.string;
+        std::string_view identifier = stream.identifier(tokens[i - 1]);
 
         // Check if it's a function
         if (accept_token(Token::LEFT_PAREN)) {
@@ -158,147 +396,344 @@ namespace frontend {
         }
     }
 
-    unq_ptr<ExpressionNode> Parser::parse_binary_operator(Token::Type opTypes[4], bool leftAssoc, unq_ptr<ExpressionNode> (Parser::*parse_next)()) {
-        unq_ptr<ExpressionNode> node = (this->*parse_next)();
-        if (!node) {return nullptr;}
-
-        ExpressionNode* current = node.get();
-        bool isBinop = false;
-        while (accept_token(opTypes[0]) || accept_token(opTypes[1]) || accept_token(opTypes[2]) || accept_token(opTypes[3])) {
-            Token op = tokens[i - 1];
-            unq_ptr<ExpressionNode> right = (this->*parse_next)();
-            if (!right) {
-                errors.emplace_back(tokens[i].pos, "Expected expression");
-                break;
-            }
-
-            if (!leftAssoc && isBinop) {
-                auto binopNode = (BinaryOperatorNode*) current;
-                binopNode->right = std::make_unique<BinaryOperatorNode>(op.pos, get_operator(op.type), std::move(binopNode->right), std::move(right));
-                current = binopNode->right.get();
-            } else {
-                node = std::make_unique<BinaryOperatorNode>(op.pos, get_operator(op.type), std::move(node), std::move(right));
-                current = node.get();
-            }
-            isBinop = true;
+    // The binding level of a binary operator (lower binds more tightly), or 0 if the token isn't one
+    static int binary_level(Token::Type type) {
+        switch (type) {
+            case Token::EXP: return 2;
+            case Token::MUL:
+            case Token::DIV:
+            case Token::MOD:
+                return 4;
+            case Token::PLUS:
+            case Token::MINUS:
+                return 5;
+            case Token::LESS:
+            case Token::GREATER:
+            case Token::LESS_EQUAL:
+            case Token::GREATER_EQUAL:
+                return 6;
+            case Token::EQUAL_EQUAL:
+            case Token::NOT_EQUAL:
+                return 7;
+            case Token::AND: return 8;
+            case Token::OR: return 9;
+            default: return 0;
         }
-        return node;
     }
 
-    unq_ptr<ExpressionNode> Parser::parse_e0() {
-        // (expr), literals, identifiers
-        if (accept_token(Token::LEFT_PAREN)) {
-            unq_ptr<ExpressionNode> node = parse_expression(true);
-            accept_token(Token::RIGHT_PAREN, true);
-            return node;
-        } else if (accept_token(Token::IDENTIFIER)) {
-            return std::make_unique<IdentifierNode>(tokens[i - 1].pos, tokens[i - 1].value.string, currentScope);
-        } else if (accept_token(Token::NUM_LITERAL)) {
-            return std::make_unique<LiteralNode>(tokens[i - 1].pos, Type(Type::NUM, true), tokens[i - 1].value.num);
-        } else if (accept_token(Token::BOOL_LITERAL)) {
-            return std::make_unique<LiteralNode>(tokens[i - 1].pos, Type(Type::BOOL, true), tokens[i - 1].value.boolean ? 1 : 0);
-        } else {
-            return nullptr;
-        }
-    }
+    // An operator whose right operand isn't complete yet
+    struct PendingOperator {
+        Token token;
+        int level;
+        bool isPrefix;
+        bool hasElse; // For ?:, once the ':' has been reached
+    };
 
-    unq_ptr<ExpressionNode> Parser::parse_e1() {
-        // func(), arr[], foo.bar
-        return parse_e0();
-    }
+    // A bracketed part of an expression, or the whole expression
+    struct ExpressionGroup {
+        enum Kind {EXPRESSION, PAREN, POINT, ABS, LIST, INITIALIZER, CALL, INDEX, DERIVATIVE} kind;
+        Token token; // The opening bracket
+        Token::Type closer;
+        int loosest; // The loosest binding level allowed in the group
+        size_t operatorBase, operandBase; // Where the group's part of each stack starts
+        size_t openTernaries; // ?: operators in the group that haven't reached their ':'
+        unq_ptr<ExpressionNode> node; // The list, initializer or call being built, the point's x, or the indexed list
+        std::vector<unq_ptr<ExpressionNode>>* elements; // Of the list, initializer or call
+    };
 
-    unq_ptr<ExpressionNode> Parser::parse_e2() {
-        // ^
-        Token::Type ops[4] = {Token::EXP, Token::EXP, Token::EXP, Token::EXP};
-        return parse_binary_operator(ops, false, &Parser::parse_e1);
+    template <class T>
+    static T pop(std::vector<T>& stack) {
+        T top = std::move(stack.back());
+        stack.pop_back();
+        return top;
     }
 
-    unq_ptr<ExpressionNode> Parser::parse_e3() {
-        // -, !
-        unq_ptr<ExpressionNode> node = nullptr;
-        UnaryOperatorNode* currentOp = nullptr;
-        while (accept_token(Token::MINUS) || accept_token(Token::INVERT)) {
-            Token op = tokens[i - 1];
-            if (currentOp) {
-                currentOp->expr = std::make_unique<UnaryOperatorNode>(op.pos, get_operator(op.type), nullptr);
-                currentOp = (UnaryOperatorNode*) (currentOp->expr.get());
-            } else {
-                node = std::make_unique<UnaryOperatorNode>(op.pos, get_operator(op.type), nullptr);
-                currentOp = (UnaryOperatorNode*) node.get();
-            }
-        }
-
-        unq_ptr<ExpressionNode> expr = parse_e2();
-        if (!expr) {return nullptr;}
+    unq_ptr<ExpressionNode> Parser::share(unq_ptr<ExpressionNode> node) {
+        if (!compiler->shareSubexpressions) {return node;}
+        return sharedExpressions.share(std::move(node));
+    }
 
-        if (currentOp) {
-            currentOp->expr = std::move(expr);
+    // Replaces the top operator and its operands with the node they make up
+    void Parser::reduce(std::vector<PendingOperator>& operators, std::vector<unq_ptr<ExpressionNode>>& operands) {
+        PendingOperator op = pop(operators);
+        if (op.isPrefix) {
+            operands.back() = std::make_unique<UnaryOperatorNode>(op.token.pos, get_operator(op.token.type), share(std::move(operands.back())));
+        } else if (op.token.type == Token::QUESTION) {
+            // The else branch is optional; without it the result is undefined when the condition fails
+            unq_ptr<ExpressionNode> ifFalse = op.hasElse ? share(pop(operands)) : nullptr;
+            unq_ptr<ExpressionNode> ifTrue = share(pop(operands));
+            operands.back() = std::make_unique<TernaryOperatorNode>(op.token.pos, share(std::move(operands.back())), std::move(ifTrue), std::move(ifFalse));
         } else {
-            node = std::move(expr);
+            unq_ptr<ExpressionNode> right = share(pop(operands));
+            operands.back() = std::make_unique<BinaryOperatorNode>(op.token.pos, get_operator(op.token.type), share(std::move(operands.back())), std::move(right));
         }
-        return node;
     }
 
-    unq_ptr<ExpressionNode> Parser::parse_e4() {
-        // +, -
-        Token::Type ops[4] = {Token::MUL, Token::DIV, Token::MOD, Token::MOD};
-        return parse_binary_operator(ops, true, &Parser::parse_e3);
-    }
+    unq_ptr<ExpressionNode> Parser::parse_expression(bool required, int loosest) {
+        // Parsed with explicit stacks instead of by recursive descent, so that deeply nested expressions can't
+        // overflow the native stack. Operators wait on the stack until a looser binding operator or the end of
+        // their group shows that their right operand is complete, and each bracket opens a group of its own.
+        std::vector<PendingOperator> operators;
+        std::vector<unq_ptr<ExpressionNode>> operands;
+        std::vector<ExpressionGroup> groups;
+        groups.push_back({ExpressionGroup::EXPRESSION, tokens[i], Token::FILE_END, loosest, 0, 0, 0, nullptr, nullptr});
+        bool expectOperand = true;
 
-    unq_ptr<ExpressionNode> Parser::parse_e5() {
-        // +, -
-        Token::Type ops[4] = {Token::PLUS, Token::MINUS, Token::MINUS, Token::MINUS};
-        return parse_binary_operator(ops, true, &Parser::parse_e4);
-    }
+        auto open_group = [&](ExpressionGroup::Kind kind, Token::Type closer, unq_ptr<ExpressionNode> node = nullptr,
+                              std::vector<unq_ptr<ExpressionNode>>* elements = nullptr) {
+            groups.push_back({kind, tokens[i - 1], closer, TERNARY_LEVEL, operators.size(), operands.size(), 0, std::move(node), elements});
+            expectOperand = true;
+        };
 
-    unq_ptr<ExpressionNode> Parser::parse_e6() {
-        // <, >, <=, >=
-        Token::Type ops[4] = {Token::LESS, Token::GREATER, Token::LESS_EQUAL, Token::GREATER_EQUAL};
-        return parse_binary_operator(ops, true, &Parser::parse_e5);
-    }
+        while (true) {
+            ExpressionGroup& group = groups.back();
+            bool hasOperator = operators.size() > group.operatorBase;
 
-    unq_ptr<ExpressionNode> Parser::parse_e7() {
-        // ==, !=
-        Token::Type ops[4] = {Token::EQUAL_EQUAL, Token::NOT_EQUAL, Token::NOT_EQUAL, Token::NOT_EQUAL};
-        return parse_binary_operator(ops, true, &Parser::parse_e6);
-    }
+            if (expectOperand) {
+                // -, ! (not allowed in exponents), then (expr), |expr|, (x,y), [list], {struct}, literals, identifiers
+                bool allowsPrefix = group.loosest >= PREFIX_LEVEL && (!hasOperator || operators.back().token.type != Token::EXP);
+                if (allowsPrefix && (tokens[i].type == Token::MINUS || tokens[i].type == Token::INVERT)) {
+                    operators.push_back({tokens[i++], PREFIX_LEVEL, true, false});
+                } else if (accept_token(Token::LEFT_PAREN)) {
+                    open_group(ExpressionGroup::PAREN, Token::RIGHT_PAREN);
+                } else if (accept_token(Token::ABS)) {
+                    open_group(ExpressionGroup::ABS, Token::ABS);
+                } else if (accept_token(Token::LEFT_BRACKET)) {
+                    auto list = std::make_unique<ListNode>(tokens[i - 1].pos);
+                    if (accept_token(Token::RIGHT_BRACKET)) {
+                        operands.push_back(std::move(list));
+                        expectOperand = false;
+                    } else {
+                        auto elements = &list->elements;
+                        open_group(ExpressionGroup::LIST, Token::RIGHT_BRACKET, std::move(list), elements);
+                    }
+                } else if (accept_token(Token::LEFT_BRACE)) {
+                    // Struct initializer
+                    auto initializer = std::make_unique<StructInitializerNode>(tokens[i - 1].pos);
+                    if (accept_token(Token::RIGHT_BRACE)) {
+                        operands.push_back(std::move(initializer));
+                        expectOperand = false;
+                    } else {
+                        auto arguments = &initializer->arguments;
+                        open_group(ExpressionGroup::INITIALIZER, Token::RIGHT_BRACE, std::move(initializer), arguments);
+                    }
+                } else if (accept_token(Token::IDENTIFIER)) {
+                    operands.push_back(std::make_unique<IdentifierNode>(tokens[i - 1].pos, stream.identifier(tokens[i - 1]), currentScope, currentDeclaration));
+                    expectOperand = false;
+                } else if (accept_token(Token::DOLLAR)) {
+                    // $name(...) calls the builtin function even where a declaration has its name
+                    Token dollar = tokens[i - 1];
+                    std::string_view name = accept_token(Token::IDENTIFIER, true) ? stream.identifier(tokens[i - 1]) : "";
+                    if (name == "solve" && !isSolving) {
+                        operands.push_back(parse_solve(dollar.pos));
+                        expectOperand = false;
+                        continue;
+                    }
+                    // $d(expr, variable) is a group of its own, which ends at the comma
+                    if (name == "d" && accept_token(Token::LEFT_PAREN)) {
+                        open_group(ExpressionGroup::DERIVATIVE, Token::RIGHT_PAREN);
+                        continue;
+                    }
+                    auto identifier = std::make_unique<IdentifierNode>(dollar.pos, name, currentScope, currentDeclaration);
+                    identifier->builtin = builtins::find(name);
+                    identifier->isExplicitBuiltin = true;
+                    if (name == "solve") {
+                        error(dollar.pos, "Equations cannot contain '$solve'");
+                    } else if (!name.empty() && name != "d" && !identifier->builtin) {
+                        error(dollar.pos, "Unknown builtin function: '$" + std::string(name) + "'");
+                    } else if ((identifier->builtin || name == "d") && tokens[i].type != Token::LEFT_PAREN) {
+                        error(tokens[i].pos, "Expected '(' after builtin function '$" + std::string(name) + "'");
+                    }
+                    operands.push_back(std::move(identifier));
+                    expectOperand = false;
+                } else if (accept_token(Token::NUM_LITERAL)) {
+                    operands.push_back(std::make_unique<LiteralNode>(tokens[i - 1].pos, Type(Type::NUM, true), stream.number(tokens[i - 1])));
+                    expectOperand = false;
+                } else if (accept_token(Token::BOOL_LITERAL)) {
+                    operands.push_back(std::make_unique<LiteralNode>(tokens[i - 1].pos, Type(Type::BOOL, true), tokens[i - 1].payload ? 1 : 0));
+                    expectOperand = false;
+                } else {
+                    // No operand: drop the operators waiting for it, leaving their left operands, or the groups
+                    // that would have contained it
+                    while (true) {
+                        ExpressionGroup& current = groups.back();
+                        while (operators.size() > current.operatorBase && operators.back().isPrefix) {
+                            operators.pop_back();
+                        }
+                        if (operators.size() > current.operatorBase) {
+                            error(tokens[i].pos, "Expected expression");
+                            PendingOperator& op = operators.back();
+                            if (op.hasElse) {
+                                op.hasElse = false;
+                                current.openTernaries++;
+                            } else {
+                                if (op.token.type == Token::QUESTION) {current.openTernaries--;}
+                                operators.pop_back();
+                            }
+                            break;
+                        }
 
-    unq_ptr<ExpressionNode> Parser::parse_e8() {
-        // &&
-        Token::Type ops[4] = {Token::AND, Token::AND, Token::AND, Token::AND};
-        return parse_binary_operator(ops, true, &Parser::parse_e7);
-    }
+                        if (current.kind == ExpressionGroup::EXPRESSION) {
+                            if (required) {error(tokens[i].pos, "Expected expression");}
+                            return nullptr;
+                        }
+                        error(tokens[i].pos, "Expected expression");
+                        if (current.kind == ExpressionGroup::LIST || current.kind == ExpressionGroup::INITIALIZER || current.kind == ExpressionGroup::CALL) {
+                            // Kept without the missing element
+                            operands.push_back(std::move(current.node));
+                            groups.pop_back();
+                            break;
+                        }
+                        accept_token(current.closer, true);
+                        if (current.kind == ExpressionGroup::INDEX) {
+                            // Kept without the index
+                            operands.push_back(std::move(current.node));
+                            groups.pop_back();
+                            break;
+                        }
+                        groups.pop_back();
+                    }
+                    expectOperand = false;
+                }
+                continue;
+            }
 
-    unq_ptr<ExpressionNode> Parser::parse_e9() {
-        // ||
-        Token::Type ops[4] = {Token::OR, Token::OR, Token::OR, Token::OR};
-        return parse_binary_operator(ops, true, &Parser::parse_e8);
-    }
+            // func(), arr[], foo.bar bind most tightly
+            if (accept_token(Token::LEFT_BRACKET)) {
+                unq_ptr<ExpressionNode> list = pop(operands);
+                open_group(ExpressionGroup::INDEX, Token::RIGHT_BRACKET, std::move(list));
+                continue;
+            }
+            if (tokens[i].type == Token::LEFT_PAREN && dynamic_cast<IdentifierNode*>(operands.back().get())) {
+                accept_token(Token::LEFT_PAREN);
+                unq_ptr<ExpressionNode> callee = pop(operands);
+                auto identifier = (IdentifierNode*) callee.get();
+                if (!identifier->builtin) {identifier->builtin = builtins::find(identifier->identifier);}
+                auto call = std::make_unique<CallNode>(tokens[i - 1].pos, std::move(callee));
+                if (accept_token(Token::RIGHT_PAREN)) {
+                    operands.push_back(std::move(call));
+                } else {
+                    auto arguments = &call->arguments;
+                    open_group(ExpressionGroup::CALL, Token::RIGHT_PAREN, std::move(call), arguments);
+                }
+                continue;
+            }
+            if (accept_token(Token::DOT)) {
+                Token dot = tokens[i - 1];
+                if (accept_token(Token::IDENTIFIER, true)) {
+                    operands.back() = std::make_unique<MemberAccessNode>(dot.pos, share(std::move(operands.back())), stream.identifier(tokens[i - 1]));
+                }
+                continue;
+            }
 
-    unq_ptr<ExpressionNode> Parser::parse_e10() {
-        // ?:
-        return parse_e9();
-    }
+            // Binary operators are left associative, except for ^
+            int level = binary_level(tokens[i].type);
+            if (level && level <= group.loosest) {
+                while (operators.size() > group.operatorBase && (operators.back().level < level || (operators.back().level == level && level != EXP_LEVEL))) {
+                    reduce(operators, operands);
+                }
+                operators.push_back({tokens[i++], level, false, false});
+                expectOperand = true;
+                continue;
+            }
 
-    unq_ptr<ExpressionNode> Parser::parse_expression(bool required) {
-        unq_ptr<ExpressionNode> node = parse_e10();
-        if (!node && required) {
-            errors.emplace_back(tokens[i].pos, "Expected expression");
+            // ?: is right associative, and its middle operand is parsed up to the matching ':'
+            if (group.loosest >= TERNARY_LEVEL && accept_token(Token::QUESTION)) {
+                while (operators.size() > group.operatorBase && operators.back().level < TERNARY_LEVEL) {
+                    reduce(operators, operands);
+                }
+                operators.push_back({tokens[i - 1], TERNARY_LEVEL, false, false});
+                group.openTernaries++;
+                expectOperand = true;
+                continue;
+            }
+            if (group.openTernaries > 0 && accept_token(Token::COLON)) {
+                while (operators.back().token.type != Token::QUESTION || operators.back().hasElse) {
+                    reduce(operators, operands);
+                }
+                operators.back().hasElse = true;
+                group.openTernaries--;
+                expectOperand = true;
+                continue;
+            }
+
+            // Anything else ends the group
+            while (operators.size() > group.operatorBase) {
+                reduce(operators, operands);
+            }
+            unq_ptr<ExpressionNode> expr = pop(operands);
+            switch (group.kind) {
+                case ExpressionGroup::EXPRESSION:
+                    return expr;
+                case ExpressionGroup::PAREN:
+                    if (accept_token(Token::COMMA)) {
+                        group.kind = ExpressionGroup::POINT;
+                        group.node = std::move(expr);
+                        expectOperand = true;
+                        continue;
+                    }
+                    accept_token(Token::RIGHT_PAREN, true);
+                    break;
+                case ExpressionGroup::POINT:
+                    accept_token(Token::RIGHT_PAREN, true);
+                    expr = std::make_unique<PointNode>(group.token.pos, share(std::move(group.node)), share(std::move(expr)));
+                    break;
+                case ExpressionGroup::ABS:
+                    accept_token(Token::ABS, true);
+                    expr = std::make_unique<UnaryOperatorNode>(group.token.pos, Operator::ABS, share(std::move(expr)));
+                    break;
+                case ExpressionGroup::INDEX:
+                    accept_token(Token::RIGHT_BRACKET, true);
+                    expr = std::make_unique<IndexNode>(group.token.pos, share(std::move(group.node)), share(std::move(expr)));
+                    break;
+                case ExpressionGroup::DERIVATIVE: {
+                    unq_ptr<ExpressionNode> variable;
+                    if (accept_token(Token::COMMA, true) && accept_token(Token::IDENTIFIER, true)) {
+                        variable = std::make_unique<IdentifierNode>(tokens[i - 1].pos, stream.identifier(tokens[i - 1]), currentScope, currentDeclaration);
+                    }
+                    accept_token(Token::RIGHT_PAREN, true);
+                    // The variable is only missing after an error, which ends compilation before the derivative is used
+                    expr = std::make_unique<DerivativeNode>(group.token.pos, share(std::move(expr)), share(std::move(variable)));
+                    break;
+                }
+                case ExpressionGroup::LIST:
+                case ExpressionGroup::INITIALIZER:
+                case ExpressionGroup::CALL:
+                    group.elements->push_back(share(std::move(expr)));
+                    if (!accept_token(group.closer) && accept_token(Token::COMMA, true)) {
+                        expectOperand = true;
+                        continue;
+                    }
+                    // Closed, or kept without the rest of its elements
+                    expr = std::move(group.node);
+                    break;
+            }
+            groups.pop_back();
+            operands.push_back(std::move(expr));
         }
-        return node;
     }
 
     unq_ptr<InitializationStatementNode> Parser::parse_initialization_statement(bool required) {
         long start = i;
         unq_ptr<DeclarationNode> declaration = parse_declaration();
         if (!declaration) {
-            if (required) {errors.emplace_back(tokens[start].pos, "Expected equals statement");}
+            if (required) {error(tokens[start].pos, "Expected equals statement");}
             return nullptr;
         }
 
         accept_token(Token::EQUALS, true);
 
-        currentScope->add_symbol(declaration.get());
+        if (declaration->isFunction()) {
+            auto function = (FunctionDeclarationNode*) declaration.get();
+            std::vector<Type> parameterTypes;
+            for (auto& param : function->parameters) {parameterTypes.push_back(param->type);}
+            function->signature = compiler->signatures.intern(parameterTypes);
+            if (!currentScope->add_symbol(function) && !currentScope->add_overload(function)) {
+                error(function->pos, "'" + std::string(function->identifier) + "' is already declared in this scope (overloaded functions need different parameter types)");
+            }
+        } else {
+            currentScope->add_symbol(declaration.get());
+        }
 
         if (declaration->isFunction()) {
             std::string name {declaration->identifier};
@@ -308,7 +743,10 @@ namespace frontend {
             }
         }
 
+        DeclarationNode* previousDeclaration = currentDeclaration;
+        currentDeclaration = declaration.get();
         unq_ptr<ExpressionNode> value = parse_expression(true);
+        currentDeclaration = previousDeclaration;
 
         if (declaration->isFunction()) {
             currentScope = currentScope->get_parent_scope();
@@ -318,17 +756,348 @@ namespace frontend {
         return std::make_unique<InitializationStatementNode>(std::move(declaration), std::move(value));
     }
 
+    unq_ptr<StructDefinitionNode> Parser::parse_struct_definition(bool required) {
+        if (!accept_token(Token::KW_STRUCT, required)) {
+            return nullptr;
+        }
+
+        Token keyword = tokens[i - 1];
+        if (!accept_token(Token::IDENTIFIER, true)) {
+            return nullptr;
+        }
+
+        auto declaration = std::make_unique<StructDeclarationNode>(keyword.pos, stream.identifier(tokens[i - 1]), currentScope);
+        currentScope->add_symbol(declaration.get());
+        currentScope = currentScope->create_child_scope(std::string(declaration->identifier));
+        declaration->memberScope = currentScope;
+
+        // Parse fields
+        if (accept_token(Token::LEFT_PAREN, true)) {
+            while (!accept_token(Token::RIGHT_PAREN)) {
+                if (!declaration->fields.empty()) {
+                    if (!accept_token(Token::COMMA, true)) { break; }
+                }
+
+                unq_ptr<DeclarationNode> field = parse_declaration(true);
+                if (!field) break;
+                field->parentStruct = declaration.get();
+                field->isPerInstance = true;
+                currentScope->add_symbol(field.get());
+                declaration->fields.push_back(std::move(field));
+            }
+        }
+
+        // Parse members
+        if (accept_token(Token::LEFT_BRACE, true)) {
+            parse_statements(declaration->members, &Parser::parse_initialization_statement);
+            for (auto& member : declaration->members) {
+                member->declaration->parentStruct = declaration.get();
+            }
+            accept_token(Token::RIGHT_BRACE, true);
+        }
+
+        currentScope = currentScope->get_parent_scope();
+        return std::make_unique<StructDefinitionNode>(std::move(declaration));
+    }
+
+    static bool is_assignment(Token::Type type) {
+        switch (type) {
+            case Token::ASSIGN:
+            case Token::PLUS_ASSIGN:
+            case Token::MINUS_ASSIGN:
+            case Token::MUL_ASSIGN:
+            case Token::DIV_ASSIGN:
+            case Token::MOD_ASSIGN:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // The operator applied by a compound assignment, e.g. PLUS for +=
+    static Operator get_compound_operator(Token::Type type) {
+        switch (type) {
+            case Token::PLUS_ASSIGN: return Operator::PLUS;
+            case Token::MINUS_ASSIGN: return Operator::MINUS;
+            case Token::MUL_ASSIGN: return Operator::MUL;
+            case Token::DIV_ASSIGN: return Operator::DIV;
+            case Token::MOD_ASSIGN: return Operator::MOD;
+            default:
+                throw std::runtime_error(std::string("Token is not a compound assignment: ") + Token::NAMES[type]);
+        }
+    }
+
+    unq_ptr<StatementNode> Parser::parse_action_statement(bool required) {
+        // x := expr; x += expr; otherAction; otherAction(args);
+        unq_ptr<ExpressionNode> expr = parse_expression();
+        if (!expr) {
+            if (required) {error(tokens[i].pos, "Expected assignment or action");}
+            return nullptr;
+        }
+
+        if (!is_assignment(tokens[i].type)) {
+            accept_token(Token::SEMICOLON, true);
+            return std::make_unique<ActionCallStatementNode>(expr->pos, std::move(expr));
+        }
+
+        Token op = tokens[i++];
+        unq_ptr<ExpressionNode> value = parse_expression(true);
+        accept_token(Token::SEMICOLON, true);
+
+        auto target = dynamic_cast<IdentifierNode*>(expr.get());
+        if (!target) {
+            error(expr->pos, "Can only assign to variables");
+            return nullptr;
+        }
+        if (!value) {return nullptr;}
+
+        if (op.type != Token::ASSIGN) {
+            auto current = std::make_unique<IdentifierNode>(target->pos, target->identifier, target->scope, target->context);
+            value = std::make_unique<BinaryOperatorNode>(op.pos, get_compound_operator(op.type), std::move(current), std::move(value));
+        }
+        expr.release();
+        return std::make_unique<AssignmentStatementNode>(op.pos, unq_ptr<IdentifierNode>(target), std::move(value));
+    }
+
+    unq_ptr<ActionDefinitionNode> Parser::parse_action_definition(bool required) {
+        if (!accept_token(Token::KW_ACTION, required)) {
+            return nullptr;
+        }
+
+        Token keyword = tokens[i - 1];
+        if (!accept_token(Token::IDENTIFIER, true)) {
+            return nullptr;
+        }
+
+        auto declaration = std::make_unique<ActionDeclarationNode>(keyword.pos, stream.identifier(tokens[i - 1]), currentScope);
+        currentScope->add_symbol(declaration.get());
+        currentScope = currentScope->create_child_scope(std::string(declaration->identifier));
+
+        // Parse parameters
+        if (accept_token(Token::LEFT_PAREN)) {
+            declaration->hasParameters = true;
+            while (!accept_token(Token::RIGHT_PAREN)) {
+                if (!declaration->parameters.empty()) {
+                    if (!accept_token(Token::COMMA, true)) { break; }
+                }
+
+                unq_ptr<DeclarationNode> param = parse_declaration(true);
+                if (!param) break;
+                currentScope->add_symbol(param.get());
+                declaration->parameters.push_back(std::move(param));
+            }
+        }
+
+        accept_token(Token::EQUALS, true);
+
+        DeclarationNode* previousDeclaration = currentDeclaration;
+        currentDeclaration = declaration.get();
+        if (accept_token(Token::LEFT_BRACE)) {
+            parse_statements(declaration->body, &Parser::parse_action_statement);
+            accept_token(Token::RIGHT_BRACE, true);
+        } else {
+            unq_ptr<StatementNode> statement = parse_action_statement(true);
+            if (statement) {declaration->body.push_back(std::move(statement));}
+        }
+        currentDeclaration = previousDeclaration;
+
+        currentScope = currentScope->get_parent_scope();
+        return std::make_unique<ActionDefinitionNode>(std::move(declaration));
+    }
+
+    std::vector<std::pair<Token, unq_ptr<ExpressionNode>>> Parser::parse_attributes() {
+        // <name=value, ...>
+        std::vector<std::pair<Token, unq_ptr<ExpressionNode>>> attributes;
+        if (!accept_token(Token::LESS)) {
+            return attributes;
+        }
+
+        while (!accept_token(Token::GREATER)) {
+            if (!attributes.empty()) {
+                if (!accept_token(Token::COMMA, true)) {break;}
+            }
+
+            if (!accept_token(Token::IDENTIFIER, true)) {break;}
+            Token name = tokens[i - 1];
+            if (!accept_token(Token::EQUALS, true)) {break;}
+
+            // Values are parsed above comparisons so that '>' closes the attribute list
+            unq_ptr<ExpressionNode> value = parse_expression(false, SUM_LEVEL);
+            if (!value) {
+                error(tokens[i].pos, "Expected expression");
+                break;
+            }
+            attributes.emplace_back(name, std::move(value));
+        }
+        return attributes;
+    }
+
+    unq_ptr<TickerNode> Parser::parse_ticker(bool required) {
+        if (!accept_token(Token::KW_TICKER, required)) {
+            return nullptr;
+        }
+
+        Token keyword = tokens[i - 1];
+        unq_ptr<ExpressionNode> action = parse_expression(false, POSTFIX_LEVEL);
+        if (!action) {
+            error(tokens[i].pos, "Expected action");
+            return nullptr;
+        }
+
+        unq_ptr<ExpressionNode> period = nullptr;
+        for (auto& [name, value] : parse_attributes()) {
+            if (stream.identifier(name) == "period") {
+                period = std::move(value);
+            } else {
+                error(name.pos, "Unknown ticker attribute '" + std::string(stream.identifier(name)) + "'");
+            }
+        }
+        accept_token(Token::SEMICOLON, true);
+
+        auto call = std::make_unique<ActionCallStatementNode>(action->pos, std::move(action));
+        return std::make_unique<TickerNode>(keyword.pos, std::move(call), std::move(period));
+    }
+
+    unq_ptr<ImportStatementNode> Parser::parse_import(bool required) {
+        if (!accept_token(Token::KW_IMPORT, required)) {
+            return nullptr;
+        }
+
+        Token keyword = tokens[i - 1];
+        if (!accept_token(Token::IDENTIFIER, true)) {
+            return nullptr;
+        }
+        std::string_view name = stream.identifier(tokens[i - 1]);
+        accept_token(Token::SEMICOLON, true);
+
+        if (currentScope != &compiler->symbolTable) {
+            error(keyword.pos, "Modules can only be imported at the top level");
+            return std::make_unique<ImportStatementNode>(keyword.pos, name, nullptr);
+        }
+
+        // Importing a module twice has no effect
+        for (auto& module : compiler->importedModules) {
+            if (module->get_name() == name) {return std::make_unique<ImportStatementNode>(keyword.pos, name, nullptr);}
+        }
+
+        // Look in the working directory first, then in each module directory
+        std::string fileName = std::string(name) + modules::EXTENSION;
+        std::vector<std::string> paths = {fileName};
+        for (auto& directory : compiler->moduleDirectories) {
+            paths.push_back(directory + "/" + fileName);
+        }
+        std::string message;
+        for (auto& path : paths) {
+            auto module = modules::Module::open(std::string(name), path, keyword.pos, compiler->signatures, message);
+            if (module) {
+                currentScope->import_module(module.get());
+                auto& imported = compiler->importedModules.emplace_back(std::move(module));
+                return std::make_unique<ImportStatementNode>(keyword.pos, name, imported.get());
+            }
+            if (!message.empty()) {break;} // Found, but not a valid module
+        }
+        error(keyword.pos, message.empty() ? "Module not found: '" + std::string(name) + "'" : message);
+        return std::make_unique<ImportStatementNode>(keyword.pos, name, nullptr);
+    }
+
+    unq_ptr<InitializationStatementNode> Parser::parse_for(bool required) {
+        // for i in [start...end] type name = value; declares name as the list of value for each i in the range
+        if (!accept_token(Token::KW_FOR, required)) {
+            return nullptr;
+        }
+
+        Token keyword = tokens[i - 1];
+        if (!accept_token(Token::IDENTIFIER, true)) {
+            return nullptr;
+        }
+        Token name = tokens[i - 1];
+        if (!accept_token(Token::KW_IN, true) || !accept_token(Token::LEFT_BRACKET, true)) {
+            return nullptr;
+        }
+        unq_ptr<ExpressionNode> start = parse_expression(true);
+        accept_token(Token::ELLIPSIS, true);
+        unq_ptr<ExpressionNode> end = parse_expression(true);
+        accept_token(Token::RIGHT_BRACKET, true);
+
+        long declarationStart = i;
+        unq_ptr<DeclarationNode> declaration = parse_declaration(true);
+        if (!declaration) {
+            return nullptr;
+        }
+        if (declaration->isFunction() || !declaration->type.isPrimitive || declaration->type.isList) {
+            error(tokens[declarationStart].pos, "Loops can only declare single values of primitive types, such as 'num' or 'point'");
+            return nullptr;
+        }
+        declaration->type.isList = true;
+        currentScope->add_symbol(declaration.get());
+        accept_token(Token::EQUALS, true);
+
+        // The variable is only visible in the value
+        currentScope = currentScope->create_child_scope();
+        auto variable = std::make_unique<DeclarationNode>(name.pos, Type(Type::NUM), stream.identifier(name), currentScope);
+        currentScope->add_symbol(variable.get());
+        DeclarationNode* previousDeclaration = currentDeclaration;
+        currentDeclaration = declaration.get();
+        unq_ptr<ExpressionNode> body = parse_expression(true);
+        currentDeclaration = previousDeclaration;
+        currentScope = currentScope->get_parent_scope();
+
+        accept_token(Token::SEMICOLON, true);
+        if (!start || !end || !body) {
+            // Kept without a value, since its name has been declared
+            return std::make_unique<InitializationStatementNode>(std::move(declaration), nullptr);
+        }
+        auto value = std::make_unique<ComprehensionNode>(keyword.pos, std::move(variable), share(std::move(start)), share(std::move(end)), share(std::move(body)));
+        return std::make_unique<InitializationStatementNode>(std::move(declaration), std::move(value));
+    }
+
+    unq_ptr<ExpressionNode> Parser::parse_solve(SrcPos pos) {
+        // $solve(left = right) solves for the definition it is the value of, which the equation refers to by name.
+        // Parsed recursively, which is safe since equations can't contain other equations.
+        if (!currentDeclaration) {
+            error(pos, "'$solve' can only be used in a definition, whose name is the unknown");
+        }
+        accept_token(Token::LEFT_PAREN, true);
+
+        // The unknown takes the definition's place in the equation
+        std::string_view name = currentDeclaration ? currentDeclaration->identifier : "";
+        currentScope = currentScope->create_child_scope();
+        auto unknown = std::make_unique<DeclarationNode>(pos, Type(Type::NUM), name, currentScope);
+        if (currentDeclaration) {unknown->type.isConst = currentDeclaration->type.isConst;}
+        currentScope->add_symbol(unknown.get());
+        isSolving = true;
+        unq_ptr<ExpressionNode> left = parse_expression(true);
+        accept_token(Token::EQUALS, true);
+        unq_ptr<ExpressionNode> right = parse_expression(true);
+        isSolving = false;
+        currentScope = currentScope->get_parent_scope();
+        accept_token(Token::RIGHT_PAREN, true);
+
+        // A side is only missing after an error, which ends compilation before the equation is used
+        return std::make_unique<SolveNode>(pos, std::move(unknown), share(std::move(left)), share(std::move(right)), currentDeclaration);
+    }
+
     unq_ptr<StatementNode> Parser::parse_statement(bool required) {
         unq_ptr<StatementNode> node;
 
         if ((node = parse_statement_block())) {
             return node;
+        } else if ((node = parse_struct_definition())) {
+            return node;
+        } else if ((node = parse_action_definition())) {
+            return node;
+        } else if ((node = parse_ticker())) {
+            return node;
+        } else if ((node = parse_import())) {
+            return node;
+        } else if ((node = parse_for())) {
+            return node;
         } else if ((node = parse_initialization_statement())) {
             return node;
         }
 
         if (required) {
-            errors.emplace_back(tokens[i].pos, "Expected statement");
+            error(tokens[i].pos, "Expected statement");
         }
         return nullptr;
     }
@@ -341,17 +1110,7 @@ namespace frontend {
         unq_ptr<StatementBlockNode> node = std::make_unique<StatementBlockNode>(tokens[i - 1].pos);
         currentScope = currentScope->create_child_scope();
 
-        bool flag = true;
-        while (tokens[i].type != Token::RIGHT_BRACE && tokens[i].type != Token::FILE_END) {
-            unq_ptr<StatementNode> statement = parse_statement(flag);
-            if (!statement) {
-                flag = false;
-                i++;
-            } else {
-                flag = true;
-                node->statements.push_back(std::move(statement));
-            }
-        }
+        parse_statements(node->statements, &Parser::parse_statement);
         accept_token(Token::RIGHT_BRACE, true);
 
         return node;
@@ -360,18 +1119,15 @@ namespace frontend {
     unq_ptr<MainBlockNode> Parser::parse_main_block() {
         unq_ptr<MainBlockNode> node = std::make_unique<MainBlockNode>(tokens[i].pos);
 
-        bool flag = true;
         while (tokens[i].type != Token::FILE_END) {
-            unq_ptr<StatementNode> statement = parse_statement(flag);
-            if (!statement) {
-                // If the next statement is invalid, skip until it isn't
-                flag = false;
+            parse_statements(node->statements, &Parser::parse_statement);
+
+            // A '}' without a matching '{'
+            if (tokens[i].type == Token::RIGHT_BRACE) {
+                error(tokens[i].pos, "Unexpected token: " + tokens[i].name());
+                panicking = false;
                 i++;
-            } else {
-                flag = true;
-                node->statements.push_back(std::move(statement));
             }
-
         }
         accept_token(Token::FILE_END, true);
 
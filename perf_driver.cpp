@@ -0,0 +1,251 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <csignal>
+#include <cstdint>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fuzz.h"
+
+// Runs inputs through each frontend phase and flags the ones that crash, time out or take superlinear time.
+// An input is repeated until a run is long enough to time, then timed again at GROWTH times that size, which
+// takes about GROWTH times as long when the work is linear. Every run is in a child process, so that crashes
+// can be caught and peak memory measured per run.
+namespace {
+
+    constexpr double MIN_SECONDS = 0.02; // Shorter runs are too noisy to compare
+    constexpr size_t MAX_BYTES = 1 << 24; // Inputs aren't repeated past this
+    constexpr size_t GROWTH = 4;
+    constexpr double SUPERLINEAR_RATIO = 8; // Growth in time that is flagged, which is n^1.5 for GROWTH = 4
+    constexpr int TIMING_RUNS = 3; // The fastest is used
+
+    struct Run {
+        enum Outcome {OK, CRASHED, TIMED_OUT} outcome = OK;
+        int signal = 0;
+        double seconds = 0;
+        long peakKilobytes = 0;
+    };
+
+    struct Measurement {
+        Run run; // The largest run, or the one that failed
+        size_t bytes = 0; // Of the largest run
+        double growth = 0; // How much longer the largest run took than one GROWTH times smaller, if timed
+        bool isSuperlinear = false;
+
+        bool is_flagged() const {return run.outcome != Run::OK || isSuperlinear;}
+    };
+
+    struct Options {
+        std::vector<fuzz::Phase> phases = {fuzz::Phase::LEX, fuzz::Phase::PARSE, fuzz::Phase::ANALYZE, fuzz::Phase::DIAGNOSTICS};
+        unsigned timeout = 10; // Seconds per run
+        std::string saveDirectory; // Where flagged inputs are copied to, if anywhere
+    };
+
+    std::string repeat(const std::string& input, size_t copies) {
+        if (copies == 1) {return input;}
+        std::string result;
+        result.reserve((input.size() + 1) * copies);
+        for (size_t i = 0; i < copies; i++) {
+            result += input;
+            result += '\n';
+        }
+        return result;
+    }
+
+    Run run_once(fuzz::Phase phase, const std::string& input, unsigned timeout) {
+        int ends[2];
+        if (pipe(ends) != 0) {throw std::runtime_error("Could not create a pipe");}
+        pid_t pid = fork();
+        if (pid < 0) {throw std::runtime_error("Could not start a run");}
+
+        if (pid == 0) {
+            close(ends[0]);
+            alarm(timeout);
+            auto start = std::chrono::steady_clock::now();
+            fuzz::run_phase(phase, input);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            _exit(write(ends[1], &seconds, sizeof(seconds)) == sizeof(seconds) ? 0 : 1);
+        }
+
+        close(ends[1]);
+        Run result;
+        bool isTimed = read(ends[0], &result.seconds, sizeof(result.seconds)) == sizeof(result.seconds);
+        close(ends[0]);
+
+        int status = 0;
+        rusage usage = {};
+        wait4(pid, &status, 0, &usage);
+        result.peakKilobytes = usage.ru_maxrss;
+        if (WIFSIGNALED(status)) {
+            result.signal = WTERMSIG(status);
+            result.outcome = result.signal == SIGALRM ? Run::TIMED_OUT : Run::CRASHED;
+        } else if (WEXITSTATUS(status) != 0 || !isTimed) {
+            // Sanitizers report errors by exiting
+            result.outcome = Run::CRASHED;
+        }
+        return result;
+    }
+
+    Run run_fastest(fuzz::Phase phase, const std::string& input, unsigned timeout) {
+        Run fastest = run_once(phase, input, timeout);
+        for (int i = 1; i < TIMING_RUNS && fastest.outcome == Run::OK; i++) {
+            Run next = run_once(phase, input, timeout);
+            if (next.outcome != Run::OK || next.seconds < fastest.seconds) {fastest = next;}
+        }
+        return fastest;
+    }
+
+    Measurement measure(fuzz::Phase phase, const std::string& input, const Options& options) {
+        Measurement result;
+        size_t copies = 1;
+        result.bytes = input.size();
+        result.run = run_once(phase, input, options.timeout);
+
+        // Long enough to time
+        size_t copyBytes = input.size() + 1;
+        while (result.run.outcome == Run::OK && result.run.seconds < MIN_SECONDS && copyBytes * copies * 2 * GROWTH <= MAX_BYTES) {
+            copies *= 2;
+            std::string repeated = repeat(input, copies);
+            result.bytes = repeated.size();
+            result.run = run_once(phase, repeated, options.timeout);
+        }
+        if (result.run.outcome != Run::OK || result.run.seconds < MIN_SECONDS) {return result;}
+
+        Run base = run_fastest(phase, repeat(input, copies), options.timeout);
+        std::string large = repeat(input, copies * GROWTH);
+        result.bytes = large.size();
+        result.run = run_fastest(phase, large, options.timeout);
+        if (result.run.outcome == Run::OK && base.outcome == Run::OK) {
+            result.growth = result.run.seconds / base.seconds;
+            result.isSuperlinear = result.growth > SUPERLINEAR_RATIO;
+        }
+        return result;
+    }
+
+    std::string describe(const Measurement& measurement) {
+        switch (measurement.run.outcome) {
+            case Run::CRASHED:
+                return measurement.run.signal ? "CRASHED (signal " + std::to_string(measurement.run.signal) + ")" : "CRASHED";
+            case Run::TIMED_OUT:
+                return "TIMED OUT";
+            default:
+                return measurement.isSuperlinear ? "SUPERLINEAR" : "ok";
+        }
+    }
+
+    // Names saved inputs by their contents, so that saving one again doesn't add a copy
+    uint64_t hash_input(const std::string& input) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : input) {
+            hash = (hash ^ (uint8_t) c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void save(const std::string& input, fuzz::Phase phase, const std::string& directory) {
+        std::stringstream name;
+        name << fuzz::PHASE_NAMES[(int) phase] << "-" << std::hex << std::setw(16) << std::setfill('0') << hash_input(input) << ".des";
+        std::filesystem::path path = std::filesystem::path(directory) / name.str();
+        std::ofstream out(path, std::ios_base::out | std::ios_base::binary);
+        out << input;
+        std::cout << "  saved to " << path.string() << std::endl;
+    }
+
+    void print_usage(const char* program) {
+        std::cerr << "Usage: " << program << " [--phase lex|parse|analyze|diagnostics] [--timeout seconds] [--save directory] inputs..." << std::endl;
+        std::cerr << "Inputs are files, or directories of files. Exits with 1 if any input is flagged." << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    std::vector<std::filesystem::path> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--phase" && i + 1 < argc) {
+            std::string_view name = argv[++i];
+            auto phase = std::find(std::begin(fuzz::PHASE_NAMES), std::end(fuzz::PHASE_NAMES), name);
+            if (phase == std::end(fuzz::PHASE_NAMES)) {
+                std::cerr << "Error: Unknown phase: " << name << std::endl;
+                return 1;
+            }
+            options.phases = {(fuzz::Phase) (phase - std::begin(fuzz::PHASE_NAMES))};
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            char* end;
+            long timeout = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || timeout <= 0) {
+                std::cerr << "Error: Invalid timeout: " << argv[i] << std::endl;
+                return 1;
+            }
+            options.timeout = (unsigned) timeout;
+        } else if (arg == "--save" && i + 1 < argc) {
+            options.saveDirectory = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            print_usage(argv[0]);
+            return 1;
+        } else if (std::filesystem::is_directory(arg)) {
+            size_t first = inputs.size();
+            for (auto& entry : std::filesystem::directory_iterator(arg)) {
+                if (entry.is_regular_file()) {inputs.push_back(entry.path());}
+            }
+            std::sort(inputs.begin() + (long) first, inputs.end());
+        } else {
+            inputs.emplace_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    size_t flagged = 0;
+    for (auto& path : inputs) {
+        std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open " << path.string() << std::endl;
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string input = buffer.str();
+
+        for (auto phase : options.phases) {
+            Measurement measurement = measure(phase, input, options);
+            std::cout << std::left << std::setw(40) << path.filename().string() << std::setw(12) << fuzz::PHASE_NAMES[(int) phase] << std::right
+                      << std::setw(10) << measurement.bytes << " B" << std::setw(10) << std::fixed << std::setprecision(1)
+                      << (measurement.bytes ? measurement.run.seconds * 1e9 / (double) measurement.bytes : 0) << " ns/B";
+            if (measurement.growth > 0) {
+                std::cout << std::setw(7) << std::setprecision(2) << measurement.growth << "x per " << GROWTH << "x";
+            } else {
+                std::cout << std::setw(16) << "";
+            }
+            std::cout << std::setw(10) << measurement.run.peakKilobytes << " KB  " << describe(measurement) << std::endl;
+
+            if (measurement.is_flagged()) {
+                flagged++;
+                if (!options.saveDirectory.empty()) {save(input, phase, options.saveDirectory);}
+            }
+        }
+    }
+
+    if (flagged) {
+        std::cout << flagged << " flagged" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,569 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+#include "compiler.h"
+#include "frontend.h"
+#include "ast.h"
+#include "visitor.h"
+#include "builtins.h"
+
+using namespace AST;
+
+// Finds the range of values every num and bool expression can take, from literals, constants and what each
+// operator does. Sliders, whatever actions and the ticker assign, and function parameters can take any value.
+// A conditional whose condition always or never holds has a branch that is never taken, which is warned about.
+// When simplifying, that conditional is replaced by its taken branch, and absolute values, ors, mods and comparisons
+// that can't change their operand's value are dropped, as are the numbers a min or max never picks (e.g. clamps that
+// are never reached), since Desmos evaluates them on every update.
+namespace {
+
+    constexpr double INF = std::numeric_limits<double>::infinity();
+
+    // Every value an expression takes, or that every element of a list takes, lies between lo and hi
+    struct Range {
+        double lo = -INF;
+        double hi = INF;
+        bool isDefined = false; // Whether the value is never undefined
+
+        static Range of(double value) {
+            if (std::isnan(value)) {return {};}
+            return {value, value, true};
+        }
+
+        static Range between(double lo, double hi, bool isDefined) {
+            if (std::isnan(lo)) {lo = -INF;}
+            if (std::isnan(hi)) {hi = INF;}
+            return {lo, hi, isDefined};
+        }
+
+        static Range boolean(bool isDefined) {return {0, 1, isDefined};}
+
+        bool is(double value) const {return isDefined && lo == value && hi == value;}
+        bool contains(double value) const {return lo <= value && value <= hi;}
+    };
+
+    Range span(const Range& a, const Range& b) {
+        return {std::min(a.lo, b.lo), std::max(a.hi, b.hi), a.isDefined && b.isDefined};
+    }
+
+    // Zero times an unbounded end is still zero, since the values themselves are finite
+    double times(double a, double b) {
+        return a == 0 || b == 0 ? 0 : a * b;
+    }
+
+    Range multiply(const Range& a, const Range& b) {
+        double corners[4] = {times(a.lo, b.lo), times(a.lo, b.hi), times(a.hi, b.lo), times(a.hi, b.hi)};
+        return {*std::min_element(corners, corners + 4), *std::max_element(corners, corners + 4), a.isDefined && b.isDefined};
+    }
+
+    Range divide(const Range& a, const Range& b) {
+        if (b.contains(0)) {return {};}
+        return multiply(a, Range {1 / b.hi, 1 / b.lo, b.isDefined});
+    }
+
+    // Desmos' mod takes the sign of the divisor
+    Range modulo(const Range& a, const Range& b) {
+        if (b.lo > 0) {return {0, b.hi, a.isDefined && b.isDefined};}
+        if (b.hi < 0) {return {b.lo, 0, a.isDefined && b.isDefined};}
+        return {};
+    }
+
+    Range power(const Range& base, const Range& exponent) {
+        bool isDefined = base.isDefined && exponent.isDefined;
+        if (!exponent.isDefined || exponent.lo != exponent.hi) {
+            // Positive bases stay positive
+            return base.lo > 0 ? Range {0, INF, isDefined} : Range {};
+        }
+
+        double e = exponent.lo;
+        if (e == 0) {return Range::of(1);}
+        if (base.lo >= 0) {
+            if (e > 0) {return Range::between(std::pow(base.lo, e), std::pow(base.hi, e), isDefined);}
+            if (base.lo > 0) {return Range::between(std::pow(base.hi, e), std::pow(base.lo, e), isDefined);}
+            return {0, INF, false};
+        }
+        if (e != std::floor(e) || e < 0) {return {};}
+
+        if (std::fmod(e, 2) != 0) {return Range::between(std::pow(base.lo, e), std::pow(base.hi, e), isDefined);}
+        double nearest = base.contains(0) ? 0 : std::min(std::abs(base.lo), std::abs(base.hi));
+        double farthest = std::max(std::abs(base.lo), std::abs(base.hi));
+        return Range::between(std::pow(nearest, e), std::pow(farthest, e), isDefined);
+    }
+
+    // 1 if it always holds, 0 if it never does. Undefined operands make a comparison fail in some places and
+    // hold in others (see emit_condition in backend.cpp), so it is only decided when both are defined.
+    Range compare(Operator op, const Range& a, const Range& b) {
+        if (!a.isDefined || !b.isDefined) {return Range::boolean(true);}
+        bool holds, fails;
+        switch (op) {
+            case Operator::LESS: holds = a.hi < b.lo; fails = a.lo >= b.hi; break;
+            case Operator::GREATER: holds = a.lo > b.hi; fails = a.hi <= b.lo; break;
+            case Operator::LESS_EQUAL: holds = a.hi <= b.lo; fails = a.lo > b.hi; break;
+            case Operator::GREATER_EQUAL: holds = a.lo >= b.hi; fails = a.hi < b.lo; break;
+            case Operator::EQUAL_EQUAL:
+            case Operator::NOT_EQUAL:
+                holds = a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+                fails = a.hi < b.lo || b.hi < a.lo;
+                if (op == Operator::NOT_EQUAL) {std::swap(holds, fails);}
+                break;
+            default:
+                return Range::boolean(true);
+        }
+        if (holds) {return Range::of(1);}
+        if (fails) {return Range::of(0);}
+        return Range::boolean(true);
+    }
+
+    // Of a builtin's value, from the ranges of its arguments
+    Range builtin_range(const builtins::Builtin* builtin, const Range* arguments, size_t count) {
+        std::string_view name = builtin->name;
+        if (name == "min" || name == "max") {
+            Range result = arguments[0];
+            if (!builtin->is_variadic(count)) {
+                // An element of the list, which is undefined if it is empty
+                result.isDefined = false;
+                return result;
+            }
+            for (size_t i = 1; i < count; i++) {
+                const Range& x = arguments[i];
+                result = name == "max" ? Range {std::max(result.lo, x.lo), std::max(result.hi, x.hi), result.isDefined && x.isDefined}
+                                       : Range {std::min(result.lo, x.lo), std::min(result.hi, x.hi), result.isDefined && x.isDefined};
+            }
+            return result;
+        }
+        if (name == "mod") {return modulo(arguments[0], arguments[1]);}
+        if (name == "floor" || name == "ceil" || name == "round" || name == "sign" || name == "exp" || name == "arctan"
+            || name == "sinh" || name == "tanh") {
+            // Increasing, so the ends of the argument's range give the ends of the value's
+            return Range::between(builtin->evaluate(&arguments[0].lo), builtin->evaluate(&arguments[0].hi), arguments[0].isDefined);
+        }
+        if (name == "sqrt" || name == "ln" || name == "log") {
+            // Also increasing, but only defined for positive numbers (and 0, for sqrt)
+            const Range& x = arguments[0];
+            double lo = std::max(x.lo, 0.0);
+            return Range::between(builtin->evaluate(&lo), builtin->evaluate(&x.hi), x.isDefined && (name == "sqrt" ? x.lo >= 0 : x.lo > 0));
+        }
+        if (name == "sin" || name == "cos") {return {-1, 1, arguments[0].isDefined};}
+        if (name == "mean") {return {arguments[0].lo, arguments[0].hi, false};}
+        if (name == "length") {return {0, INF, true};}
+        if (name == "random") {return {0, 1, true};}
+        return {};
+    }
+
+    bool is_comparison(Operator op) {
+        return op >= Operator::LESS && op <= Operator::NOT_EQUAL;
+    }
+
+    // A literal, or a negated one
+    bool is_number(const ExpressionNode* node) {
+        if (node->kind == NodeKind::UNARY_OPERATOR && ((const UnaryOperatorNode*) node)->op == Operator::MINUS) {
+            node = ((const UnaryOperatorNode*) node)->expr.get();
+        }
+        return node->kind == NodeKind::LITERAL;
+    }
+
+    bool is_same_value(const ExpressionNode* a, const ExpressionNode* b) {
+        if (a == b) {return true;}
+        if (a->kind != NodeKind::IDENTIFIER || b->kind != NodeKind::IDENTIFIER) {return false;}
+        auto declaration = ((const IdentifierNode*) a)->declaration;
+        return declaration && declaration == ((const IdentifierNode*) b)->declaration;
+    }
+
+    // Replaces the expression in a slot with one of its own subexpressions
+    void replace_with(unq_ptr<ExpressionNode>& slot, unq_ptr<ExpressionNode>& child) {
+        ExpressionNode* replacement = child.get();
+        if (slot->owners > 1) {
+            // Other parents still hold the expression, and it still holds the subexpression
+            replacement->owners++;
+            slot->owners--;
+            slot.release();
+        } else {
+            child.release();
+            slot.reset();
+        }
+        slot.reset(replacement);
+    }
+
+    void replace_with_constant(unq_ptr<ExpressionNode>& slot, double value) {
+        auto literal = std::make_unique<LiteralNode>(slot->pos, slot->type, value);
+        if (slot->owners > 1) {
+            slot->owners--;
+            slot.release();
+        }
+        slot = std::move(literal);
+    }
+
+    class RangeAnalyzer {
+        Compiler* compiler;
+        bool isSimplifying;
+        // Sliders, which are always defined, and variables assigned by actions and the ticker, which may not be
+        std::unordered_map<const DeclarationNode*, bool> unbounded;
+        std::unordered_map<const DeclarationNode*, Range> declarations; // Of values, and of function bodies
+        std::unordered_map<const ExpressionNode*, Range> ranges; // Of every subexpression analyzed so far
+        std::vector<Error> warnings;
+
+        void find_unbounded() {
+            for (auto& statement : compiler->ast->statements) {
+                if (auto initialization = dynamic_cast<const InitializationStatementNode*>(statement.get())) {
+                    auto declaration = initialization->declaration.get();
+                    // Desmos gives a definition of a plain number a slider
+                    if (!declaration->type.isConst && !declaration->isFunction() && is_number(initialization->value.get())) {
+                        unbounded.try_emplace(declaration, true);
+                    }
+                } else if (auto action = dynamic_cast<const ActionDefinitionNode*>(statement.get())) {
+                    for (auto& [variable, value] : action->declaration->assignments) {unbounded[variable] = false;}
+                }
+            }
+            if (auto dispatch = compiler->ast->tickerSchedule.dispatch.get()) {
+                for (auto& [variable, value] : dispatch->assignments) {unbounded[variable] = false;}
+            }
+        }
+
+        Range declaration_range(const DeclarationNode* declaration) const {
+            auto it = declarations.find(declaration);
+            return it == declarations.end() ? Range {} : it->second;
+        }
+
+        // From the ranges of the subexpressions, in the order for_each_slot gives them
+        Range find_range(const ExpressionNode* node, const Range* children) const {
+            if (node->type.isUnknown || !(node->type.element().matches_primitive(Type::NUM) || node->type.element().matches_primitive(Type::BOOL))) {
+                return {};
+            }
+            switch (node->kind) {
+                case NodeKind::LITERAL:
+                    return Range::of(((const LiteralNode*) node)->value);
+                case NodeKind::IDENTIFIER:
+                    return declaration_range(((const IdentifierNode*) node)->declaration);
+                case NodeKind::LIST: {
+                    size_t count = ((const ListNode*) node)->elements.size();
+                    if (count == 0) {return {};}
+                    Range result = children[0];
+                    for (size_t i = 1; i < count; i++) {result = span(result, children[i]);}
+                    return result;
+                }
+                case NodeKind::INDEX: {
+                    // Out of range indices are undefined
+                    Range result = children[0];
+                    result.isDefined = false;
+                    return result;
+                }
+                case NodeKind::CALL: {
+                    auto call = (const CallNode*) node;
+                    if (auto builtin = call->builtin()) {return builtin_range(builtin, children, call->arguments.size());}
+                    // Parameters can take any value, so the body's range holds for every call
+                    return declaration_range(((const IdentifierNode*) call->function.get())->declaration);
+                }
+                case NodeKind::BINARY_OPERATOR: {
+                    auto binop = (const BinaryOperatorNode*) node;
+                    const Range& l = children[0];
+                    const Range& r = children[1];
+                    switch (binop->op) {
+                        case Operator::PLUS: return Range::between(l.lo + r.lo, l.hi + r.hi, l.isDefined && r.isDefined);
+                        case Operator::MINUS: return Range::between(l.lo - r.hi, l.hi - r.lo, l.isDefined && r.isDefined);
+                        case Operator::MUL:
+                            // x * x can't be negative, even though x can be
+                            if (is_same_value(binop->left.get(), binop->right.get())) {return power(l, Range::of(2));}
+                            return multiply(l, r);
+                        case Operator::AND:
+                            return multiply(l, r);
+                        case Operator::DIV: return divide(l, r);
+                        case Operator::MOD: return modulo(l, r);
+                        case Operator::EXP: return power(l, r);
+                        case Operator::OR: return {std::max(l.lo, r.lo), std::max(l.hi, r.hi), l.isDefined && r.isDefined};
+                        default: return is_comparison(binop->op) ? compare(binop->op, l, r) : Range {};
+                    }
+                }
+                case NodeKind::UNARY_OPERATOR: {
+                    const Range& value = children[0];
+                    switch (((const UnaryOperatorNode*) node)->op) {
+                        case Operator::MINUS: return {-value.hi, -value.lo, value.isDefined};
+                        case Operator::INVERT: return {1 - value.hi, 1 - value.lo, value.isDefined};
+                        case Operator::ABS:
+                            if (value.lo >= 0) {return value;}
+                            if (value.hi <= 0) {return {-value.hi, -value.lo, value.isDefined};}
+                            return {0, std::max(-value.lo, value.hi), value.isDefined};
+                        default: return {};
+                    }
+                }
+                case NodeKind::COMPREHENSION:
+                    // Of the elements, which are the body's values (or the unrolled list's)
+                    return ((const ComprehensionNode*) node)->unrolled ? children[0] : children[2];
+                case NodeKind::SOLVE: {
+                    // A regression can be fit to any value
+                    auto solve = (const SolveNode*) node;
+                    return solve->root ? Range::of(*solve->root) : Range {};
+                }
+                case NodeKind::DERIVATIVE:
+                    // Of the derivative, which is all that's left of the expression
+                    return children[0];
+                case NodeKind::TERNARY_OPERATOR: {
+                    const Range& condition = children[0];
+                    bool hasElse = ((const TernaryOperatorNode*) node)->ifFalse != nullptr;
+                    if (condition.is(1)) {return children[1];}
+                    if (condition.is(0)) {return hasElse ? children[2] : Range {};}
+                    if (!hasElse) {
+                        Range result = children[1];
+                        result.isDefined = false;
+                        return result;
+                    }
+                    return span(children[1], children[2]);
+                }
+                default:
+                    return {};
+            }
+        }
+
+        // The variable of a comprehension takes every value between the bounds, if they are constant
+        void bind_variable(const ComprehensionNode* comprehension) {
+            std::optional<double> first = comprehension->start->constant_value(), last = comprehension->end->constant_value();
+            if (!first || !last) {return;}
+            declarations[comprehension->variable.get()] = Range::between(std::min(*first, *last), std::max(*first, *last), true);
+        }
+
+        void check_branches(const TernaryOperatorNode* ternary, const Range& condition) {
+            if (condition.is(1) && ternary->ifFalse) {
+                warnings.emplace_back(ternary->ifFalse->pos, "Branch is never taken, since its condition always holds");
+            } else if (condition.is(0)) {
+                warnings.emplace_back(ternary->ifTrue->pos, "Branch is never taken, since its condition never holds");
+            }
+        }
+
+        // Finds the range of every subexpression, children first, without recursing. Only those of shared
+        // subexpressions are kept, unless simplifying.
+        Range analyze(const ExpressionNode* root) {
+            std::vector<std::pair<const ExpressionNode*, bool>> stack = {{root, false}}; // (node, whether its children are done)
+            std::vector<Range> values; // Of the subexpressions done so far whose parents aren't
+            while (!stack.empty()) {
+                auto [node, isExpanded] = stack.back();
+                if (isExpanded) {
+                    stack.pop_back();
+                    size_t count = 0;
+                    for_each_slot((ExpressionNode*) node, [&](unq_ptr<ExpressionNode>&) {count++;});
+                    const Range* children = values.data() + values.size() - count;
+                    Range range = find_range(node, children);
+                    if (node->kind == NodeKind::TERNARY_OPERATOR) {check_branches((const TernaryOperatorNode*) node, children[0]);}
+                    values.resize(values.size() - count);
+                    values.push_back(range);
+                    if (isSimplifying || is_shared(node)) {ranges[node] = range;}
+                    continue;
+                }
+                if (is_shared(node)) {
+                    if (auto it = ranges.find(node); it != ranges.end()) {
+                        stack.pop_back();
+                        values.push_back(it->second);
+                        continue;
+                    }
+                }
+                if (node->kind == NodeKind::COMPREHENSION) {bind_variable((const ComprehensionNode*) node);}
+                stack.back().second = true;
+                size_t first = stack.size();
+                for_each_slot((ExpressionNode*) node, [&](unq_ptr<ExpressionNode>& child) {stack.emplace_back(child.get(), false);});
+                std::reverse(stack.begin() + (long) first, stack.end());
+            }
+            return values.back();
+        }
+
+        // The numbers a min or max picks from, which are its arguments or the elements of a list written in the call
+        // (unless the list is shared, since other parents still need all of it)
+        static std::vector<unq_ptr<ExpressionNode>>* find_candidates(ExpressionNode* node, bool& isMax) {
+            if (node->kind != NodeKind::CALL || node->type.isList) {return nullptr;}
+            auto call = (CallNode*) node;
+            auto builtin = call->builtin();
+            if (!builtin || (builtin->name != "min" && builtin->name != "max")) {return nullptr;}
+            isMax = builtin->name == "max";
+            if (builtin->is_variadic(call->arguments.size())) {return &call->arguments;}
+            auto list = call->arguments[0].get();
+            if (list->kind != NodeKind::LIST || list->owners > 1) {return nullptr;}
+            return &((ListNode*) list)->elements;
+        }
+
+        // Whether each candidate is never picked, because one of the others that is kept always wins over it.
+        // Undefined candidates make the result undefined, so only defined ones are dropped.
+        std::vector<bool> find_losers(const std::vector<unq_ptr<ExpressionNode>>& candidates, bool isMax) const {
+            std::vector<bool> isLoser(candidates.size(), false);
+            for (size_t j = 0; j < candidates.size(); j++) {
+                const Range& loser = ranges.at(candidates[j].get());
+                if (!loser.isDefined) {continue;}
+                for (size_t i = 0; i < candidates.size() && !isLoser[j]; i++) {
+                    const Range& winner = ranges.at(candidates[i].get());
+                    isLoser[j] = i != j && !isLoser[i] && (isMax ? winner.lo >= loser.hi : winner.hi <= loser.lo);
+                }
+            }
+            return isLoser;
+        }
+
+        // Drops the candidates of a min or max that are never picked, as long as it still has two
+        void drop_losers(ExpressionNode* node) {
+            bool isMax = false;
+            auto candidates = find_candidates(node, isMax);
+            if (!candidates) {return;}
+            std::vector<bool> isLoser = find_losers(*candidates, isMax);
+            if (std::count(isLoser.begin(), isLoser.end(), false) < 2) {return;}
+            for (size_t i = candidates->size(); i-- > 0;) {
+                if (!isLoser[i]) {continue;}
+                unq_ptr<ExpressionNode>& candidate = (*candidates)[i];
+                if (candidate->owners > 1) {
+                    candidate->owners--;
+                    candidate.release();
+                }
+                candidates->erase(candidates->begin() + (long) i);
+            }
+        }
+
+        // The subexpression that always has the same value as the one in the slot, if there is one
+        unq_ptr<ExpressionNode>* find_redundancy(ExpressionNode* node) {
+            auto same_type = [node](const unq_ptr<ExpressionNode>& replacement) {
+                return !node->type.isUnknown && replacement->type.isList == node->type.isList && node->type.matches(replacement->type);
+            };
+            switch (node->kind) {
+                case NodeKind::UNARY_OPERATOR: {
+                    auto unop = (UnaryOperatorNode*) node;
+                    if (unop->op == Operator::ABS && ranges.at(unop->expr.get()).lo >= 0) {return &unop->expr;}
+                    return nullptr;
+                }
+                case NodeKind::BINARY_OPERATOR: {
+                    auto binop = (BinaryOperatorNode*) node;
+                    const Range& l = ranges.at(binop->left.get());
+                    const Range& r = ranges.at(binop->right.get());
+                    switch (binop->op) {
+                        case Operator::OR:
+                            // One side always decides, e.g. when the other never holds
+                            if (r.isDefined && l.lo >= r.hi && same_type(binop->left)) {return &binop->left;}
+                            if (l.isDefined && r.lo >= l.hi && same_type(binop->right)) {return &binop->right;}
+                            return nullptr;
+                        case Operator::AND:
+                            if (r.is(1) && same_type(binop->left)) {return &binop->left;}
+                            if (l.is(1) && same_type(binop->right)) {return &binop->right;}
+                            return nullptr;
+                        case Operator::MOD:
+                            if (r.isDefined && l.lo >= 0 && l.hi < r.lo && same_type(binop->left)) {return &binop->left;}
+                            return nullptr;
+                        default:
+                            return nullptr;
+                    }
+                }
+                case NodeKind::CALL: {
+                    // A min or max that one candidate always wins
+                    bool isMax = false;
+                    auto candidates = find_candidates(node, isMax);
+                    if (!candidates) {return nullptr;}
+                    std::vector<bool> isLoser = find_losers(*candidates, isMax);
+                    if (std::count(isLoser.begin(), isLoser.end(), false) != 1) {return nullptr;}
+                    auto& winner = (*candidates)[std::find(isLoser.begin(), isLoser.end(), false) - isLoser.begin()];
+                    return same_type(winner) ? &winner : nullptr;
+                }
+                case NodeKind::TERNARY_OPERATOR: {
+                    auto ternary = (TernaryOperatorNode*) node;
+                    const Range& condition = ranges.at(ternary->condition.get());
+                    if (condition.is(1) && same_type(ternary->ifTrue)) {return &ternary->ifTrue;}
+                    if (condition.is(0) && ternary->ifFalse && same_type(ternary->ifFalse)) {return &ternary->ifFalse;}
+                    return nullptr;
+                }
+                default:
+                    return nullptr;
+            }
+        }
+
+        // Top down, so that whatever is dropped isn't simplified first
+        void simplify(unq_ptr<ExpressionNode>& root, bool isDefinition) {
+            // Each slot, and whether it is in the condition of a ternary that was kept
+            std::vector<std::pair<unq_ptr<ExpressionNode>*, bool>> stack = {{&root, false}};
+            while (!stack.empty()) {
+                auto [top, isCondition] = stack.back();
+                unq_ptr<ExpressionNode>& slot = *top;
+                stack.pop_back();
+
+                // Desmos would make a definition that is simplified to a plain number a slider
+                bool mayBecomeNumber = &slot != &root || !isDefinition;
+                auto redundant = find_redundancy(slot.get());
+                if (redundant && (mayBecomeNumber || !is_number(redundant->get()))) {
+                    replace_with(slot, *redundant);
+                    stack.push_back({&slot, isCondition});
+                    continue;
+                }
+                // Kept, so only its taken branch is left to simplify
+                if (slot->kind == NodeKind::TERNARY_OPERATOR) {
+                    auto ternary = (TernaryOperatorNode*) slot.get();
+                    const Range& condition = ranges.at(ternary->condition.get());
+                    if (condition.is(1) || (condition.is(0) && ternary->ifFalse)) {
+                        stack.push_back({condition.is(1) ? &ternary->ifTrue : &ternary->ifFalse, isCondition});
+                        continue;
+                    }
+                    // A decided condition with no branch for it would be left as a comparison of constants
+                    stack.push_back({&ternary->condition, true});
+                    stack.push_back({&ternary->ifTrue, isCondition});
+                    if (ternary->ifFalse) {stack.push_back({&ternary->ifFalse, isCondition});}
+                    continue;
+                }
+                // Comparisons that are decided, outside of conditions
+                if (mayBecomeNumber && !isCondition && slot->kind == NodeKind::BINARY_OPERATOR && is_comparison(((BinaryOperatorNode*) slot.get())->op) && !slot->type.isList) {
+                    const Range& range = ranges.at(slot.get());
+                    if (range.is(0) || range.is(1)) {
+                        double value = range.lo;
+                        replace_with_constant(slot, value);
+                        ranges[slot.get()] = Range::of(value);
+                        continue;
+                    }
+                }
+                drop_losers(slot.get());
+                for_each_slot(slot.get(), [&](unq_ptr<ExpressionNode>& child) {stack.push_back({&child, isCondition});});
+            }
+        }
+
+        // Returns the range of the expression
+        Range process(unq_ptr<ExpressionNode>& root, bool isDefinition = false) {
+            Range result = analyze(root.get());
+            if (isSimplifying) {simplify(root, isDefinition);}
+            return result;
+        }
+
+    public:
+        RangeAnalyzer(Compiler* compiler, bool isSimplifying) : compiler(compiler), isSimplifying(isSimplifying), unbounded(), declarations(), ranges(), warnings() {}
+
+        // Declarations are emitted after what they depend on, so their ranges are known before they are used
+        void run(std::string& source) {
+            find_unbounded();
+
+            MainBlockNode& ast = *compiler->ast;
+            std::unordered_map<const StatementNode*, StatementNode*> statements;
+            for (auto& statement : ast.statements) {
+                statements[statement.get()] = statement.get();
+            }
+
+            for (auto emitted : ast.emissionOrder) {
+                StatementNode* statement = statements[emitted];
+                if (auto initialization = dynamic_cast<InitializationStatementNode*>(statement)) {
+                    if (initialization->value->kind == NodeKind::STRUCT_INITIALIZER) {continue;}
+                    DeclarationNode* declaration = initialization->declaration.get();
+                    Range range = process(initialization->value, !declaration->type.isConst);
+                    declaration->value = initialization->value.get();
+                    if (auto it = unbounded.find(declaration); it != unbounded.end()) {
+                        range = {-INF, INF, it->second};
+                    }
+                    declarations[declaration] = range;
+                } else if (auto action = dynamic_cast<ActionDefinitionNode*>(statement)) {
+                    for (auto& [variable, value] : action->declaration->assignments) {process(value);}
+                }
+            }
+            if (auto dispatch = ast.tickerSchedule.dispatch.get()) {
+                for (auto& [variable, value] : dispatch->assignments) {process(value);}
+            }
+
+            if (!warnings.empty()) {
+                // Found top down, so sorted back into the order they appear in
+                std::stable_sort(warnings.begin(), warnings.end(), [](const Error& a, const Error& b) {return a.pos.i < b.pos.i;});
+                frontend::print_diagnostics(warnings, source, false);
+            }
+        }
+    };
+}
+
+void Compiler::narrow_ranges(std::string& source, bool simplify) {
+    RangeAnalyzer(this, simplify).run(source);
+}
@@ -0,0 +1,634 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <cmath>
+#include <limits>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "sampler.h"
+#include "ast.h"
+#include "builtins.h"
+
+using namespace AST;
+using namespace sampler;
+
+static constexpr double UNDEFINED = std::numeric_limits<double>::quiet_NaN();
+
+// Operations on as many doubles at once as the target's vector registers hold.
+// Comparisons give 1 or 0 like bools do, and are false if either side is undefined.
+namespace simd {
+#if defined(__AVX2__)
+    using Lanes = __m256d;
+    constexpr size_t WIDTH = 4;
+
+    inline Lanes load(const double* p) {return _mm256_loadu_pd(p);}
+    inline void store(double* p, Lanes v) {_mm256_storeu_pd(p, v);}
+    inline Lanes splat(double x) {return _mm256_set1_pd(x);}
+    inline Lanes add(Lanes a, Lanes b) {return _mm256_add_pd(a, b);}
+    inline Lanes sub(Lanes a, Lanes b) {return _mm256_sub_pd(a, b);}
+    inline Lanes mul(Lanes a, Lanes b) {return _mm256_mul_pd(a, b);}
+    inline Lanes div(Lanes a, Lanes b) {return _mm256_div_pd(a, b);}
+    inline Lanes floor(Lanes a) {return _mm256_floor_pd(a);}
+    inline Lanes max(Lanes a, Lanes b) {
+        // Undefined if either side is, like Desmos
+        return _mm256_blendv_pd(_mm256_max_pd(a, b), splat(UNDEFINED), _mm256_cmp_pd(a, b, _CMP_UNORD_Q));
+    }
+    inline Lanes neg(Lanes a) {return _mm256_xor_pd(a, splat(-0.0));}
+    inline Lanes abs(Lanes a) {return _mm256_andnot_pd(splat(-0.0), a);}
+
+    template <int PREDICATE>
+    inline Lanes compare(Lanes a, Lanes b) {return _mm256_and_pd(_mm256_cmp_pd(a, b, PREDICATE), splat(1));}
+    inline Lanes less(Lanes a, Lanes b) {return compare<_CMP_LT_OQ>(a, b);}
+    inline Lanes greater(Lanes a, Lanes b) {return compare<_CMP_GT_OQ>(a, b);}
+    inline Lanes less_equal(Lanes a, Lanes b) {return compare<_CMP_LE_OQ>(a, b);}
+    inline Lanes greater_equal(Lanes a, Lanes b) {return compare<_CMP_GE_OQ>(a, b);}
+    inline Lanes equal(Lanes a, Lanes b) {return compare<_CMP_EQ_OQ>(a, b);}
+    inline Lanes not_equal(Lanes a, Lanes b) {return compare<_CMP_NEQ_UQ>(a, b);}
+    inline Lanes select(Lanes condition, Lanes a, Lanes b) {return _mm256_blendv_pd(b, a, _mm256_cmp_pd(condition, splat(1), _CMP_EQ_OQ));}
+#elif defined(__SSE2__)
+    // Every x86-64 target has SSE2, so this is the lane portable builds use there
+    using Lanes = __m128d;
+    constexpr size_t WIDTH = 2;
+
+    inline Lanes load(const double* p) {return _mm_loadu_pd(p);}
+    inline void store(double* p, Lanes v) {_mm_storeu_pd(p, v);}
+    inline Lanes splat(double x) {return _mm_set1_pd(x);}
+    inline Lanes add(Lanes a, Lanes b) {return _mm_add_pd(a, b);}
+    inline Lanes sub(Lanes a, Lanes b) {return _mm_sub_pd(a, b);}
+    inline Lanes mul(Lanes a, Lanes b) {return _mm_mul_pd(a, b);}
+    inline Lanes div(Lanes a, Lanes b) {return _mm_div_pd(a, b);}
+    // Lanes where mask is set from a, and the rest from b (SSE2 has no blend)
+    inline Lanes blend(Lanes mask, Lanes a, Lanes b) {return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));}
+    inline Lanes floor(Lanes a) {
+        // No rounding instruction either: adding and subtracting 2^52 (with a's sign) rounds to an integer, which is
+        // one too high where it rounded up. Anything of magnitude 2^52 or more, including infinities and NaN, already is one.
+        Lanes sign = _mm_and_pd(a, splat(-0.0));
+        Lanes shift = _mm_or_pd(splat(0x1p52), sign);
+        Lanes rounded = _mm_sub_pd(_mm_add_pd(a, shift), shift);
+        rounded = _mm_or_pd(_mm_sub_pd(rounded, _mm_and_pd(_mm_cmpgt_pd(rounded, a), splat(1))), sign);
+        return blend(_mm_cmplt_pd(_mm_andnot_pd(splat(-0.0), a), splat(0x1p52)), rounded, a);
+    }
+    inline Lanes max(Lanes a, Lanes b) {
+        // Undefined if either side is, like Desmos
+        return blend(_mm_cmpunord_pd(a, b), splat(UNDEFINED), _mm_max_pd(a, b));
+    }
+    inline Lanes neg(Lanes a) {return _mm_xor_pd(a, splat(-0.0));}
+    inline Lanes abs(Lanes a) {return _mm_andnot_pd(splat(-0.0), a);}
+
+    inline Lanes from_mask(Lanes mask) {return _mm_and_pd(mask, splat(1));}
+    inline Lanes less(Lanes a, Lanes b) {return from_mask(_mm_cmplt_pd(a, b));}
+    inline Lanes greater(Lanes a, Lanes b) {return from_mask(_mm_cmpgt_pd(a, b));}
+    inline Lanes less_equal(Lanes a, Lanes b) {return from_mask(_mm_cmple_pd(a, b));}
+    inline Lanes greater_equal(Lanes a, Lanes b) {return from_mask(_mm_cmpge_pd(a, b));}
+    inline Lanes equal(Lanes a, Lanes b) {return from_mask(_mm_cmpeq_pd(a, b));}
+    inline Lanes not_equal(Lanes a, Lanes b) {return from_mask(_mm_cmpneq_pd(a, b));}
+    inline Lanes select(Lanes condition, Lanes a, Lanes b) {return blend(_mm_cmpeq_pd(condition, splat(1)), a, b);}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    using Lanes = float64x2_t;
+    constexpr size_t WIDTH = 2;
+
+    inline Lanes load(const double* p) {return vld1q_f64(p);}
+    inline void store(double* p, Lanes v) {vst1q_f64(p, v);}
+    inline Lanes splat(double x) {return vdupq_n_f64(x);}
+    inline Lanes add(Lanes a, Lanes b) {return vaddq_f64(a, b);}
+    inline Lanes sub(Lanes a, Lanes b) {return vsubq_f64(a, b);}
+    inline Lanes mul(Lanes a, Lanes b) {return vmulq_f64(a, b);}
+    inline Lanes div(Lanes a, Lanes b) {return vdivq_f64(a, b);}
+    inline Lanes floor(Lanes a) {return vrndmq_f64(a);}
+    inline Lanes max(Lanes a, Lanes b) {return vmaxq_f64(a, b);} // Already undefined if either side is
+    inline Lanes neg(Lanes a) {return vnegq_f64(a);}
+    inline Lanes abs(Lanes a) {return vabsq_f64(a);}
+
+    inline Lanes from_mask(uint64x2_t mask) {return vreinterpretq_f64_u64(vandq_u64(mask, vreinterpretq_u64_f64(splat(1))));}
+    inline Lanes less(Lanes a, Lanes b) {return from_mask(vcltq_f64(a, b));}
+    inline Lanes greater(Lanes a, Lanes b) {return from_mask(vcgtq_f64(a, b));}
+    inline Lanes less_equal(Lanes a, Lanes b) {return from_mask(vcleq_f64(a, b));}
+    inline Lanes greater_equal(Lanes a, Lanes b) {return from_mask(vcgeq_f64(a, b));}
+    inline Lanes equal(Lanes a, Lanes b) {return from_mask(vceqq_f64(a, b));}
+    inline Lanes not_equal(Lanes a, Lanes b) {return from_mask(veorq_u64(vceqq_f64(a, b), vdupq_n_u64(~0ULL)));}
+    inline Lanes select(Lanes condition, Lanes a, Lanes b) {return vbslq_f64(vceqq_f64(condition, splat(1)), a, b);}
+#else
+    // Scalar fallback
+    struct Lanes {double v;};
+    constexpr size_t WIDTH = 1;
+
+    inline Lanes load(const double* p) {return {*p};}
+    inline void store(double* p, Lanes v) {*p = v.v;}
+    inline Lanes splat(double x) {return {x};}
+    inline Lanes add(Lanes a, Lanes b) {return {a.v + b.v};}
+    inline Lanes sub(Lanes a, Lanes b) {return {a.v - b.v};}
+    inline Lanes mul(Lanes a, Lanes b) {return {a.v * b.v};}
+    inline Lanes div(Lanes a, Lanes b) {return {a.v / b.v};}
+    inline Lanes floor(Lanes a) {return {std::floor(a.v)};}
+    inline Lanes max(Lanes a, Lanes b) {return {(std::isnan(a.v) || std::isnan(b.v)) ? UNDEFINED : std::max(a.v, b.v)};}
+    inline Lanes neg(Lanes a) {return {-a.v};}
+    inline Lanes abs(Lanes a) {return {std::abs(a.v)};}
+
+    inline Lanes less(Lanes a, Lanes b) {return {(double) (a.v < b.v)};}
+    inline Lanes greater(Lanes a, Lanes b) {return {(double) (a.v > b.v)};}
+    inline Lanes less_equal(Lanes a, Lanes b) {return {(double) (a.v <= b.v)};}
+    inline Lanes greater_equal(Lanes a, Lanes b) {return {(double) (a.v >= b.v)};}
+    inline Lanes equal(Lanes a, Lanes b) {return {(double) (a.v == b.v)};}
+    inline Lanes not_equal(Lanes a, Lanes b) {return {(double) !(a.v == b.v)};}
+    inline Lanes select(Lanes condition, Lanes a, Lanes b) {return condition.v == 1 ? a : b;}
+#endif
+
+    static_assert(Kernel::BATCH % WIDTH == 0);
+
+    template <class F>
+    inline void map(double* dest, const double* a, F&& f) {
+        for (size_t i = 0; i < Kernel::BATCH; i += WIDTH) {
+            store(dest + i, f(load(a + i)));
+        }
+    }
+
+    template <class F>
+    inline void map(double* dest, const double* a, const double* b, F&& f) {
+        for (size_t i = 0; i < Kernel::BATCH; i += WIDTH) {
+            store(dest + i, f(load(a + i), load(b + i)));
+        }
+    }
+}
+
+// Thrown for expressions that can't be sampled; the position is located when it's reported
+struct UnsupportedExpression : std::runtime_error {
+    SrcPos pos;
+
+    UnsupportedExpression(SrcPos pos, const std::string& message) : std::runtime_error(message), pos(pos) {}
+};
+
+// Flattens a function's body into kernel instructions. Like the assembler, it keeps an explicit stack of the
+// subexpressions left to build and the code that follows each of them, instead of recursing into them.
+class KernelBuilder {
+    struct Step {
+        const ExpressionNode* expr; // Built onto the results, or nullptr to run then instead
+        std::function<void()> then;
+    };
+
+    std::vector<KernelInstruction>& code;
+    const vm::Program& program;
+    const vm::Machine& machine;
+    std::unordered_map<const DeclarationNode*, uint16_t> parameters; // Of the function being inlined
+    std::vector<const DeclarationNode*> inlining; // To reject recursive functions
+    std::vector<Step> stack; // Top runs next
+    std::vector<Step> pending; // Queued by the step being run
+    std::vector<uint16_t> results; // Instructions of the subexpressions built so far, latest last
+
+    [[noreturn]] static void unsupported(const ExpressionNode* expr, const std::string& message) {
+        throw UnsupportedExpression(expr->pos, message);
+    }
+
+    uint16_t emit(KernelOp op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0, double value = 0) {
+        if (code.size() >= std::numeric_limits<uint16_t>::max()) {
+            throw std::runtime_error("Function is too large to sample");
+        }
+        code.push_back({op, a, b, c, value});
+        return code.size() - 1;
+    }
+
+    // The current value of a global, which is a constant as far as the kernel is concerned
+    const vm::Value& global(const ExpressionNode* expr, const DeclarationNode* declaration) {
+        auto slot = program.symbols.globals.find(declaration);
+        if (slot == program.symbols.globals.end()) {
+            unsupported(expr, "'" + std::string(declaration->identifier) + "' has no value");
+        }
+        return machine.global_values()[slot->second];
+    }
+
+    void queue(const ExpressionNode* expr) {pending.push_back({expr, nullptr});}
+    void then(std::function<void()> step) {pending.push_back({nullptr, std::move(step)});}
+
+    uint16_t result() {
+        uint16_t result = results.back();
+        results.pop_back();
+        return result;
+    }
+
+    void expand(const ExpressionNode* expr) {
+        if (expr->type.isList || !(expr->type.matches_primitive(Type::NUM) || expr->type.matches_primitive(Type::BOOL))) {
+            unsupported(expr, "Cannot sample a value of type '" + expr->type.name() + "'");
+        }
+
+        if (auto literal = dynamic_cast<const LiteralNode*>(expr)) {
+            results.push_back(emit(KernelOp::CONST, 0, 0, 0, literal->value));
+            return;
+        }
+
+        if (auto identifier = dynamic_cast<const IdentifierNode*>(expr)) {
+            if (auto parameter = parameters.find(identifier->declaration); parameter != parameters.end()) {
+                results.push_back(parameter->second);
+                return;
+            }
+            const vm::Value& value = global(expr, identifier->declaration);
+            results.push_back(emit(KernelOp::CONST, 0, 0, 0, value.x));
+            return;
+        }
+
+        if (auto derivative = dynamic_cast<const DerivativeNode*>(expr)) {
+            queue(derivative->derivative.get());
+            return;
+        }
+
+        if (auto binop = dynamic_cast<const BinaryOperatorNode*>(expr)) {
+            KernelOp op;
+            switch (binop->op) {
+                case Operator::PLUS: op = KernelOp::ADD; break;
+                case Operator::MINUS: op = KernelOp::SUB; break;
+                case Operator::MUL: op = KernelOp::MUL; break;
+                case Operator::DIV: op = KernelOp::DIV; break;
+                case Operator::MOD: op = KernelOp::MOD; break;
+                case Operator::EXP: op = KernelOp::POW; break;
+                case Operator::AND: op = KernelOp::AND; break;
+                case Operator::OR: op = KernelOp::OR; break;
+                case Operator::LESS: op = KernelOp::LESS; break;
+                case Operator::GREATER: op = KernelOp::GREATER; break;
+                case Operator::LESS_EQUAL: op = KernelOp::LESS_EQUAL; break;
+                case Operator::GREATER_EQUAL: op = KernelOp::GREATER_EQUAL; break;
+                case Operator::EQUAL_EQUAL: op = KernelOp::EQUAL; break;
+                case Operator::NOT_EQUAL: op = KernelOp::NOT_EQUAL; break;
+                default:
+                    throw std::runtime_error("Invalid binary operator: " + std::to_string(binop->op));
+            }
+            queue(binop->left.get());
+            queue(binop->right.get());
+            then([this, op] {
+                uint16_t right = result();
+                uint16_t left = result();
+                results.push_back(emit(op, left, right));
+            });
+            return;
+        }
+
+        if (auto unop = dynamic_cast<const UnaryOperatorNode*>(expr)) {
+            KernelOp op;
+            switch (unop->op) {
+                case Operator::MINUS: op = KernelOp::NEG; break;
+                case Operator::ABS: op = KernelOp::ABS; break;
+                case Operator::INVERT: op = KernelOp::NOT; break;
+                default:
+                    throw std::runtime_error("Invalid unary operator: " + std::to_string(unop->op));
+            }
+            queue(unop->expr.get());
+            then([this, op] {results.push_back(emit(op, result()));});
+            return;
+        }
+
+        if (auto ternary = dynamic_cast<const TernaryOperatorNode*>(expr)) {
+            queue(ternary->condition.get());
+            queue(ternary->ifTrue.get());
+            if (ternary->ifFalse) {
+                queue(ternary->ifFalse.get());
+            } else {
+                then([this] {results.push_back(emit(KernelOp::CONST, 0, 0, 0, UNDEFINED));});
+            }
+            then([this] {
+                uint16_t ifFalse = result();
+                uint16_t ifTrue = result();
+                uint16_t condition = result();
+                results.push_back(emit(KernelOp::SELECT, condition, ifTrue, ifFalse));
+            });
+            return;
+        }
+
+        if (auto call = dynamic_cast<const CallNode*>(expr); call && call->builtin()) {
+            const builtins::Builtin* called = call->builtin();
+            size_t count = call->arguments.size();
+            if (!called->evaluate || (called->reduce && !called->is_variadic(count))) {
+                unsupported(expr, "Builtin function '" + std::string(called->name) + "' cannot be sampled");
+            }
+            if (called->is_variadic(count)) {
+                // Combined two at a time, left to right
+                queue(call->arguments[0].get());
+                for (size_t i = 1; i < count; i++) {
+                    queue(call->arguments[i].get());
+                    then([this, called] {
+                        uint16_t second = result();
+                        uint16_t first = result();
+                        results.push_back(emit(KernelOp::BUILTIN, first, second, builtins::index(called)));
+                    });
+                }
+                return;
+            }
+            for (auto& argument : call->arguments) {
+                queue(argument.get());
+            }
+            then([this, called, count] {
+                uint16_t second = result();
+                uint16_t first = count > 1 ? result() : second;
+                results.push_back(emit(KernelOp::BUILTIN, first, second, builtins::index(called)));
+            });
+            return;
+        }
+
+        if (auto call = dynamic_cast<const CallNode*>(expr)) {
+            auto function = (const FunctionDeclarationNode*) ((const IdentifierNode*) call->function.get())->declaration;
+            if (std::find(inlining.begin(), inlining.end(), function) != inlining.end()) {
+                unsupported(expr, "Recursive function '" + std::string(function->identifier) + "' cannot be sampled");
+            }
+
+            for (auto& argument : call->arguments) {
+                queue(argument.get());
+            }
+            then([this, function] {
+                // The callee only sees its own parameters
+                auto callerParameters = std::move(parameters);
+                parameters = {};
+                for (size_t i = function->parameters.size(); i-- > 0;) {
+                    parameters[function->parameters[i].get()] = result();
+                }
+                inlining.push_back(function);
+                queue(function->value);
+                then([this, callerParameters = std::move(callerParameters)] {
+                    inlining.pop_back();
+                    parameters = callerParameters;
+                });
+            });
+            return;
+        }
+
+        if (auto access = dynamic_cast<const MemberAccessNode*>(expr)) {
+            if (access->memberDeclaration) {
+                const vm::Value& value = global(expr, access->memberDeclaration);
+                if (!access->memberDeclaration->isPerInstance) {
+                    results.push_back(emit(KernelOp::CONST, 0, 0, 0, value.x));
+                    return;
+                }
+                auto instance = ((const IdentifierNode*) access->object.get())->declaration;
+                long index = instance->instanceIndex;
+                results.push_back(emit(KernelOp::CONST, 0, 0, 0, value.x_at(index)));
+                return;
+            }
+
+            // Point coordinate
+            bool isX = access->member == "x";
+            if (auto point = dynamic_cast<const PointNode*>(access->object.get())) {
+                queue(isX ? point->x.get() : point->y.get());
+                return;
+            }
+            if (auto identifier = dynamic_cast<const IdentifierNode*>(access->object.get()); identifier && !parameters.contains(identifier->declaration)) {
+                const vm::Value& value = global(expr, identifier->declaration);
+                results.push_back(emit(KernelOp::CONST, 0, 0, 0, isX ? value.x : value.y));
+                return;
+            }
+        }
+
+        unsupported(expr, "Expression cannot be sampled");
+    }
+
+public:
+    KernelBuilder(std::vector<KernelInstruction>& code, const vm::Program& program, const vm::Machine& machine)
+        : code(code), program(program), machine(machine), parameters(), inlining(), stack(), pending(), results() {}
+
+    void bind(const DeclarationNode* parameter, KernelOp op) {
+        parameters[parameter] = emit(op);
+    }
+
+    // Returns the instruction that computes expr
+    uint16_t build(const ExpressionNode* expr) {
+        queue(expr);
+        while (true) {
+            for (auto step = pending.rbegin(); step != pending.rend(); step++) {
+                stack.push_back(std::move(*step));
+            }
+            pending.clear();
+            if (stack.empty()) {return result();}
+
+            Step step = std::move(stack.back());
+            stack.pop_back();
+            if (step.expr) {
+                expand(step.expr);
+            } else {
+                step.then();
+            }
+        }
+    }
+};
+
+Kernel::Kernel(const FunctionDeclarationNode* function, const vm::Program& program, const vm::Machine& machine) : code() {
+    KernelBuilder builder(code, program, machine);
+    for (size_t i = 0; i < function->parameters.size(); i++) {
+        builder.bind(function->parameters[i].get(), i == 0 ? KernelOp::X : KernelOp::Y);
+    }
+    builder.build(function->value);
+}
+
+void Kernel::evaluate(const double* x, const double* y, double* out, size_t count) const {
+    // Every instruction has its own batch of results
+    std::vector<double> results(code.size() * BATCH);
+    for (size_t k = 0; k < code.size(); k++) {
+        if (code[k].op == KernelOp::CONST) {
+            std::fill_n(&results[k * BATCH], BATCH, code[k].value);
+        }
+    }
+
+    for (size_t start = 0; start < count; start += BATCH) {
+        size_t size = std::min(BATCH, count - start);
+
+        for (size_t k = 0; k < code.size(); k++) {
+            const KernelInstruction& instruction = code[k];
+            double* dest = &results[k * BATCH];
+            const double* a = &results[instruction.a * BATCH];
+            const double* b = &results[instruction.b * BATCH];
+
+            switch (instruction.op) {
+                case KernelOp::CONST:
+                    break;
+                case KernelOp::X:
+                case KernelOp::Y:
+                    // The last batch is padded so that every operation can run over a whole batch
+                    std::copy_n((instruction.op == KernelOp::X ? x : y) + start, size, dest);
+                    std::fill(dest + size, dest + BATCH, 0);
+                    break;
+
+                case KernelOp::ADD: simd::map(dest, a, b, simd::add); break;
+                case KernelOp::SUB: simd::map(dest, a, b, simd::sub); break;
+                case KernelOp::MUL:
+                case KernelOp::AND: simd::map(dest, a, b, simd::mul); break;
+                case KernelOp::DIV: simd::map(dest, a, b, simd::div); break;
+                case KernelOp::MOD:
+                    // Desmos' mod takes the sign of the divisor
+                    simd::map(dest, a, b, [](simd::Lanes a, simd::Lanes b) {return simd::sub(a, simd::mul(b, simd::floor(simd::div(a, b))));});
+                    break;
+                case KernelOp::POW:
+                    for (size_t i = 0; i < BATCH; i++) {dest[i] = std::pow(a[i], b[i]);}
+                    break;
+                case KernelOp::OR: simd::map(dest, a, b, simd::max); break;
+
+                case KernelOp::LESS: simd::map(dest, a, b, simd::less); break;
+                case KernelOp::GREATER: simd::map(dest, a, b, simd::greater); break;
+                case KernelOp::LESS_EQUAL: simd::map(dest, a, b, simd::less_equal); break;
+                case KernelOp::GREATER_EQUAL: simd::map(dest, a, b, simd::greater_equal); break;
+                case KernelOp::EQUAL: simd::map(dest, a, b, simd::equal); break;
+                case KernelOp::NOT_EQUAL: simd::map(dest, a, b, simd::not_equal); break;
+
+                case KernelOp::NEG: simd::map(dest, a, simd::neg); break;
+                case KernelOp::ABS: simd::map(dest, a, simd::abs); break;
+                case KernelOp::NOT: simd::map(dest, a, [](simd::Lanes a) {return simd::sub(simd::splat(1), a);}); break;
+
+                case KernelOp::SELECT: {
+                    const double* c = &results[instruction.c * BATCH];
+                    for (size_t i = 0; i < BATCH; i += simd::WIDTH) {
+                        simd::store(dest + i, simd::select(simd::load(a + i), simd::load(b + i), simd::load(c + i)));
+                    }
+                    break;
+                }
+                case KernelOp::BUILTIN: {
+                    auto evaluate = builtins::at(instruction.c)->evaluate;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        double arguments[] = {a[i], b[i]};
+                        dest[i] = evaluate(arguments);
+                    }
+                    break;
+                }
+            }
+        }
+
+        std::copy_n(&results[(code.size() - 1) * BATCH], size, out + start);
+    }
+}
+
+std::vector<double> sampler::sample(const Kernel& kernel, size_t parameters, const Options& options) {
+    size_t rows = parameters == 1 ? 1 : options.height;
+    std::vector<double> x(options.width * rows), y(options.width * rows);
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t col = 0; col < options.width; col++) {
+            x[row * options.width + col] = options.xMin + (col + 0.5) * (options.xMax - options.xMin) / options.width;
+            y[row * options.width + col] = options.yMax - (row + 0.5) * (options.yMax - options.yMin) / options.height;
+        }
+    }
+
+    std::vector<double> samples(x.size());
+    kernel.evaluate(x.data(), y.data(), samples.data(), samples.size());
+    return samples;
+}
+
+void sampler::write_csv(std::ostream& out, const std::vector<double>& samples, size_t parameters, const Options& options) {
+    out << (parameters == 1 ? "x,value" : "x,y,value") << "\n" << std::setprecision(10);
+    for (size_t i = 0; i < samples.size(); i++) {
+        size_t row = i / options.width, col = i % options.width;
+        out << options.xMin + (col + 0.5) * (options.xMax - options.xMin) / options.width << ",";
+        if (parameters == 2) {
+            out << options.yMax - (row + 0.5) * (options.yMax - options.yMin) / options.height << ",";
+        }
+        out << samples[i] << "\n";
+    }
+}
+
+void sampler::write_ppm(std::ostream& out, const std::vector<double>& samples, size_t parameters, const Options& options) {
+    struct Color {unsigned char r, g, b;};
+    const Color background = {255, 255, 255}, axis = {170, 170, 170}, curve = {199, 68, 64}, region = {45, 112, 179};
+    std::vector<Color> pixels(options.width * options.height, background);
+
+    // Rows and columns of the axes, if they are in view
+    auto row_of = [&](double y) {return (options.yMax - y) / (options.yMax - options.yMin) * options.height;};
+    auto col_of = [&](double x) {return (x - options.xMin) / (options.xMax - options.xMin) * options.width;};
+    double axisRow = row_of(0), axisCol = col_of(0);
+
+    if (parameters == 1) {
+        for (size_t col = 0; col < options.width; col++) {
+            if (axisRow >= 0 && axisRow < options.height) {pixels[(size_t) axisRow * options.width + col] = axis;}
+        }
+        for (size_t row = 0; row < options.height; row++) {
+            if (axisCol >= 0 && axisCol < options.width) {pixels[row * options.width + (size_t) axisCol] = axis;}
+        }
+
+        // Connect each sample to the previous one so that steep parts of the curve don't break up
+        double previous = UNDEFINED;
+        for (size_t col = 0; col < options.width; col++) {
+            double row = row_of(samples[col]);
+            if (std::isnan(row)) {
+                previous = UNDEFINED;
+                continue;
+            }
+            double from = std::isnan(previous) ? row : previous;
+            long top = std::lround(std::max(0.0, std::min(from, row)));
+            long bottom = std::lround(std::min((double) options.height - 1, std::max(from, row)));
+            for (long r = top; r <= bottom; r++) {
+                pixels[r * options.width + col] = curve;
+            }
+            previous = row;
+        }
+    } else {
+        // Conditions are shaded where they hold, anything else is drawn as a heatmap between its extremes
+        double low = std::numeric_limits<double>::infinity(), high = -low;
+        bool isCondition = true;
+        for (double value : samples) {
+            if (std::isnan(value)) {continue;}
+            low = std::min(low, value);
+            high = std::max(high, value);
+            isCondition = isCondition && (value == 0 || value == 1);
+        }
+
+        for (size_t i = 0; i < samples.size(); i++) {
+            double value = samples[i];
+            if (std::isnan(value) || std::isinf(value)) {continue;}
+            if (isCondition) {
+                if (value == 1) {pixels[i] = region;}
+            } else {
+                double t = high > low ? (value - low) / (high - low) : 0.5;
+                auto level = (unsigned char) std::lround(255 * t);
+                pixels[i] = {level, level, (unsigned char) (255 - level)};
+            }
+        }
+    }
+
+    out << "P6\n" << options.width << " " << options.height << "\n255\n";
+    out.write((const char*) pixels.data(), (std::streamsize) (pixels.size() * sizeof(Color)));
+}
+
+bool Compiler::sample_program(std::string& source, const sampler::Options& options, std::ostream& out) {
+    Compiler compiler;
+    if (!compiler.compile_frontend(source)) {return false;}
+
+    try {
+        if (!compiler.importedModules.empty()) {
+            throw std::runtime_error("Programs that import modules can't be sampled");
+        }
+        auto function = dynamic_cast<const FunctionDeclarationNode*>(compiler.symbolTable.find_symbol(options.function));
+        if (!function || !function->isFunction() || dynamic_cast<const ActionDeclarationNode*>(function)) {
+            throw std::runtime_error("'" + options.function + "' is not a function");
+        }
+        size_t parameters = function->parameters.size();
+        if (parameters < 1 || parameters > 2) {
+            throw std::runtime_error("Only functions of one or two variables can be sampled");
+        }
+        for (auto& parameter : function->parameters) {
+            if (!parameter->type.matches_primitive(Type::NUM)) {
+                throw std::runtime_error("Parameter '" + std::string(parameter->identifier) + "' must be of type 'num' to be sampled");
+            }
+        }
+
+        vm::Program program = vm::compile(&compiler);
+        vm::Machine machine(program);
+        machine.reset();
+
+        Kernel kernel(function, program, machine);
+        std::vector<double> samples = sample(kernel, parameters, options);
+        if (options.csv) {
+            write_csv(out, samples, parameters, options);
+        } else {
+            write_ppm(out, samples, parameters, options);
+        }
+    } catch (const UnsupportedExpression& error) {
+        SrcLocation location = SourceMap(source).locate(error.pos);
+        std::cerr << "Error during sampling: line " << location.line + 1 << ", col " << location.col + 1 << ": " << error.what() << std::endl;
+        return false;
+    } catch (const std::runtime_error& error) {
+        std::cerr << "Error during sampling: " << error.what() << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#ifndef DESMOS_COMPILER_SAMPLER_H
+#define DESMOS_COMPILER_SAMPLER_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "vm.h"
+
+// Forward declaration
+namespace AST {struct FunctionDeclarationNode;}
+
+// Evaluates number-valued functions of one or two variables over dense grids, to preview what they draw
+// and to compare the output of different compilations without Desmos.
+namespace sampler {
+
+    struct Options {
+        std::string function;
+        double xMin = -10, xMax = 10;
+        double yMin = -10, yMax = 10; // For functions of one variable, only used to place the curve in the image
+        size_t width = 512, height = 512;
+        bool csv = false; // Write the samples instead of an image (PPM)
+    };
+
+    enum class KernelOp : uint8_t {
+        CONST, X, Y,
+        ADD, SUB, MUL, DIV, MOD, POW, AND, OR,
+        LESS, GREATER, LESS_EQUAL, GREATER_EQUAL, EQUAL, NOT_EQUAL,
+        NEG, ABS, NOT,
+        SELECT, // a ? b : c
+        BUILTIN // The builtin at index c of the catalog, of a and b (a again for builtins of one number)
+    };
+
+    struct KernelInstruction {
+        KernelOp op;
+        uint16_t a, b, c; // Operands are the results of earlier instructions
+        double value; // For CONST
+    };
+
+    // A straight-line program with one result per instruction. Function calls are inlined and both branches
+    // of conditionals are evaluated, so every operation runs over a whole batch of points at once.
+    class Kernel {
+        std::vector<KernelInstruction> code;
+
+    public:
+        static constexpr size_t BATCH = 256;
+
+        Kernel(const AST::FunctionDeclarationNode* function, const vm::Program& program, const vm::Machine& machine);
+
+        // Evaluates the kernel at (x[i], y[i]) for every i < count
+        void evaluate(const double* x, const double* y, double* out, size_t count) const;
+    };
+
+    // Samples at the center of each pixel, a row for functions of one variable or the whole grid (top row first) otherwise
+    std::vector<double> sample(const Kernel& kernel, size_t parameters, const Options& options);
+
+    void write_csv(std::ostream& out, const std::vector<double>& samples, size_t parameters, const Options& options);
+    void write_ppm(std::ostream& out, const std::vector<double>& samples, size_t parameters, const Options& options);
+}
+
+#endif //DESMOS_COMPILER_SAMPLER_H
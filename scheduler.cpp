@@ -0,0 +1,115 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "ast.h"
+
+using namespace AST;
+
+static unq_ptr<ExpressionNode> make_literal(SrcPos pos, double value) {
+    return std::make_unique<LiteralNode>(pos, Type(Type::NUM, true), value);
+}
+
+static unq_ptr<ExpressionNode> make_reference(DeclarationNode* declaration) {
+    auto identifier = std::make_unique<IdentifierNode>(declaration->pos, declaration->identifier, declaration->scope, nullptr);
+    identifier->declaration = declaration;
+    identifier->type = declaration->type;
+    return identifier;
+}
+
+static unq_ptr<ExpressionNode> make_binop(Operator op, unq_ptr<ExpressionNode> left, unq_ptr<ExpressionNode> right, Type type) {
+    SrcPos pos = left->pos;
+    auto node = std::make_unique<BinaryOperatorNode>(pos, op, std::move(left), std::move(right));
+    node->type = type;
+    return node;
+}
+
+void TickerScheduleNode::build(std::vector<Error>& errors) {
+    if (tickers.empty()) {return;}
+
+    // Tickers with a constant period share a base period that divides all of them
+    std::vector<long> constantPeriods(tickers.size(), 0);
+    std::vector<bool> isDynamic(tickers.size(), false);
+    long base = 0;
+    for (size_t k = 0; k < tickers.size(); k++) {
+        if (!tickers[k]->period) {continue;}
+
+        std::optional<double> period = tickers[k]->period->constant_value();
+        if (!period) {
+            isDynamic[k] = true;
+        } else if (!(*period > 0)) {
+            errors.emplace_back(tickers[k]->period->pos, "Ticker period must be positive");
+        } else {
+            // Desmos runs tickers in whole milliseconds
+            constantPeriods[k] = std::max(1L, std::lround(*period));
+            base = std::gcd(base, constantPeriods[k]);
+        }
+    }
+    if (base == 0 && std::find(isDynamic.begin(), isDynamic.end(), true) != isDynamic.end()) {
+        base = DEFAULT_BASE_PERIOD;
+    }
+    basePeriod = base;
+
+    // The tick counter wraps after the least common multiple of the constant periods (in ticks)
+    long cycle = 1;
+    for (long period : constantPeriods) {
+        if (period == 0 || cycle == 0) {continue;}
+        cycle = std::lcm(cycle, period / base);
+        if (cycle > MAX_TICK_CYCLE) {cycle = 0;}
+    }
+
+    dispatch = std::make_unique<ActionDeclarationNode>(pos, "ticker", nullptr);
+    TickerStateDeclarationNode* counter = nullptr;
+    if (cycle != 1) {
+        counter = state.emplace_back(std::make_unique<TickerStateDeclarationNode>(pos, "tick", nullptr)).get();
+    }
+
+    // Tickers that fire on the same tick run in declaration order, as if they were one action
+    Type boolType(Type::BOOL), numType(Type::NUM);
+    std::vector<std::pair<DeclarationNode*, unq_ptr<ExpressionNode>>> stateUpdates;
+    for (size_t k = 0; k < tickers.size(); k++) {
+        TickerNode* ticker = tickers[k];
+        unq_ptr<ExpressionNode> condition = nullptr;
+
+        if (constantPeriods[k] > base) {
+            // mod(tick, period) = 0
+            auto ticks = make_binop(Operator::MOD, make_reference(counter), make_literal(ticker->pos, (double) (constantPeriods[k] / base)), numType);
+            condition = make_binop(Operator::EQUAL_EQUAL, std::move(ticks), make_literal(ticker->pos, 0), boolType);
+        } else if (isDynamic[k]) {
+            // The period can change at any time, so count the time since the ticker last fired instead:
+            // elapsed + base >= period fires it, and carries the remainder over to the next period.
+            // A dynamic period shorter than the base period fires at most once per tick.
+            auto elapsed = state.emplace_back(std::make_unique<TickerStateDeclarationNode>(ticker->pos, "elapsed" + std::to_string(k + 1), nullptr)).get();
+            condition = make_binop(Operator::GREATER_EQUAL, make_binop(Operator::PLUS, make_reference(elapsed), make_literal(ticker->pos, (double) base), numType),
+                                   ticker->period->substitute({}), boolType);
+
+            // The condition and period are evaluated after earlier tickers in the same tick, like in the action itself
+            Bindings bindings;
+            for (auto& [variable, value] : dispatch->assignments) {
+                bindings[variable] = value.get();
+            }
+            auto next = make_binop(Operator::PLUS, make_reference(elapsed), make_literal(ticker->pos, (double) base), numType);
+            auto carried = make_binop(Operator::MINUS, next->substitute({}), ticker->period->substitute(bindings), numType);
+            auto update = std::make_unique<TernaryOperatorNode>(ticker->pos, condition->substitute(bindings), std::move(carried), std::move(next));
+            update->type = numType;
+            stateUpdates.emplace_back(elapsed, std::move(update));
+        }
+
+        dispatch->lower_statement(ticker->action.get(), errors, condition.get());
+    }
+
+    if (counter) {
+        auto next = make_binop(Operator::PLUS, make_reference(counter), make_literal(pos, 1), numType);
+        if (cycle != 0) {
+            next = make_binop(Operator::MOD, std::move(next), make_literal(pos, (double) cycle), numType);
+        }
+        stateUpdates.emplace_back(counter, std::move(next));
+    }
+    for (auto& update : stateUpdates) {
+        dispatch->assignments.push_back(std::move(update));
+    }
+}
@@ -2,62 +2,166 @@
 // Created by Cooper Roalson on 8/25/24.
 //
 
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <concepts>
+
 #include "frontend.h"
 #include "ast.h"
+#include "module.h"
+#include "builtins.h"
+#include "visitor.h"
 
 namespace frontend {
-    void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
-        compiler->ast->postorder_traverse(compiler, errors, &AST::ASTNode::semantic_analysis);
+    using namespace AST;
+
+    static bool is_overloaded(const DeclarationNode* declaration) {
+        return declaration->isFunction() && ((const FunctionDeclarationNode*) declaration)->isOverloaded;
     }
 
+    // Resolves names and checks types. Calls are qualified so that they bind to the node's own implementation
+    // without a virtual call.
+    struct TypeCheckPass {
+        Compiler* compiler;
+        std::vector<Error>& errors;
+
+        template <class Node>
+        void visit(Node& node) {node.Node::semantic_analysis(compiler, errors);}
+    };
+
+    // Counts the references to each declaration
+    struct UseCountPass {
+        void visit(IdentifierNode& node) {
+            // Calls count the overload they resolve to instead
+            if (node.declaration && !is_overloaded(node.declaration)) {node.declaration->uses++;}
+        }
+        void visit(CallNode& node) {
+            auto declaration = ((IdentifierNode*) node.function.get())->declaration;
+            if (declaration && is_overloaded(declaration)) {declaration->uses++;}
+        }
+        void visit(MemberAccessNode& node) {
+            if (node.memberDeclaration) {node.memberDeclaration->uses++;}
+        }
+    };
+
+    // Caches the constant value of each expression, from the values already cached for its subexpressions
+    struct ConstantFoldPass {
+        template <class Node> requires std::derived_from<Node, ExpressionNode>
+        void visit(Node& node) {
+            if constexpr (!std::is_same_v<Node, IdentifierNode>) {
+                node.folded = node.Node::fold();
+                node.isFolded = true;
+            }
+        }
+    };
+
+    // Runs once every node has been through the passes above
+    struct LateAnalysisPass {
+        Compiler* compiler;
+        std::vector<Error>& errors;
+
+        template <class Node>
+        void visit(Node& node) {node.Node::late_analysis(compiler, errors);}
+    };
+
+    void semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+        TypeCheckPass typeCheck {compiler, errors};
+        UseCountPass useCount;
+        ConstantFoldPass constantFold;
+        traverse(compiler->ast.get(), typeCheck, useCount, constantFold);
+        if (errors.empty()) {
+            LateAnalysisPass lateAnalysis {compiler, errors};
+            traverse(compiler->ast.get(), lateAnalysis);
+        }
+    }
 }
 
 using namespace AST;
 
 void IdentifierNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
-    DeclarationNode* declaration = scope->find_symbol(identifier);
-    if (!declaration) {
+    if (!isExplicitBuiltin) {declaration = scope->find_symbol(identifier);}
+    if (declaration) {builtin = nullptr;}
+
+    if (builtin) {
+        // Typed by the call
+        return;
+    } else if (!declaration && builtins::find(identifier)) {
+        errors.emplace_back(pos, "'" + std::string(identifier) + "' is a builtin function, so it can only be called");
+    } else if (!declaration) {
         errors.emplace_back(pos, "Symbol not found in current scope: '" + std::string(identifier) + "'");
+    } else if (declaration->isStruct()) {
+        errors.emplace_back(pos, "'" + std::string(identifier) + "' is a struct, not a value");
     } else {
         type = declaration->type;
+        // Calls add the dependency on the overload they resolve to
+        if (context && !frontend::is_overloaded(declaration)) {
+            compiler->dependencies.add_dependency(context, declaration);
+        }
+        if (context && context->parentStruct && context->parentStruct == declaration->parentStruct) {
+            context->parentStruct->memberReferences.emplace_back(context, declaration);
+        }
     }
 }
 
 void BinaryOperatorNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    // Operators apply elementwise to lists (broadcasting a single value over a list),
+    // so the checks are done on element types
+    Type leftType = left->type.element();
+    Type rightType = right->type.element();
+
     bool isValid = false;
     switch (op) {
         case Operator::PLUS:
         case Operator::MINUS:
-            if ((left->type.matches_primitive(Type::NUM) && right->type.matches_primitive(Type::NUM))
-                || (left->type.matches_primitive(Type::POINT) && right->type.matches_primitive(Type::POINT))) {
+            if ((leftType.matches_primitive(Type::NUM) && rightType.matches_primitive(Type::NUM))
+                || (leftType.matches_primitive(Type::POINT) && rightType.matches_primitive(Type::POINT))) {
                     isValid = true;
-                    type = {Type::NUM};
+                    type = leftType.isUnknown ? rightType : leftType;
+                    type.isConst = false;
             }
             break;
         case Operator::MUL:
-            if (left->type.matches_primitive(Type::NUM) && right->type.matches_primitive(Type::POINT)) {
+            if (leftType.matches_primitive(Type::NUM) && rightType.matches_primitive(Type::POINT)) {
                 isValid = true;
                 type = {Type::POINT};
             }
         case Operator::DIV:
-            if (left->type.matches_primitive(Type::NUM) && right->type.matches_primitive(Type::NUM)) {
+            if (leftType.matches_primitive(Type::NUM) && rightType.matches_primitive(Type::NUM)) {
                 isValid = true;
                 type = {Type::NUM};
-            } else if (left->type.matches_primitive(Type::POINT) && right->type.matches_primitive(Type::NUM)) {
+            } else if (leftType.matches_primitive(Type::POINT) && rightType.matches_primitive(Type::NUM)) {
                 isValid = true;
                 type = {Type::POINT};
             }
             break;
         case Operator::MOD:
         case Operator::EXP:
-            if (left->type.matches_primitive(Type::NUM) || right->type.matches_primitive(Type::NUM)) {
+            if (leftType.matches_primitive(Type::NUM) || rightType.matches_primitive(Type::NUM)) {
                 isValid = true;
                 type = {Type::NUM};
             }
             break;
         case Operator::AND:
         case Operator::OR:
-            if (left->type.matches_primitive(Type::BOOL) && right->type.matches_primitive(Type::BOOL)) {
+            if (leftType.matches_primitive(Type::BOOL) && rightType.matches_primitive(Type::BOOL)) {
+                isValid = true;
+                type = {Type::BOOL};
+            }
+            break;
+        case Operator::LESS:
+        case Operator::GREATER:
+        case Operator::LESS_EQUAL:
+        case Operator::GREATER_EQUAL:
+            if (leftType.matches_primitive(Type::NUM) && rightType.matches_primitive(Type::NUM)) {
+                isValid = true;
+                type = {Type::BOOL};
+            }
+            break;
+        case Operator::EQUAL_EQUAL:
+        case Operator::NOT_EQUAL:
+            if ((leftType.matches_primitive(Type::NUM) && rightType.matches_primitive(Type::NUM))
+                || (leftType.matches_primitive(Type::BOOL) && rightType.matches_primitive(Type::BOOL))) {
                 isValid = true;
                 type = {Type::BOOL};
             }
@@ -67,31 +171,719 @@ void BinaryOperatorNode::semantic_analysis(Compiler* compiler, std::vector<Error
     }
     if (!isValid) {
         errors.emplace_back(pos, "Operator cannot be applied to operands of type '" + left->type.name() + "' and '" + right->type.name() + "'");
+    } else if (left->type.isList || right->type.isList) {
+        type = type.list();
     }
 }
 
 void UnaryOperatorNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    Type exprType = expr->type.element();
+
     bool isValid = false;
     switch (op) {
         case Operator::MINUS:
-            if (expr->type.matches_primitive(Type::NUM)) {
+            if (exprType.matches_primitive(Type::NUM)) {
                 isValid = true;
                 type = {Type::NUM};
-            } else if (expr->type.matches_primitive(Type::POINT)) {
+            } else if (exprType.matches_primitive(Type::POINT)) {
                 isValid = true;
                 type = {Type::POINT};
             }
             break;
         case Operator::INVERT:
-            if (expr->type.matches_primitive(Type::BOOL)) {
+            if (exprType.matches_primitive(Type::BOOL)) {
                 isValid = true;
                 type = {Type::BOOL};
             }
             break;
+        case Operator::ABS:
+            if (exprType.matches_primitive(Type::NUM)) {
+                isValid = true;
+                type = {Type::NUM};
+            }
+            break;
         default:
             throw std::runtime_error("Invalid unary operator: " + std::to_string(op));
     }
     if (!isValid) {
         errors.emplace_back(pos, "Operator cannot be applied to operand of type '" + expr->type.name() + "'");
+    } else if (expr->type.isList) {
+        type = type.list();
+    }
+}
+
+void TernaryOperatorNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    if (!condition->type.element().matches_primitive(Type::BOOL)) {
+        errors.emplace_back(condition->pos, "Condition must be of type 'bool', got '" + condition->type.name() + "'");
+    }
+    type = (ifTrue->type.isUnknown && ifFalse) ? ifFalse->type.element() : ifTrue->type.element();
+    type.isConst = false;
+    if (ifFalse && !ifTrue->type.element().matches(ifFalse->type.element())) {
+        errors.emplace_back(pos, "Branches of conditional have different types '" + ifTrue->type.name() + "' and '" + ifFalse->type.name() + "'");
+    }
+    // Like other operators, conditionals are applied elementwise to lists
+    if (condition->type.isList || ifTrue->type.isList || (ifFalse && ifFalse->type.isList)) {
+        type = type.list();
+    }
+}
+
+void ComprehensionNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    if (!start->type.matches_primitive(Type::NUM) || !end->type.matches_primitive(Type::NUM)) {
+        errors.emplace_back(pos, "Range bounds must be of type 'num', got '" + start->type.name() + "' and '" + end->type.name() + "'");
+    }
+    if (body->type.isList) {
+        errors.emplace_back(body->pos, "Lists cannot contain other lists");
+    }
+    type = body->type.list();
+    type.isConst = false;
+}
+
+// Replaces each largest num or bool subexpression that has a constant value with a literal
+static void fold_constants(unq_ptr<ExpressionNode>& root) {
+    std::vector<unq_ptr<ExpressionNode>*> stack = {&root};
+    while (!stack.empty()) {
+        unq_ptr<ExpressionNode>& slot = *stack.back();
+        stack.pop_back();
+        bool isNumber = !slot->type.isUnknown && (slot->type.matches_primitive(Type::NUM) || slot->type.matches_primitive(Type::BOOL));
+        // Constants are still referred to by name
+        if (isNumber && slot->kind != NodeKind::LITERAL && slot->kind != NodeKind::IDENTIFIER) {
+            std::optional<double> value = slot->constant_value();
+            if (value && std::isfinite(*value)) {
+                slot = std::make_unique<LiteralNode>(slot->pos, Type(slot->type.value.primitive, true), *value);
+                continue;
+            }
+        }
+        for_each_slot(slot.get(), [&](unq_ptr<ExpressionNode>& child) {stack.push_back(&child);});
+    }
+}
+
+void ComprehensionNode::late_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    std::optional<double> count = size();
+    if (!count) {return;}
+    if (*count > MAX_SIZE) {
+        errors.emplace_back(pos, "Ranges can have at most " + std::to_string((long) MAX_SIZE) + " elements");
+        return;
+    }
+    if (*count > MAX_UNROLLED) {return;}
+
+    // Small constant ranges are written out, with the elements that only depend on the variable computed
+    double first = *start->constant_value();
+    double step = *end->constant_value() < first ? -1 : 1;
+    auto list = std::make_unique<ListNode>(pos);
+    list->type = type;
+    for (long k = 0; k < (long) *count; k++) {
+        LiteralNode value(variable->pos, Type(Type::NUM, true), first + (double) k * step);
+        list->elements.push_back(body->substitute({{variable.get(), &value}}));
+        fold_constants(list->elements.back());
+    }
+    unrolled = std::move(list);
+}
+
+void SolveNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    type = Type(Type::NUM);
+    if (!left->type.matches_primitive(Type::NUM) || !right->type.matches_primitive(Type::NUM)) {
+        errors.emplace_back(pos, "Both sides of an equation must be of type 'num', got '" + left->type.name() + "' and '" + right->type.name() + "'");
+        return;
+    }
+    // A regression fits a single value for the whole graph
+    if (!definition || definition->value != this || definition->isFunction() || definition->parentStruct) {
+        errors.emplace_back(pos, "'$solve' can only be the whole value of a definition outside of functions and structs");
+        return;
+    }
+    if (left->type.isUnknown || right->type.isUnknown) {return;}
+
+    if (solve() && !root) {
+        errors.emplace_back(pos, "No solution found for the equation");
+    }
+    type.isConst = root.has_value();
+}
+
+void DerivativeNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    type = expr->type;
+    type.isConst = false;
+    if (!expr->type.element().matches_primitive(Type::NUM) && !expr->type.element().matches_primitive(Type::POINT)) {
+        errors.emplace_back(expr->pos, "Only values of type 'num' or 'point' can be differentiated, got '" + expr->type.name() + "'");
+        type = {};
+    }
+    auto declaration = ((const IdentifierNode*) variable.get())->declaration;
+    if (declaration && (declaration->isFunction() || !variable->type.matches_primitive(Type::NUM))) {
+        errors.emplace_back(variable->pos, "Derivatives are taken with respect to a single 'num', got '" + std::string(declaration->identifier) + "'");
+    }
+}
+
+void DerivativeNode::late_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    differentiate(compiler, errors);
+}
+
+void PointNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    if (!x->type.element().matches_primitive(Type::NUM) || !y->type.element().matches_primitive(Type::NUM)) {
+        errors.emplace_back(pos, "Point coordinates must be of type 'num', got '" + x->type.name() + "' and '" + y->type.name() + "'");
+    }
+    type = {Type::POINT, x->type.isConst && y->type.isConst, x->type.isList || y->type.isList};
+}
+
+void ListNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    type = {};
+    bool isConst = true;
+    for (auto& element : elements) {
+        if (element->type.isList) {
+            errors.emplace_back(element->pos, "Lists cannot contain other lists");
+        } else if (!element->type.matches(type)) {
+            errors.emplace_back(element->pos, "List element of type '" + element->type.name() + "' does not match type '" + type.name() + "'");
+        } else if (type.isUnknown) {
+            type = element->type;
+        }
+        isConst = isConst && element->type.isConst;
+    }
+    type = type.list();
+    type.isConst = isConst && !type.isUnknown;
+}
+
+void IndexNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    if (!list->type.isList && !list->type.isUnknown) {
+        errors.emplace_back(pos, "Cannot index into non-list type '" + list->type.name() + "'");
+    }
+    if (!index->type.element().matches_primitive(Type::NUM)) {
+        errors.emplace_back(index->pos, "List index must be of type 'num', got '" + index->type.name() + "'");
+    }
+    // Indexing with a list of indices gives a list
+    type = index->type.isList ? list->type : list->type.element();
+    type.isConst = false;
+}
+
+// The overload whose parameter types match the arguments', or else their element types, so that a list
+// argument is passed to the overload taking a single value elementwise
+static FunctionDeclarationNode* resolve_overload(Compiler* compiler, const CallNode& call, FunctionDeclarationNode* first, std::vector<Error>& errors) {
+    std::vector<Type> types;
+    for (auto& argument : call.arguments) {
+        if (argument->type.isUnknown) {return nullptr;}
+        types.push_back(argument->type);
+    }
+
+    uint32_t signature;
+    if (compiler->signatures.find(types, signature)) {
+        if (auto function = first->scope->find_overload(first->identifier, signature)) {return function;}
+    }
+    for (auto& type : types) {type = type.element();}
+    if (compiler->signatures.find(types, signature)) {
+        if (auto function = first->scope->find_overload(first->identifier, signature)) {return function;}
+    }
+
+    std::string names;
+    for (auto& argument : call.arguments) {
+        if (!names.empty()) {names += ", ";}
+        names += argument->type.name();
+    }
+    errors.emplace_back(call.pos, "No overload of '" + std::string(first->identifier) + "' takes (" + names + ")");
+    return nullptr;
+}
+
+// Like calls to declared functions, except that list parameters take lists of any length
+static void check_builtin_call(CallNode& call, const builtins::Builtin* builtin, std::vector<Error>& errors) {
+    if (builtin->is_variadic(call.arguments.size())) {
+        // Numbers to combine, which (unlike the list form) don't broadcast
+        for (auto& argument : call.arguments) {
+            if (argument->type.matches_primitive(Type::NUM)) {continue;}
+            errors.emplace_back(argument->pos, "Cannot pass value of type '" + argument->type.name() + "' to '" + std::string(builtin->name)
+                                               + "' with other arguments, which takes numbers");
+        }
+        call.type = builtin->result_type();
+        return;
+    }
+    if (call.arguments.size() != builtin->parameterCount) {
+        errors.emplace_back(call.pos, "'" + std::string(builtin->name) + "' takes " + std::to_string(builtin->parameterCount)
+                                      + " arguments, got " + std::to_string(call.arguments.size()));
+        return;
+    }
+
+    bool isBroadcast = false;
+    for (size_t i = 0; i < call.arguments.size(); i++) {
+        Type parameterType = builtin->parameter_type(i);
+        const Type& argumentType = call.arguments[i]->type;
+        if (parameterType.matches(argumentType)) {continue;}
+        if (!parameterType.isList && argumentType.isList && parameterType.matches(argumentType.element())) {
+            isBroadcast = true;
+            continue;
+        }
+        errors.emplace_back(call.arguments[i]->pos, "Cannot pass value of type '" + argumentType.name() + "' to '" + std::string(builtin->name)
+                                                    + "', which takes '" + parameterType.name() + "'");
+    }
+
+    call.type = builtin->result_type();
+    if (isBroadcast) {call.type = call.type.list();}
+}
+
+void CallNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    type = {};
+    auto identifier = (IdentifierNode*) function.get(); // The parser only creates calls on identifiers
+    if (identifier->builtin) {
+        check_builtin_call(*this, identifier->builtin, errors);
+        return;
+    }
+    if (!identifier->declaration) {return;}
+    if (!identifier->declaration->isFunction()) {
+        errors.emplace_back(pos, "'" + std::string(identifier->identifier) + "' is not a function");
+        return;
+    }
+
+    auto declaration = (FunctionDeclarationNode*) identifier->declaration;
+    if (declaration->isOverloaded) {
+        declaration = resolve_overload(compiler, *this, declaration, errors);
+        if (!declaration) {return;}
+        identifier->declaration = declaration;
+        identifier->type = declaration->type;
+        if (identifier->context) {
+            compiler->dependencies.add_dependency(identifier->context, declaration);
+        }
+    }
+
+    if (arguments.size() != declaration->parameters.size()) {
+        errors.emplace_back(pos, "'" + std::string(identifier->identifier) + "' takes " + std::to_string(declaration->parameters.size())
+                                 + " arguments, got " + std::to_string(arguments.size()));
+        return;
+    }
+
+    // Like operators, functions are applied elementwise when passed a list in place of a single value
+    bool isBroadcast = false;
+    for (size_t i = 0; i < arguments.size(); i++) {
+        const Type& parameterType = declaration->parameters[i]->type;
+        const Type& argumentType = arguments[i]->type;
+        if (parameterType.matches(argumentType)) {continue;}
+        if (!parameterType.isList && argumentType.isList && parameterType.matches(argumentType.element())) {
+            isBroadcast = true;
+            continue;
+        }
+        errors.emplace_back(arguments[i]->pos, "Cannot pass value of type '" + argumentType.name() + "' as parameter '"
+                                               + std::string(declaration->parameters[i]->identifier) + "' of type '" + parameterType.name() + "'");
+    }
+
+    type = declaration->type;
+    type.isConst = false;
+    if (isBroadcast) {type = type.list();}
+}
+
+void MemberAccessNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    type = {};
+    if (object->type.isUnknown) {return;}
+
+    Type objectType = object->type.element();
+    if (objectType.isPrimitive) {
+        if (objectType.value.primitive == Type::POINT && (member == "x" || member == "y")) {
+            type = {Type::NUM, false, object->type.isList};
+        } else {
+            errors.emplace_back(pos, "Type '" + object->type.name() + "' has no member '" + std::string(member) + "'");
+        }
+        return;
     }
+
+    // Struct members are looked up through the instance, which must be known at compile time
+    auto instance = dynamic_cast<IdentifierNode*>(object.get());
+    if (!instance || object->type.isList) {
+        errors.emplace_back(pos, "Struct members can only be accessed directly through a struct instance");
+        return;
+    }
+    DeclarationNode* typeDeclaration = instance->scope->find_symbol(objectType.value.identifier);
+    if (!typeDeclaration || !typeDeclaration->isStruct()) {return;} // Reported where the instance is declared
+    auto structDeclaration = (StructDeclarationNode*) typeDeclaration;
+    memberDeclaration = structDeclaration->memberScope->find_symbol(member);
+    if (!memberDeclaration || memberDeclaration->parentStruct != structDeclaration) {
+        errors.emplace_back(pos, "Struct '" + objectType.name() + "' has no member '" + std::string(member) + "'");
+        memberDeclaration = nullptr;
+        return;
+    }
+    type = memberDeclaration->type;
+    if (instance->context) {
+        compiler->dependencies.add_dependency(instance->context, memberDeclaration);
+    }
+}
+
+void StructDeclarationNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    for (auto& member : members) {
+        if (member->declaration->isFunction()) {
+            errors.emplace_back(member->pos, "Struct members cannot be functions");
+        } else if (!member->declaration->type.isPrimitive && !member->declaration->type.isUnknown) {
+            errors.emplace_back(member->pos, "Struct members cannot be structs");
+        }
+    }
+
+    // A member differs between instances if it (indirectly) references a field
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& [member, reference] : memberReferences) {
+            if (reference->isPerInstance && !member->isPerInstance) {
+                member->isPerInstance = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+void InitializationStatementNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    if (!declaration->type.isPrimitive && !declaration->type.isUnknown) {
+        // Struct instance
+        DeclarationNode* structDeclaration = declaration->scope->find_symbol(declaration->type.value.identifier);
+        if (!structDeclaration || !structDeclaration->isStruct()) {
+            errors.emplace_back(declaration->pos, "Unknown type '" + declaration->type.name() + "'");
+            return;
+        }
+        auto structType = (StructDeclarationNode*) structDeclaration;
+
+        auto initializer = dynamic_cast<StructInitializerNode*>(value.get());
+        if (!initializer || declaration->type.isList || declaration->isFunction()) {
+            errors.emplace_back(value->pos, "Struct instances must be initialized with '{...}'");
+            return;
+        }
+        if (initializer->arguments.size() != structType->fields.size()) {
+            errors.emplace_back(value->pos, "Struct '" + declaration->type.name() + "' has " + std::to_string(structType->fields.size())
+                                            + " fields, got " + std::to_string(initializer->arguments.size()));
+            return;
+        }
+        for (size_t i = 0; i < structType->fields.size(); i++) {
+            auto& argument = initializer->arguments[i];
+            if (!structType->fields[i]->type.matches(argument->type)) {
+                errors.emplace_back(argument->pos, "Cannot initialize field '" + std::string(structType->fields[i]->identifier) + "' of type '"
+                                                   + structType->fields[i]->type.name() + "' with value of type '" + argument->type.name() + "'");
+            }
+        }
+
+        initializer->type = declaration->type;
+        declaration->instanceIndex = (long) structType->instances.size();
+        structType->instances.push_back(this);
+        for (auto& field : structType->fields) {
+            // The instance's arguments are part of each field's list
+            compiler->dependencies.add_dependency(field.get(), declaration.get());
+        }
+        return;
+    }
+
+    if (dynamic_cast<StructInitializerNode*>(value.get())) {
+        errors.emplace_back(value->pos, "Only struct instances can be initialized with '{...}'");
+        return;
+    }
+    if (!declaration->type.matches(value->type)) {
+        errors.emplace_back(value->pos, "Cannot initialize '" + std::string(declaration->identifier) + "' of type '"
+                                        + declaration->type.name() + "' with value of type '" + value->type.name() + "'");
+    }
+}
+
+void AssignmentStatementNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    DeclarationNode* variable = target->declaration;
+    if (!variable) {return;}
+
+    std::string name(variable->identifier);
+    if (dynamic_cast<FunctionDeclarationNode*>(variable) || variable->isStruct() || (!variable->type.isPrimitive && !variable->type.isUnknown)) {
+        errors.emplace_back(target->pos, "Cannot assign to '" + name + "'");
+    } else if (variable->type.isConst) {
+        errors.emplace_back(target->pos, "Cannot assign to constant '" + name + "'");
+    } else if (variable->parentStruct || variable->scope->get_parent_scope()) {
+        errors.emplace_back(target->pos, "Only global variables can be assigned to, but '" + name + "' is local");
+    } else if (!variable->type.matches(value->type)) {
+        errors.emplace_back(value->pos, "Cannot assign value of type '" + value->type.name() + "' to '" + name + "' of type '" + variable->type.name() + "'");
+    }
+}
+
+void ActionCallStatementNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    auto call = dynamic_cast<CallNode*>(action.get());
+    auto identifier = dynamic_cast<IdentifierNode*>(call ? call->function.get() : action.get());
+    if (!identifier) {
+        errors.emplace_back(pos, "Expected assignment or action");
+        return;
+    }
+    if (identifier->builtin) {
+        errors.emplace_back(pos, "'" + std::string(identifier->identifier) + "' is a builtin function, not an action");
+        return;
+    }
+    if (!identifier->declaration) {return;}
+
+    if (!dynamic_cast<ActionDeclarationNode*>(identifier->declaration)) {
+        errors.emplace_back(pos, "'" + std::string(identifier->identifier) + "' is not an action");
+    } else if (!call && identifier->declaration->isFunction()) {
+        errors.emplace_back(pos, "Action '" + std::string(identifier->identifier) + "' requires arguments");
+    }
+}
+
+void ActionDeclarationNode::late_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    lower(errors);
+}
+
+void ActionDeclarationNode::lower(std::vector<Error>& errors) {
+    if (lowering != UNLOWERED) {return;}
+    lowering = LOWERING;
+    for (auto& statement : body) {
+        lower_statement(statement.get(), errors);
+    }
+    lowering = LOWERED;
+}
+
+void ActionDeclarationNode::lower_statement(const StatementNode* statement, std::vector<Error>& errors, const ExpressionNode* condition) {
+    // Values in the statement refer to the variables as previous statements left them
+    Bindings bindings;
+    for (auto& [variable, value] : assignments) {
+        bindings[variable] = value.get();
+    }
+
+    std::vector<std::pair<DeclarationNode*, unq_ptr<ExpressionNode>>> updates;
+    if (auto assignment = dynamic_cast<const AssignmentStatementNode*>(statement)) {
+        updates.emplace_back(assignment->target->declaration, assignment->value->substitute(bindings));
+    } else {
+        // Inline the called action, binding its parameters to the arguments
+        auto actionCall = (const ActionCallStatementNode*) statement;
+        auto call = dynamic_cast<const CallNode*>(actionCall->action.get());
+        auto identifier = (const IdentifierNode*) (call ? call->function.get() : actionCall->action.get());
+        auto callee = (ActionDeclarationNode*) identifier->declaration;
+
+        if (callee->lowering == LOWERING) {
+            errors.emplace_back(statement->pos, "Action '" + std::string(callee->identifier) + "' cannot be called recursively");
+            return;
+        }
+        callee->lower(errors);
+
+        std::vector<unq_ptr<ExpressionNode>> arguments;
+        Bindings calleeBindings = bindings;
+        for (size_t i = 0; call && i < call->arguments.size(); i++) {
+            arguments.push_back(call->arguments[i]->substitute(bindings));
+            calleeBindings[callee->parameters[i].get()] = arguments.back().get();
+        }
+        for (auto& [variable, value] : callee->assignments) {
+            updates.emplace_back(variable, value->substitute(calleeBindings));
+        }
+    }
+
+    for (auto& [variable, value] : updates) {
+        auto existing = std::find_if(assignments.begin(), assignments.end(), [&](auto& assignment) {return assignment.first == variable;});
+
+        if (condition) {
+            // Only take the new value if the condition holds, otherwise keep the current one
+            unq_ptr<ExpressionNode> current;
+            if (existing != assignments.end()) {
+                current = std::move(existing->second);
+            } else {
+                auto identifier = std::make_unique<IdentifierNode>(variable->pos, variable->identifier, variable->scope, nullptr);
+                identifier->declaration = variable;
+                identifier->type = variable->type;
+                current = std::move(identifier);
+            }
+            Type type = value->type;
+            value = std::make_unique<TernaryOperatorNode>(condition->pos, condition->substitute(bindings), std::move(value), std::move(current));
+            value->type = type;
+        }
+
+        if (existing != assignments.end()) {
+            existing->second = std::move(value);
+        } else {
+            assignments.emplace_back(variable, std::move(value));
+        }
+    }
+}
+
+void TickerNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    if (period && !period->type.matches_primitive(Type::NUM)) {
+        errors.emplace_back(period->pos, "Ticker period must be of type 'num', got '" + period->type.name() + "'");
+    }
+    compiler->ast->tickerSchedule.tickers.push_back(this);
+}
+
+static std::string describe_position(const DeclarationNode* declaration, const SourceMap& lines) {
+    SrcLocation location = lines.locate(declaration->pos);
+    return "'" + std::string(declaration->identifier) + "' (line " + std::to_string(location.line + 1) + ", col " + std::to_string(location.col + 1) + ")";
+}
+
+void ImportStatementNode::semantic_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    if (!module) {return;}
+
+    // The module's definitions are emitted alongside the program's, so their names can't be reused
+    for (auto& statement : compiler->ast->statements) {
+        std::vector<const DeclarationNode*> provided;
+        statement->provided_declarations(provided);
+        for (auto declaration : provided) {
+            if (!declaration->parentStruct && module->defines(declaration->identifier)) {
+                errors.emplace_back(declaration->pos, "'" + std::string(declaration->identifier) + "' is already defined by module '" + module->get_name() + "'");
+            }
+        }
+    }
+}
+
+void MainBlockNode::late_analysis(Compiler* compiler, std::vector<Error>& errors) {
+    // Like an imported module's, the prelude's definitions are emitted alongside the program's
+    if (compiler->prelude) {
+        for (auto& statement : statements) {
+            std::vector<const DeclarationNode*> provided;
+            statement->provided_declarations(provided);
+            for (auto declaration : provided) {
+                if (!declaration->parentStruct && compiler->prelude->defines(declaration->identifier)) {
+                    errors.emplace_back(declaration->pos, "'" + std::string(declaration->identifier) + "' is already defined by the prelude");
+                }
+            }
+        }
+    }
+
+    // Likewise the units of different modules can't define the same name, even one that only they use.
+    // Only the units that are emitted are compared, since the rest of a module never reaches the graph.
+    std::unordered_map<std::string_view, std::pair<const modules::Module*, std::string>> definers;
+    auto check_units = [&](const modules::Module* module, const std::string& description, SrcPos pos) {
+        for (auto name : module->emitted_names()) {
+            auto [definer, inserted] = definers.try_emplace(name, module, description);
+            if (!inserted && definer->second.first != module) {
+                errors.emplace_back(pos, "'" + std::string(name) + "' is defined by both " + definer->second.second + " and " + description);
+            }
+        }
+    };
+    if (compiler->prelude) {
+        check_units(compiler->prelude.get(), "the prelude", pos);
+    }
+    for (auto& statement : statements) {
+        auto import = dynamic_cast<const ImportStatementNode*>(statement.get());
+        if (import && import->module) {
+            check_units(import->module, "module '" + import->module->get_name() + "'", import->pos);
+        }
+    }
+
+    // Desmos can't evaluate cyclic definitions, so catch them here
+    auto cycles = compiler->dependencies.find_cycles();
+    SourceMap lines(cycles.empty() ? "" : compiler->source);
+    for (auto& cycle : cycles) {
+        std::string message = "Cyclic definition: ";
+        for (auto declaration : cycle) {
+            message += describe_position(declaration, lines) + " -> ";
+        }
+        message += "'" + std::string(cycle.front()->identifier) + "'";
+        errors.emplace_back(cycle.front()->pos, message);
+    }
+
+    // Emit each statement after the statements it depends on, otherwise keeping source order
+    std::unordered_map<const DeclarationNode*, size_t> providers;
+    for (size_t i = 0; i < statements.size(); i++) {
+        std::vector<const DeclarationNode*> provided;
+        statements[i]->provided_declarations(provided);
+        for (auto declaration : provided) {providers[declaration] = i;}
+    }
+
+    std::vector<std::vector<size_t>> dependents(statements.size());
+    std::vector<size_t> remainingDependencies(statements.size(), 0);
+    for (size_t i = 0; i < statements.size(); i++) {
+        std::vector<const DeclarationNode*> provided;
+        statements[i]->provided_declarations(provided);
+        std::vector<size_t> dependencies;
+        for (auto declaration : provided) {
+            for (auto dependency : compiler->dependencies.dependencies(declaration)) {
+                auto provider = providers.find(dependency);
+                if (provider == providers.end() || provider->second == i) {continue;}
+                if (std::find(dependencies.begin(), dependencies.end(), provider->second) == dependencies.end()) {
+                    dependencies.push_back(provider->second);
+                }
+            }
+        }
+        for (size_t dependency : dependencies) {
+            dependents[dependency].push_back(i);
+        }
+        remainingDependencies[i] = dependencies.size();
+    }
+
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<>> ready;
+    for (size_t i = 0; i < statements.size(); i++) {
+        if (remainingDependencies[i] == 0) {ready.push(i);}
+    }
+    std::vector<bool> emitted(statements.size(), false);
+    emissionOrder.clear();
+    while (!ready.empty()) {
+        size_t i = ready.top();
+        ready.pop();
+        emitted[i] = true;
+        emissionOrder.push_back(statements[i].get());
+        for (size_t dependent : dependents[i]) {
+            if (--remainingDependencies[dependent] == 0) {ready.push(dependent);}
+        }
+    }
+    // Statements can depend on each other without their declarations forming a cycle (e.g. through a struct's lists)
+    for (size_t i = 0; i < statements.size(); i++) {
+        if (!emitted[i]) {emissionOrder.push_back(statements[i].get());}
+    }
+
+    tickerSchedule.build(errors);
+}
+
+std::optional<double> IdentifierNode::fold() const {
+    if (!declaration || !declaration->type.isConst || !declaration->value || isEvaluating) {return std::nullopt;}
+    isEvaluating = true;
+    std::optional<double> result = declaration->value->constant_value();
+    isEvaluating = false;
+    return result;
+}
+
+std::optional<double> ComprehensionNode::size() const {
+    std::optional<double> first = start->constant_value(), last = end->constant_value();
+    if (!first || !last) {return std::nullopt;}
+    double count = std::floor(std::abs(*last - *first)) + 1;
+    if (std::isnan(count)) {return std::nullopt;}
+    return count;
+}
+
+std::optional<double> CallNode::fold() const {
+    // Only pure builtins of numbers; declared functions depend on the values of their parameters
+    const builtins::Builtin* called = builtin();
+    if (type.isList || !called || !called->isPure || !called->evaluate) {return std::nullopt;}
+    if (called->reduce) {
+        // Numbers given to a builtin of lists, which are combined two at a time
+        if (!called->is_variadic(arguments.size())) {return std::nullopt;}
+        double values[2];
+        for (size_t i = 0; i < arguments.size(); i++) {
+            std::optional<double> value = arguments[i]->constant_value();
+            if (!value) {return std::nullopt;}
+            values[i > 0] = *value;
+            if (i > 0) {values[0] = called->evaluate(values);}
+        }
+        return values[0];
+    }
+    double values[3];
+    for (size_t i = 0; i < arguments.size(); i++) {
+        std::optional<double> value = arguments[i]->constant_value();
+        if (!value) {return std::nullopt;}
+        values[i] = *value;
+    }
+    return called->evaluate(values);
+}
+
+std::optional<double> BinaryOperatorNode::fold() const {
+    if (type.isList) {return std::nullopt;}
+    std::optional<double> l = left->constant_value(), r = right->constant_value();
+    if (!l || !r) {return std::nullopt;}
+    switch (op) {
+        case Operator::PLUS: return *l + *r;
+        case Operator::MINUS: return *l - *r;
+        case Operator::MUL:
+        case Operator::AND:
+            return *l * *r;
+        case Operator::DIV: return *l / *r;
+        case Operator::MOD: return *l - *r * std::floor(*l / *r); // Desmos' mod takes the sign of the divisor
+        case Operator::EXP: return std::pow(*l, *r);
+        case Operator::OR: return std::max(*l, *r);
+        case Operator::LESS: return *l < *r;
+        case Operator::GREATER: return *l > *r;
+        case Operator::LESS_EQUAL: return *l <= *r;
+        case Operator::GREATER_EQUAL: return *l >= *r;
+        case Operator::EQUAL_EQUAL: return *l == *r;
+        case Operator::NOT_EQUAL: return *l != *r;
+        default: return std::nullopt;
+    }
+}
+
+std::optional<double> UnaryOperatorNode::fold() const {
+    if (type.isList) {return std::nullopt;}
+    std::optional<double> value = expr->constant_value();
+    if (!value) {return std::nullopt;}
+    switch (op) {
+        case Operator::MINUS: return -*value;
+        case Operator::INVERT: return 1 - *value;
+        case Operator::ABS: return std::abs(*value);
+        default: return std::nullopt;
+    }
+}
+
+std::optional<double> TernaryOperatorNode::fold() const {
+    if (type.isList) {return std::nullopt;}
+    std::optional<double> value = condition->constant_value();
+    if (!value) {return std::nullopt;}
+    if (*value != 0) {return ifTrue->constant_value();}
+    return ifFalse ? ifFalse->constant_value() : std::nullopt;
 }
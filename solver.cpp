@@ -0,0 +1,157 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <cmath>
+#include <limits>
+#include <optional>
+
+#include "ast.h"
+#include "visitor.h"
+
+using namespace AST;
+
+// Equations whose sides only depend on constants and the unknown are solved numerically at compile time.
+// The range around zero is scanned outwards for a sign change, which Newton's method narrows down to the root,
+// falling back to bisection whenever a step would leave the bracket. Roots that the difference of the sides
+// only touches (like that of x^2 = 0) don't change its sign, so they are left to Newton's method on its own,
+// starting from the scanned point closest to a root.
+namespace {
+
+    constexpr int MAX_ITERATIONS = 100;
+    constexpr int SCAN_STEPS = 64; // Out to 2^63 on either side of zero
+    constexpr double EPSILON = std::numeric_limits<double>::epsilon();
+    constexpr double TOLERANCE = 1e-10; // How close to zero the difference has to get at a root with no sign change
+
+    // Lists the subexpressions that constant folding caches, each after its own subexpressions
+    struct FoldOrderPass {
+        std::vector<ExpressionNode*>& order;
+
+        template <class Node> requires std::derived_from<Node, ExpressionNode>
+        void visit(Node& node) {
+            if constexpr (!std::is_same_v<Node, IdentifierNode>) {order.push_back(&node);}
+        }
+    };
+
+    // left - right as a function of the unknown, evaluated by constant folding a copy of it in which the unknown
+    // is replaced by a constant whose value is changed between evaluations. Each evaluation folds the subexpressions
+    // in an order found once up front, so that every fold() reads its subexpressions' values instead of recursing.
+    class Equation {
+        LiteralNode guess;
+        DeclarationNode constant;
+        IdentifierNode reference;
+        unq_ptr<ExpressionNode> difference;
+        std::vector<ExpressionNode*> order;
+
+    public:
+        explicit Equation(const SolveNode& solve)
+            : guess(solve.pos, Type(Type::NUM, true), 0), constant(solve.pos, Type(Type::NUM, true), solve.unknown->identifier, solve.unknown->scope),
+              reference(solve.pos, solve.unknown->identifier, solve.unknown->scope, nullptr), difference(), order() {
+            constant.value = &guess;
+            reference.declaration = &constant;
+            reference.type = constant.type;
+            Bindings bindings = {{solve.unknown.get(), &reference}};
+            difference = std::make_unique<BinaryOperatorNode>(solve.pos, Operator::MINUS, solve.left->substitute(bindings), solve.right->substitute(bindings));
+            difference->type = Type(Type::NUM);
+            FoldOrderPass foldOrder {order};
+            traverse(difference.get(), foldOrder);
+        }
+
+        // NaN where the equation is undefined, and nullopt if it depends on more than the unknown
+        std::optional<double> operator()(double x) {
+            guess.value = x;
+            for (auto node : order) {
+                node->folded = node->fold();
+                node->isFolded = true;
+            }
+            return difference->constant_value();
+        }
+    };
+
+    // The next Newton step from x, or NaN if the slope can't be found
+    double newton_step(Equation& f, double x, double fx) {
+        double h = std::sqrt(EPSILON) * std::max(1.0, std::abs(x));
+        double slope = (f(x + h).value_or(NAN) - f(x - h).value_or(NAN)) / (2 * h);
+        if (slope == 0 || !std::isfinite(slope)) {return NAN;}
+        return x - fx / slope;
+    }
+
+    bool has_converged(double x, double next) {
+        return std::abs(next - x) <= 4 * EPSILON * std::abs(x);
+    }
+
+    // The root between lo and hi, where f has opposite signs
+    double solve_bracketed(Equation& f, double lo, double hi, double fLo) {
+        double x = (lo + hi) / 2;
+        for (int k = 0; k < MAX_ITERATIONS; k++) {
+            double fx = f(x).value_or(NAN);
+            if (fx == 0) {return x;}
+            // Keeps the half where the sign changes, bisecting if f is undefined at x
+            if (std::isnan(fx) || (fx < 0) == (fLo < 0)) {
+                lo = x;
+                if (!std::isnan(fx)) {fLo = fx;}
+            } else {
+                hi = x;
+            }
+            double next = std::isnan(fx) ? NAN : newton_step(f, x, fx);
+            if (!(next > lo && next < hi)) {next = (lo + hi) / 2;}
+            if (has_converged(x, next)) {return next;}
+            x = next;
+        }
+        return x;
+    }
+
+    std::optional<double> solve_unbracketed(Equation& f, double x) {
+        for (int k = 0; k < MAX_ITERATIONS; k++) {
+            double fx = f(x).value_or(NAN);
+            double next = fx == 0 ? x : newton_step(f, x, fx);
+            if (!std::isfinite(next)) {return std::nullopt;}
+            // Only a step that stops moving is at a root; one that runs off to infinity isn't
+            if (fx == 0 || has_converged(x, next)) {
+                return std::abs(f(next).value_or(NAN)) <= TOLERANCE ? std::optional(next) : std::nullopt;
+            }
+            x = next;
+        }
+        return std::nullopt;
+    }
+}
+
+bool SolveNode::solve() {
+    Equation f(*this);
+    std::optional<double> atZero = f(0);
+    if (!atZero) {return false;}
+
+    // Scans [0, 1], [-1, 0], [1, 2], [-2, -1], [2, 4], ... so that the root closest to zero is found first
+    double best = 0, fBest = std::isnan(*atZero) ? INFINITY : std::abs(*atZero);
+    auto scan = [&](double a, double fA, double b, double fB) -> bool {
+        if (std::abs(fB) < fBest) {
+            best = b;
+            fBest = std::abs(fB);
+        }
+        if (fA == 0) {
+            root = a;
+        } else if (fB == 0) {
+            root = b;
+        } else if ((fA < 0) != (fB < 0) && !std::isnan(fA) && !std::isnan(fB)) {
+            double x = a < b ? solve_bracketed(f, a, b, fA) : solve_bracketed(f, b, a, fB);
+            // The sign also changes across a pole, where f grows instead of shrinking
+            if (std::abs(f(x).value_or(NAN)) <= std::min(std::abs(fA), std::abs(fB))) {root = x;}
+        }
+        return root.has_value();
+    };
+    double near = 0, fPositive = *atZero, fNegative = *atZero;
+    for (int k = 0; k < SCAN_STEPS; k++) {
+        double far = std::ldexp(1.0, k);
+        double fFar = f(far).value_or(NAN);
+        if (scan(near, fPositive, far, fFar)) {break;}
+        double fFarNegative = f(-far).value_or(NAN);
+        if (scan(-near, fNegative, -far, fFarNegative)) {break;}
+        near = far;
+        fPositive = fFar;
+        fNegative = fFarNegative;
+    }
+    if (!root) {root = solve_unbracketed(f, best);}
+    // -0 would be written with its sign
+    if (root) {root = *root + 0.0;}
+    return true;
+}
@@ -0,0 +1,310 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#ifndef DESMOS_COMPILER_VISITOR_H
+#define DESMOS_COMPILER_VISITOR_H
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "ast.h"
+
+// A pass over the AST is a struct with a visit() overload for each kind of node it handles. traverse() switches
+// on each node's kind, so every call goes straight to the overload for the node's concrete type and can be
+// inlined, and any number of passes share a single walk over the tree.
+namespace AST {
+
+    // Calls f with the node as its concrete type
+    template <class F>
+    void visit_kind(ASTNode* node, F&& f) {
+        switch (node->kind) {
+            case NodeKind::LITERAL: f(static_cast<LiteralNode&>(*node)); break;
+            case NodeKind::IDENTIFIER: f(static_cast<IdentifierNode&>(*node)); break;
+            case NodeKind::POINT: f(static_cast<PointNode&>(*node)); break;
+            case NodeKind::LIST: f(static_cast<ListNode&>(*node)); break;
+            case NodeKind::INDEX: f(static_cast<IndexNode&>(*node)); break;
+            case NodeKind::CALL: f(static_cast<CallNode&>(*node)); break;
+            case NodeKind::MEMBER_ACCESS: f(static_cast<MemberAccessNode&>(*node)); break;
+            case NodeKind::STRUCT_INITIALIZER: f(static_cast<StructInitializerNode&>(*node)); break;
+            case NodeKind::BINARY_OPERATOR: f(static_cast<BinaryOperatorNode&>(*node)); break;
+            case NodeKind::UNARY_OPERATOR: f(static_cast<UnaryOperatorNode&>(*node)); break;
+            case NodeKind::TERNARY_OPERATOR: f(static_cast<TernaryOperatorNode&>(*node)); break;
+            case NodeKind::COMPREHENSION: f(static_cast<ComprehensionNode&>(*node)); break;
+            case NodeKind::SOLVE: f(static_cast<SolveNode&>(*node)); break;
+            case NodeKind::DERIVATIVE: f(static_cast<DerivativeNode&>(*node)); break;
+            case NodeKind::DECLARATION: f(static_cast<DeclarationNode&>(*node)); break;
+            case NodeKind::FUNCTION_DECLARATION: f(static_cast<FunctionDeclarationNode&>(*node)); break;
+            case NodeKind::STRUCT_DECLARATION: f(static_cast<StructDeclarationNode&>(*node)); break;
+            case NodeKind::ACTION_DECLARATION: f(static_cast<ActionDeclarationNode&>(*node)); break;
+            case NodeKind::TICKER_STATE_DECLARATION: f(static_cast<TickerStateDeclarationNode&>(*node)); break;
+            case NodeKind::HOISTED_DECLARATION: f(static_cast<HoistedDeclarationNode&>(*node)); break;
+            case NodeKind::STATEMENT_BLOCK: f(static_cast<StatementBlockNode&>(*node)); break;
+            case NodeKind::INITIALIZATION: f(static_cast<InitializationStatementNode&>(*node)); break;
+            case NodeKind::STRUCT_DEFINITION: f(static_cast<StructDefinitionNode&>(*node)); break;
+            case NodeKind::ASSIGNMENT: f(static_cast<AssignmentStatementNode&>(*node)); break;
+            case NodeKind::ACTION_CALL: f(static_cast<ActionCallStatementNode&>(*node)); break;
+            case NodeKind::ACTION_DEFINITION: f(static_cast<ActionDefinitionNode&>(*node)); break;
+            case NodeKind::TICKER: f(static_cast<TickerNode&>(*node)); break;
+            case NodeKind::IMPORT: f(static_cast<ImportStatementNode&>(*node)); break;
+            case NodeKind::TICKER_SCHEDULE: f(static_cast<TickerScheduleNode&>(*node)); break;
+            case NodeKind::MAIN_BLOCK: f(static_cast<MainBlockNode&>(*node)); break;
+            default:
+                throw std::runtime_error("Invalid node kind: " + std::to_string((int) node->kind));
+        }
+    }
+
+    // Calls f on each of the node's children, in the order they are visited
+    template <class F>
+    void for_each_child(ASTNode* node, F&& f) {
+        switch (node->kind) {
+            case NodeKind::POINT: {
+                auto& point = static_cast<PointNode&>(*node);
+                f(point.x.get());
+                f(point.y.get());
+                break;
+            }
+            case NodeKind::LIST:
+                for (auto& element : static_cast<ListNode&>(*node).elements) {f(element.get());}
+                break;
+            case NodeKind::INDEX: {
+                auto& index = static_cast<IndexNode&>(*node);
+                f(index.list.get());
+                f(index.index.get());
+                break;
+            }
+            case NodeKind::CALL: {
+                auto& call = static_cast<CallNode&>(*node);
+                f(call.function.get());
+                for (auto& argument : call.arguments) {f(argument.get());}
+                break;
+            }
+            case NodeKind::MEMBER_ACCESS:
+                f(static_cast<MemberAccessNode&>(*node).object.get());
+                break;
+            case NodeKind::STRUCT_INITIALIZER:
+                for (auto& argument : static_cast<StructInitializerNode&>(*node).arguments) {f(argument.get());}
+                break;
+            case NodeKind::BINARY_OPERATOR: {
+                auto& binop = static_cast<BinaryOperatorNode&>(*node);
+                f(binop.left.get());
+                f(binop.right.get());
+                break;
+            }
+            case NodeKind::UNARY_OPERATOR:
+                f(static_cast<UnaryOperatorNode&>(*node).expr.get());
+                break;
+            case NodeKind::TERNARY_OPERATOR: {
+                auto& ternary = static_cast<TernaryOperatorNode&>(*node);
+                f(ternary.condition.get());
+                f(ternary.ifTrue.get());
+                if (ternary.ifFalse) {f(ternary.ifFalse.get());}
+                break;
+            }
+            case NodeKind::COMPREHENSION: {
+                // Once unrolled, only the list is left
+                auto& comprehension = static_cast<ComprehensionNode&>(*node);
+                if (comprehension.unrolled) {
+                    f(comprehension.unrolled.get());
+                } else {
+                    f(comprehension.start.get());
+                    f(comprehension.end.get());
+                    f(comprehension.body.get());
+                }
+                break;
+            }
+            case NodeKind::SOLVE: {
+                // Once solved, only the solution is left
+                auto& solve = static_cast<SolveNode&>(*node);
+                if (!solve.root) {
+                    f(solve.left.get());
+                    f(solve.right.get());
+                }
+                break;
+            }
+            case NodeKind::DERIVATIVE: {
+                // Once differentiated, only the derivative is left
+                auto& derivative = static_cast<DerivativeNode&>(*node);
+                if (derivative.derivative) {
+                    f(derivative.derivative.get());
+                } else {
+                    f(derivative.expr.get());
+                    f(derivative.variable.get());
+                }
+                break;
+            }
+            case NodeKind::FUNCTION_DECLARATION:
+                for (auto& param : static_cast<FunctionDeclarationNode&>(*node).parameters) {f(param.get());}
+                break;
+            case NodeKind::STRUCT_DECLARATION: {
+                auto& declaration = static_cast<StructDeclarationNode&>(*node);
+                for (auto& field : declaration.fields) {f(field.get());}
+                for (auto& member : declaration.members) {f(member.get());}
+                break;
+            }
+            case NodeKind::ACTION_DECLARATION: {
+                auto& declaration = static_cast<ActionDeclarationNode&>(*node);
+                for (auto& statement : declaration.body) {f(statement.get());}
+                for (auto& param : declaration.parameters) {f(param.get());}
+                break;
+            }
+            case NodeKind::STATEMENT_BLOCK:
+                for (auto& statement : static_cast<StatementBlockNode&>(*node).statements) {f(statement.get());}
+                break;
+            case NodeKind::INITIALIZATION: {
+                auto& initialization = static_cast<InitializationStatementNode&>(*node);
+                f(initialization.declaration.get());
+                f(initialization.value.get());
+                break;
+            }
+            case NodeKind::STRUCT_DEFINITION:
+                f(static_cast<StructDefinitionNode&>(*node).declaration.get());
+                break;
+            case NodeKind::ASSIGNMENT: {
+                auto& assignment = static_cast<AssignmentStatementNode&>(*node);
+                f(assignment.target.get());
+                f(assignment.value.get());
+                break;
+            }
+            case NodeKind::ACTION_CALL:
+                f(static_cast<ActionCallStatementNode&>(*node).action.get());
+                break;
+            case NodeKind::ACTION_DEFINITION:
+                f(static_cast<ActionDefinitionNode&>(*node).declaration.get());
+                break;
+            case NodeKind::TICKER: {
+                auto& ticker = static_cast<TickerNode&>(*node);
+                f(ticker.action.get());
+                if (ticker.period) {f(ticker.period.get());}
+                break;
+            }
+            case NodeKind::MAIN_BLOCK:
+                for (auto& statement : static_cast<MainBlockNode&>(*node).statements) {f(statement.get());}
+                break;
+            default:
+                // No children
+                break;
+        }
+    }
+
+    // Calls f on each slot holding a subexpression of an expression (not a call's function), so that passes can
+    // replace the subexpression
+    template <class F>
+    void for_each_slot(ExpressionNode* node, F&& f) {
+        switch (node->kind) {
+            case NodeKind::POINT: {
+                auto point = static_cast<PointNode*>(node);
+                f(point->x);
+                f(point->y);
+                break;
+            }
+            case NodeKind::LIST:
+                for (auto& element : static_cast<ListNode*>(node)->elements) {f(element);}
+                break;
+            case NodeKind::INDEX: {
+                auto index = static_cast<IndexNode*>(node);
+                f(index->list);
+                f(index->index);
+                break;
+            }
+            case NodeKind::CALL:
+                for (auto& argument : static_cast<CallNode*>(node)->arguments) {f(argument);}
+                break;
+            case NodeKind::MEMBER_ACCESS:
+                f(static_cast<MemberAccessNode*>(node)->object);
+                break;
+            case NodeKind::BINARY_OPERATOR: {
+                auto binop = static_cast<BinaryOperatorNode*>(node);
+                f(binop->left);
+                f(binop->right);
+                break;
+            }
+            case NodeKind::UNARY_OPERATOR:
+                f(static_cast<UnaryOperatorNode*>(node)->expr);
+                break;
+            case NodeKind::TERNARY_OPERATOR: {
+                auto ternary = static_cast<TernaryOperatorNode*>(node);
+                f(ternary->condition);
+                f(ternary->ifTrue);
+                if (ternary->ifFalse) {f(ternary->ifFalse);}
+                break;
+            }
+            case NodeKind::COMPREHENSION: {
+                auto comprehension = static_cast<ComprehensionNode*>(node);
+                if (comprehension->unrolled) {
+                    f(comprehension->unrolled);
+                } else {
+                    f(comprehension->start);
+                    f(comprehension->end);
+                    f(comprehension->body);
+                }
+                break;
+            }
+            case NodeKind::SOLVE: {
+                auto solve = static_cast<SolveNode*>(node);
+                if (!solve->root) {
+                    f(solve->left);
+                    f(solve->right);
+                }
+                break;
+            }
+            case NodeKind::DERIVATIVE: {
+                auto derivative = static_cast<DerivativeNode*>(node);
+                if (derivative->derivative) {
+                    f(derivative->derivative);
+                } else {
+                    f(derivative->expr);
+                    f(derivative->variable);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Whether the node is an expression held by more than one parent
+    inline bool is_shared(const ASTNode* node) {
+        return node->kind <= NodeKind::DERIVATIVE && static_cast<const ExpressionNode*>(node)->owners > 1;
+    }
+
+    // Passes only see the nodes they have a visit() overload for
+    template <class Pass, class Node>
+    void visit_if_handled(Pass& pass, Node& node) {
+        if constexpr (requires {pass.visit(node);}) {
+            pass.visit(node);
+        }
+    }
+
+    // Visits every node of the tree, children before their parents. Every pass visits a node, in the order
+    // the passes are given, before the walk moves on, so later passes can use what earlier ones found out about
+    // the same node. Uses an explicit stack, so that deeply nested expressions can't overflow the native stack.
+    // Shared subexpressions are only visited the first time they are reached, so passes work on each once.
+    template <class... Passes>
+    void traverse(ASTNode* root, Passes&... passes) {
+        std::vector<std::pair<ASTNode*, bool>> stack = {{root, false}}; // (node, whether its children are on the stack)
+        std::unordered_set<const ASTNode*> sharedExpanded;
+        while (!stack.empty()) {
+            auto [node, isExpanded] = stack.back();
+            if (isExpanded) {
+                stack.pop_back();
+                visit_kind(node, [&](auto& concrete) {(visit_if_handled(passes, concrete), ...);});
+                continue;
+            }
+
+            if (is_shared(node) && !sharedExpanded.insert(node).second) {
+                // Already visited through another parent
+                stack.pop_back();
+                continue;
+            }
+            stack.back().second = true;
+            size_t first = stack.size();
+            for_each_child(node, [&](ASTNode* child) {stack.emplace_back(child, false);});
+            std::reverse(stack.begin() + (long) first, stack.end());
+        }
+    }
+}
+
+#endif //DESMOS_COMPILER_VISITOR_H
@@ -0,0 +1,450 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "vm.h"
+#include "ast.h"
+#include "builtins.h"
+
+using namespace vm;
+
+static constexpr double UNDEFINED = std::numeric_limits<double>::quiet_NaN();
+
+Value Value::list(bool isPoint, size_t size) {
+    Value result;
+    result.kind = isPoint ? POINT_LIST : NUM_LIST;
+    result.xs.resize(size);
+    if (isPoint) {result.ys.resize(size);}
+    return result;
+}
+
+static void print_number(std::ostream& out, double x) {
+    if (std::isnan(x)) {
+        out << "undefined";
+    } else {
+        out << x;
+    }
+}
+
+void Value::print(std::ostream& out) const {
+    auto print_element = [&](size_t i) {
+        if (is_point()) {
+            out << "(";
+            print_number(out, x_at(i));
+            out << ", ";
+            print_number(out, y_at(i));
+            out << ")";
+        } else {
+            print_number(out, x_at(i));
+        }
+    };
+
+    if (!is_list()) {
+        print_element(0);
+        return;
+    }
+    out << "[";
+    for (size_t i = 0; i < size(); i++) {
+        if (i > 0) {out << ", ";}
+        print_element(i);
+    }
+    out << "]";
+}
+
+long Program::find_action(std::string_view name) const {
+    for (size_t i = 0; i < actions.size(); i++) {
+        if (actions[i].name == name) {return (long) i;}
+    }
+    return -1;
+}
+
+// Applies an operation to each element of the operands, broadcasting single values over lists.
+// Like Desmos, operations on lists of different lengths stop at the end of the shortest one.
+template <class F>
+static Value elementwise(bool isPoint, std::initializer_list<const Value*> operands, F&& element) {
+    bool isList = false;
+    size_t size = std::numeric_limits<size_t>::max();
+    for (const Value* operand : operands) {
+        if (operand->is_list()) {
+            isList = true;
+            size = std::min(size, operand->size());
+        }
+    }
+
+    if (!isList) {
+        Value result = isPoint ? Value::point(0, 0) : Value::number(0);
+        element(0, result.x, result.y);
+        return result;
+    }
+    Value result = Value::list(isPoint, size);
+    double y = 0;
+    for (size_t i = 0; i < size; i++) {
+        element(i, result.xs[i], isPoint ? result.ys[i] : y);
+    }
+    return result;
+}
+
+static double apply(OpCode op, double a, double b) {
+    switch (op) {
+        case OpCode::ADD: return a + b;
+        case OpCode::SUB: return a - b;
+        case OpCode::MUL:
+        case OpCode::AND: return a * b;
+        case OpCode::DIV: return a / b;
+        case OpCode::MOD: return a - b * std::floor(a / b); // Desmos' mod takes the sign of the divisor
+        case OpCode::POW: return std::pow(a, b);
+        case OpCode::OR: return (std::isnan(a) || std::isnan(b)) ? UNDEFINED : std::max(a, b);
+        case OpCode::LESS: return a < b;
+        case OpCode::GREATER: return a > b;
+        case OpCode::LESS_EQUAL: return a <= b;
+        case OpCode::GREATER_EQUAL: return a >= b;
+        case OpCode::EQUAL: return a == b;
+        case OpCode::NOT_EQUAL: return !(a == b);
+        default:
+            throw std::runtime_error("Invalid binary opcode: " + std::to_string((int) op));
+    }
+}
+
+static Value binary(OpCode op, const Value& a, const Value& b) {
+    // Points are added componentwise and scaled by numbers
+    bool isPoint = false;
+    if (op == OpCode::ADD || op == OpCode::SUB || op == OpCode::DIV) {
+        isPoint = a.is_point();
+    } else if (op == OpCode::MUL) {
+        isPoint = a.is_point() || b.is_point();
+    }
+
+    return elementwise(isPoint, {&a, &b}, [&](size_t i, double& x, double& y) {
+        if (!isPoint) {
+            x = apply(op, a.x_at(i), b.x_at(i));
+        } else if (op == OpCode::MUL && !a.is_point()) {
+            x = a.x_at(i) * b.x_at(i);
+            y = a.x_at(i) * b.y_at(i);
+        } else if (op == OpCode::MUL || op == OpCode::DIV) {
+            x = apply(op, a.x_at(i), b.x_at(i));
+            y = apply(op, a.y_at(i), b.x_at(i));
+        } else {
+            x = apply(op, a.x_at(i), b.x_at(i));
+            y = apply(op, a.y_at(i), b.y_at(i));
+        }
+    });
+}
+
+static Value unary(OpCode op, const Value& a) {
+    return elementwise(a.is_point(), {&a}, [&](size_t i, double& x, double& y) {
+        switch (op) {
+            case OpCode::NEG:
+                x = -a.x_at(i);
+                y = -a.y_at(i);
+                break;
+            case OpCode::ABS:
+                x = std::abs(a.x_at(i));
+                break;
+            case OpCode::NOT:
+                x = 1 - a.x_at(i);
+                break;
+            default:
+                throw std::runtime_error("Invalid unary opcode: " + std::to_string((int) op));
+        }
+    });
+}
+
+static Value index(const Value& list, const Value& index) {
+    return elementwise(list.is_point(), {&index}, [&](size_t i, double& x, double& y) {
+        double k = std::round(index.x_at(i));
+        if (!(k >= 0 && k < (double) list.size())) {
+            // Out of range
+            x = y = UNDEFINED;
+            return;
+        }
+        x = list.x_at((size_t) k);
+        y = list.y_at((size_t) k);
+    });
+}
+
+static Value element(const Value& list, size_t i) {
+    return list.is_point() ? Value::point(list.x_at(i), list.y_at(i)) : Value::number(list.x_at(i));
+}
+
+Machine::Machine(const Program& program) : program(program), globals(), assigned(), registers() {}
+
+void Machine::reset() {
+    globals.assign(program.globalNames.size(), Value::number(UNDEFINED));
+    assigned.assign(program.globalNames.size(), false);
+    execute(program.update, 0, nullptr);
+}
+
+void Machine::run_action(size_t action) {
+    execute(program.actions.at(action), 0, nullptr);
+    execute(program.update, 0, nullptr);
+}
+
+bool Machine::tick() {
+    if (program.ticker < 0) {return false;}
+    run_action(program.ticker);
+    return true;
+}
+
+void Machine::print_globals(std::ostream& out) const {
+    for (size_t i = 0; i < globals.size(); i++) {
+        out << program.globalNames[i] << " = ";
+        globals[i].print(out);
+        out << std::endl;
+    }
+}
+
+// Builtins of numbers apply elementwise, like operators, while builtins of lists reduce the list to a number
+static Value call_builtin(const builtins::Builtin* builtin, const Value* arguments, size_t count) {
+    if (builtin->is_variadic(count)) {
+        double values[2] = {arguments[0].x};
+        for (size_t k = 1; k < count; k++) {
+            values[1] = arguments[k].x;
+            values[0] = builtin->evaluate(values);
+        }
+        return Value::number(values[0]);
+    }
+    if (builtin->reduce) {return Value::number(builtin->reduce(arguments[0].xs));}
+    double values[3];
+    // The first argument stands in for a missing second one, which doesn't change the result's size
+    return elementwise(false, {&arguments[0], &arguments[count > 1]}, [&](size_t i, double& x, double&) {
+        for (size_t k = 0; k < count; k++) {values[k] = arguments[k].x_at(i);}
+        x = builtin->evaluate(values);
+    });
+}
+
+void Machine::execute(const Chunk& chunk, size_t base, Value* result) {
+    if (registers.size() < base + chunk.registerCount) {
+        registers.resize(base + chunk.registerCount);
+    }
+
+    size_t pc = 0;
+    while (pc < chunk.code.size()) {
+        const Instruction& instruction = chunk.code[pc++];
+        // Calls can grow the registers, so they are looked up again for every instruction
+        Value* r = registers.data() + base;
+        Value& dest = r[instruction.dest];
+
+        switch (instruction.op) {
+            case OpCode::LOAD_CONST:
+                dest = program.constants[instruction.a];
+                break;
+            case OpCode::LOAD_GLOBAL:
+                dest = globals[instruction.a];
+                break;
+            case OpCode::DEFINE_GLOBAL:
+                if (!assigned[instruction.a]) {globals[instruction.a] = dest;}
+                break;
+            case OpCode::ASSIGN_GLOBAL:
+                globals[instruction.a] = dest;
+                assigned[instruction.a] = true;
+                break;
+            case OpCode::MOVE:
+                dest = r[instruction.a];
+                break;
+
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+            case OpCode::DIV:
+            case OpCode::MOD:
+            case OpCode::POW:
+            case OpCode::AND:
+            case OpCode::OR:
+            case OpCode::LESS:
+            case OpCode::GREATER:
+            case OpCode::LESS_EQUAL:
+            case OpCode::GREATER_EQUAL:
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL:
+                dest = binary(instruction.op, r[instruction.a], r[instruction.b]);
+                break;
+            case OpCode::NEG:
+            case OpCode::ABS:
+            case OpCode::NOT:
+                dest = unary(instruction.op, r[instruction.a]);
+                break;
+
+            case OpCode::MAKE_POINT: {
+                const Value& x = r[instruction.a];
+                const Value& y = r[instruction.b];
+                dest = elementwise(true, {&x, &y}, [&](size_t i, double& px, double& py) {
+                    px = x.x_at(i);
+                    py = y.x_at(i);
+                });
+                break;
+            }
+            case OpCode::POINT_X:
+            case OpCode::POINT_Y: {
+                const Value& point = r[instruction.a];
+                bool isX = instruction.op == OpCode::POINT_X;
+                dest = elementwise(false, {&point}, [&](size_t i, double& x, double&) {
+                    x = isX ? point.x_at(i) : point.y_at(i);
+                });
+                break;
+            }
+            case OpCode::MAKE_LIST: {
+                // c is 1 for lists of points
+                Value list = Value::list(instruction.c == 1, instruction.b);
+                for (size_t i = 0; i < instruction.b; i++) {
+                    const Value& item = r[instruction.a + i];
+                    list.xs[i] = item.is_list() ? UNDEFINED : item.x;
+                    if (instruction.c == 1) {list.ys[i] = item.is_list() ? UNDEFINED : item.y;}
+                }
+                dest = std::move(list);
+                break;
+            }
+            case OpCode::RANGE: {
+                const Value& first = r[instruction.a];
+                const Value& last = r[instruction.b];
+                double count = std::floor(std::abs(last.x - first.x)) + 1;
+                // Undefined for bad bounds, like in Desmos
+                if (first.is_list() || last.is_list() || std::isnan(count) || count > AST::ComprehensionNode::MAX_SIZE) {
+                    dest = Value::list(false, 0);
+                    break;
+                }
+                double step = last.x < first.x ? -1 : 1;
+                Value list = Value::list(false, (size_t) count);
+                for (size_t i = 0; i < list.xs.size(); i++) {
+                    list.xs[i] = first.x + (double) i * step;
+                }
+                dest = std::move(list);
+                break;
+            }
+            case OpCode::INDEX:
+                dest = index(r[instruction.a], r[instruction.b]);
+                break;
+            case OpCode::SELECT: {
+                const Value& condition = r[instruction.a];
+                const Value& ifTrue = r[instruction.b];
+                const Value& ifFalse = r[instruction.c];
+                if (!condition.is_list()) {
+                    // Only the taken branch was evaluated
+                    dest = condition.x == 1 ? ifTrue : ifFalse;
+                    break;
+                }
+                dest = elementwise(ifTrue.is_point() || ifFalse.is_point(), {&condition, &ifTrue, &ifFalse}, [&](size_t i, double& x, double& y) {
+                    const Value& taken = condition.x_at(i) == 1 ? ifTrue : ifFalse;
+                    x = taken.x_at(i);
+                    y = taken.is_point() ? taken.y_at(i) : UNDEFINED;
+                });
+                break;
+            }
+
+            case OpCode::JUMP:
+                pc = instruction.a;
+                break;
+            case OpCode::JUMP_UNLESS:
+                if (!r[instruction.a].is_list() && r[instruction.a].x != 1) {pc = instruction.b;}
+                break;
+            case OpCode::JUMP_IF_SINGLE:
+                if (!r[instruction.a].is_list()) {pc = instruction.b;}
+                break;
+            case OpCode::CALL:
+                call(chunk, instruction, base);
+                break;
+            case OpCode::BUILTIN:
+                dest = call_builtin(builtins::at(instruction.a), &r[instruction.b], instruction.c);
+                break;
+            case OpCode::RETURN:
+                if (result) {*result = std::move(dest);}
+                return;
+        }
+    }
+}
+
+void Machine::call(const Chunk& caller, const Instruction& instruction, size_t base) {
+    const Chunk& function = program.functions[instruction.a];
+    if (++callDepth > MAX_CALL_DEPTH) {
+        callDepth = 0;
+        throw std::runtime_error("Maximum call depth exceeded in '" + function.name + "'");
+    }
+
+    // The callee's frame starts after the caller's registers
+    size_t frame = base + caller.registerCount;
+    size_t argumentCount = instruction.c;
+    auto argument = [&](size_t k) -> const Value& {return registers[base + instruction.b + k];};
+
+    bool isList = false;
+    size_t size = std::numeric_limits<size_t>::max();
+    for (size_t k = 0; k < argumentCount; k++) {
+        if (argument(k).is_list()) {
+            isList = true;
+            size = std::min(size, argument(k).size());
+        }
+    }
+
+    if (registers.size() < frame + function.registerCount) {
+        registers.resize(frame + function.registerCount);
+    }
+    if (!isList) {
+        for (size_t k = 0; k < argumentCount; k++) {
+            registers[frame + k] = argument(k);
+        }
+        Value result;
+        execute(function, frame, &result);
+        registers[base + instruction.dest] = std::move(result);
+        callDepth--;
+        return;
+    }
+
+    // Functions are called once for each element of list arguments
+    std::vector<Value> results;
+    results.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        for (size_t k = 0; k < argumentCount; k++) {
+            registers[frame + k] = argument(k).is_list() ? element(argument(k), i) : argument(k);
+        }
+        execute(function, frame, &results.emplace_back());
+    }
+
+    bool isPoint = !results.empty() && results.front().is_point();
+    Value list = Value::list(isPoint, size);
+    for (size_t i = 0; i < size; i++) {
+        // Lists can't contain other lists
+        list.xs[i] = results[i].is_list() ? UNDEFINED : results[i].x;
+        if (isPoint) {list.ys[i] = results[i].is_list() ? UNDEFINED : results[i].y;}
+    }
+    registers[base + instruction.dest] = std::move(list);
+    callDepth--;
+}
+
+bool Compiler::simulate_program(std::string& source, long ticks, std::ostream& out) {
+    Compiler compiler;
+    if (!compiler.compile_frontend(source)) {return false;}
+    if (!compiler.importedModules.empty()) {
+        // Modules only hold LaTeX, so there is nothing to run for imported definitions
+        std::cerr << "Error: Programs that import modules can't be simulated" << std::endl;
+        return false;
+    }
+
+    Program program;
+    try {
+        program = vm::compile(&compiler);
+    } catch (const std::runtime_error& error) {
+        std::cerr << "Error: " << error.what() << std::endl;
+        return false;
+    }
+    Machine machine(program);
+    try {
+        auto start = std::chrono::steady_clock::now();
+        machine.reset();
+        long ran = 0;
+        while (ran < ticks && machine.tick()) {ran++;}
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        machine.print_globals(out);
+        std::cerr << "Simulated " << ran << " ticks (" << ran * program.tickerPeriod << " ms of graph time) in "
+                  << elapsed.count() << " ms" << std::endl;
+    } catch (const std::runtime_error& error) {
+        std::cerr << "Error during simulation: " << error.what() << std::endl;
+        return false;
+    }
+    return true;
+}
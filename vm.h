@@ -0,0 +1,172 @@
+//
+// Created by Cooper Roalson on 10/19/26.
+//
+
+#ifndef DESMOS_COMPILER_VM_H
+#define DESMOS_COMPILER_VM_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <unordered_map>
+
+#include "compiler.h"
+
+// Headless evaluator for compiled graphs: the checked AST is compiled to register bytecode that computes
+// the same values Desmos would, so graph logic can be tested and profiled without a browser.
+namespace vm {
+
+    // A Desmos value: a number (bools are 0/1), a point, or a list of either
+    struct Value {
+        enum Kind : uint8_t {NUM, POINT, NUM_LIST, POINT_LIST};
+
+        Kind kind = NUM;
+        double x = 0, y = 0;
+        std::vector<double> xs, ys; // Elements of lists (ys only for point lists)
+
+        bool is_list() const {return kind == NUM_LIST || kind == POINT_LIST;}
+        bool is_point() const {return kind == POINT || kind == POINT_LIST;}
+        size_t size() const {return is_list() ? xs.size() : 1;}
+        // Elements of a list, or the value itself for single values (broadcasting)
+        double x_at(size_t i) const {return is_list() ? xs[i] : x;}
+        double y_at(size_t i) const {return kind == POINT_LIST ? ys[i] : y;}
+
+        static Value number(double x) {return {NUM, x, 0, {}, {}};}
+        static Value point(double x, double y) {return {POINT, x, y, {}, {}};}
+        static Value list(bool isPoint, size_t size);
+
+        void print(std::ostream& out) const;
+    };
+
+    enum class OpCode : uint8_t {
+        LOAD_CONST,    // dest = constants[a]
+        LOAD_GLOBAL,   // dest = globals[a]
+        DEFINE_GLOBAL, // globals[a] = dest, unless an action has assigned it
+        ASSIGN_GLOBAL, // globals[a] = dest
+        MOVE,          // dest = a
+
+        ADD, SUB, MUL, DIV, MOD, POW, AND, OR,                   // dest = a op b
+        LESS, GREATER, LESS_EQUAL, GREATER_EQUAL, EQUAL, NOT_EQUAL, // dest = a op b ? 1 : 0
+        NEG, ABS, NOT,                                           // dest = op a
+
+        MAKE_POINT, // dest = (a, b)
+        POINT_X,    // dest = a.x
+        POINT_Y,    // dest = a.y
+        MAKE_LIST,  // dest = [a, a+1, ..., a+b-1]
+        RANGE,      // dest = [a...b], counting by 1 (down if b < a)
+        INDEX,      // dest = a[b] (0-indexed)
+        SELECT,     // dest = a ? b : c, elementwise if a is a list
+
+        JUMP,           // continue at a
+        JUMP_UNLESS,    // continue at b if a is a single value that isn't true
+        JUMP_IF_SINGLE, // continue at b if a isn't a list
+        CALL,           // dest = functions[a](b, b+1, ..., b+c-1), broadcast over list arguments
+        BUILTIN,        // dest = the builtin at index a of the catalog (b, b+1, ..., b+c-1), likewise
+        RETURN          // return dest
+    };
+
+    struct Instruction {
+        OpCode op;
+        uint32_t dest, a, b, c;
+    };
+
+    struct Chunk {
+        std::string name;
+        std::vector<Instruction> code;
+        uint32_t registerCount = 0; // Most registers in use at once. Parameters are passed in the first registers
+    };
+
+    // Global slots and function indices of declarations, shared by every chunk of a program
+    struct Symbols {
+        std::unordered_map<const AST::DeclarationNode*, uint32_t> globals;
+        std::unordered_map<const AST::DeclarationNode*, uint32_t> functions;
+    };
+
+    struct Program {
+        Symbols symbols;
+        std::vector<Value> constants;
+        std::vector<Chunk> functions;
+        Chunk update; // Recomputes every global in dependency order, like Desmos does after any change
+        std::vector<Chunk> actions; // Parameterless actions, which only assign globals
+        std::vector<std::string> globalNames;
+
+        long ticker = -1; // Index of the ticker's action, if there is one
+        long tickerPeriod = 0; // ms
+
+        long find_action(std::string_view name) const;
+    };
+
+    class Machine {
+        static constexpr size_t MAX_CALL_DEPTH = 4096;
+
+        const Program& program;
+        std::vector<Value> globals;
+        std::vector<bool> assigned; // Globals whose definition has been replaced by an action
+        std::vector<Value> registers; // Frames of every active call
+        size_t callDepth = 0;
+
+        void execute(const Chunk& chunk, size_t base, Value* result);
+        void call(const Chunk& caller, const Instruction& instruction, size_t base);
+
+    public:
+        explicit Machine(const Program& program);
+
+        void reset();
+        void run_action(size_t action);
+        // Runs the ticker once, returning false if the program has no ticker
+        bool tick();
+
+        const std::vector<Value>& global_values() const {return globals;}
+        void print_globals(std::ostream& out) const;
+    };
+
+    // Compiles a checked AST to bytecode. Nodes emit their own code through this (see ExpressionNode::compile_bytecode).
+    // Subexpressions are compiled with an explicit stack instead of by recursing into them, so that deeply nested
+    // expressions can't overflow the native stack: a node queues its subexpressions and the code that follows each of
+    // them, and these run in order once the node has returned.
+    class Assembler {
+        struct Step {
+            const AST::ExpressionNode* node; // Compiled into dest, or nullptr to run then instead
+            uint32_t dest;
+            std::function<void()> then;
+        };
+
+        Program& program;
+        Chunk& chunk;
+        std::unordered_map<const AST::DeclarationNode*, uint32_t> locals; // Parameters of the function being compiled
+        std::vector<Step> stack; // Top runs next
+        std::vector<Step> pending; // Queued by the step being run
+        uint32_t top = 0; // Registers from here on are free
+
+    public:
+        Assembler(Program& program, Chunk& chunk) : program(program), chunk(chunk), locals(), stack(), pending() {}
+
+        // Queues a subexpression to be compiled into dest
+        void compile(const AST::ExpressionNode* node, uint32_t dest) {pending.push_back({node, dest, nullptr});}
+        // Queues code to emit once everything queued before it has been compiled
+        void then(std::function<void()> step) {pending.push_back({nullptr, 0, std::move(step)});}
+        // Compiles everything that has been queued
+        void finish();
+
+        // Registers are allocated like a stack: releasing one frees it and everything allocated after it
+        uint32_t allocate(size_t count = 1);
+        void release(uint32_t first) {top = first;}
+        void bind_local(const AST::DeclarationNode* declaration, uint32_t reg) {locals[declaration] = reg;}
+
+        size_t emit(OpCode op, uint32_t dest, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+        size_t position() const {return chunk.code.size();}
+        void patch_jump(size_t jump, size_t target);
+
+        uint32_t constant(Value value);
+        // Emits code that loads a declaration's current value into dest
+        void load(const AST::DeclarationNode* declaration, uint32_t dest);
+        uint32_t function(const AST::DeclarationNode* declaration) const;
+        uint32_t global(const AST::DeclarationNode* declaration) const;
+    };
+
+    Program compile(const Compiler* compiler);
+}
+
+#endif //DESMOS_COMPILER_VM_H